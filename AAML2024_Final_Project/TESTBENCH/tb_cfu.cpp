@@ -0,0 +1,289 @@
+//============================================================================//
+// AAML2024 Final Project - CFU co-simulation                                 //
+// file: tb_cfu.cpp                                                           //
+// description: Verilator testbench for the Cfu top (cfu.v). Replays a CFU    //
+//              op trace written by the software CFU (aaml_host --trace),     //
+//              checks every response against the model and reports the      //
+//              cycles per op and the busy/idle cycles of the CFU.           //
+//============================================================================//
+//
+// usage: tb_cfu TRACE [--gap N] [--max-ops N]
+//
+//   --gap N      idle cycles between two ops, standing in for the CPU (2)
+//   --max-ops N  stop after N ops
+//
+// Trace lines are "funct3 funct7 rs1 rs2 rsp" in hex; "# ..." lines mark the
+// op of the model that issued them. Status polls of cfuop_sa depend on timing,
+// so a run of polls in the trace is replayed as "poll until idle" and is not
+// checked.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+#include "VCfu.h"
+#include "verilated.h"
+
+namespace {
+
+const uint64_t kTimeout = 1000000;
+
+struct OpStats {
+  uint64_t count = 0;
+  uint64_t cycles = 0;
+  uint64_t max_cycles = 0;
+};
+
+const char* op_name(int funct3, int funct7, uint32_t rs2) {
+  if (funct3 == 0) {
+    switch (funct7) {
+      case 0x00: return (rs2 & 7) == 5 ? "sa.poll_status" : "sa.read_config";
+      case 0x40: return "sa.write_config";
+      case 0x42: return "sa.write_qparam";
+      case 0x10: return "sa.read_buff_a";
+      case 0x50: return "sa.write_buff_a";
+      case 0x20: return "sa.read_buff_b";
+      case 0x60: return "sa.write_buff_b";
+      case 0x30: return "sa.read_buff_c";
+      case 0x70: return "sa.write_buff_c";
+      case 0x32: return "sa.read_buff_c_q";
+      case 0x01: return "sa.compute";
+      case 0x03: return "sa.compute_async";
+    }
+    return "sa.?";
+  }
+  if (funct3 == 1) {
+    switch (funct7) {
+      case 0: return "add.set_offset_shift";
+      case 1: return "add.set_multiplier";
+      case 2: return "add.add4";
+      case 3: return "add.write_bcast";
+      case 4: return "add.set_bcast";
+      case 5: return "add.add4_bcast";
+      case 6: return "add.set_input2";
+      case 7: return "add.set_output";
+    }
+    return "add.?";
+  }
+  if (funct3 == 2) {
+    switch (funct7) {
+      case 0: return "simd.reset_acc";
+      case 1: return "simd.mac4";
+      case 2: return "simd.set_bias_offset";
+      case 3: return "simd.requant";
+      case 4: return "simd.set_acc";
+      case 5: return "simd.reset_lanes";
+      case 6: return "simd.mac_lanes";
+      case 7: return "simd.read_lane";
+      case 8: return "simd.set_input_offset";
+    }
+    return "simd.?";
+  }
+  if (funct3 == 3) {
+    switch (funct7) {
+      case 0: return "softmax.set_beta";
+      case 1: return "softmax.begin_row";
+      case 2: return "softmax.exp_sum4";
+      case 3: return "softmax.reciprocal";
+      case 4: return "softmax.prob4";
+    }
+    return "softmax.?";
+  }
+  if (funct3 == 4) {
+    switch (funct7) {
+      case 0: return "act.write_table";
+      case 1: return "act.lookup4";
+      case 2: return "act.set_int16";
+      case 3: return "act.eval2";
+    }
+    return "act.?";
+  }
+  if (funct3 == 5) {
+    switch (funct7) {
+      case 0: return "pool.set_clamp";
+      case 1: return "pool.set_divisor";
+      case 2: return "pool.clear";
+      case 3: return "pool.sum8";
+      case 4: return "pool.max8";
+      case 5: return "pool.avg4";
+      case 6: return "pool.max4";
+    }
+    return "pool.?";
+  }
+  return "?";
+}
+
+bool is_poll(int funct3, int funct7, uint32_t rs2) {
+  return funct3 == 0 && funct7 == 0x00 && (rs2 & 7) == 5;
+}
+
+class Harness {
+ public:
+  Harness() : top_(new VCfu) {
+    top_->clk = 0;
+    top_->cmd_valid = 0;
+    top_->rsp_ready = 1;
+    top_->reset = 1;
+    for (int i = 0; i < 4; ++i) {
+      tick();
+    }
+    top_->reset = 0;
+    tick();
+    cycles_ = 0;
+  }
+
+  ~Harness() {
+    top_->final();
+    delete top_;
+  }
+
+  void idle(int n) {
+    for (int i = 0; i < n; ++i) {
+      tick();
+    }
+    idle_cycles_ += n;
+  }
+
+  // Issue one op; returns its response, and its cycles in *op_cycles
+  uint32_t op(int funct3, int funct7, uint32_t rs1, uint32_t rs2, uint64_t* op_cycles) {
+    top_->cmd_payload_function_id = (funct7 << 3) | funct3;
+    top_->cmd_payload_inputs_0 = rs1;
+    top_->cmd_payload_inputs_1 = rs2;
+    top_->cmd_valid = 1;
+    bool accepted = false;
+    uint32_t rsp = 0;
+    uint64_t n = 0;
+    for (;;) {
+      top_->eval();
+      const bool fire_cmd = top_->cmd_valid && top_->cmd_ready;
+      const bool fire_rsp = top_->rsp_valid && top_->rsp_ready && (accepted || fire_cmd);
+      if (fire_rsp) {
+        rsp = top_->rsp_payload_outputs_0;
+      }
+      tick();
+      ++n;
+      if (fire_cmd) {
+        accepted = true;
+        top_->cmd_valid = 0;
+      }
+      if (fire_rsp) {
+        break;
+      }
+      if (n > kTimeout) {
+        printf("Timeout on %s (%d %02x %08x %08x)\n", op_name(funct3, funct7, rs2),
+               funct3, funct7, rs1, rs2);
+        exit(1);
+      }
+    }
+    busy_cycles_ += n;
+    *op_cycles = n;
+    return rsp;
+  }
+
+  uint64_t cycles() const { return cycles_; }
+  uint64_t busy_cycles() const { return busy_cycles_; }
+  uint64_t idle_cycles() const { return idle_cycles_; }
+
+ private:
+  void tick() {
+    top_->clk = 1;
+    top_->eval();
+    top_->clk = 0;
+    top_->eval();
+    ++cycles_;
+  }
+
+  VCfu* top_;
+  uint64_t cycles_ = 0, busy_cycles_ = 0, idle_cycles_ = 0;
+};
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  Verilated::commandArgs(argc, argv);
+  if (argc < 2) {
+    printf("usage: %s TRACE [--gap N] [--max-ops N]\n", argv[0]);
+    return 1;
+  }
+  int gap = 2;
+  uint64_t max_ops = 0;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--gap") == 0) {
+      gap = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--max-ops") == 0) {
+      max_ops = strtoull(argv[i + 1], nullptr, 0);
+    }
+  }
+  FILE* trace = fopen(argv[1], "r");
+  if (!trace) {
+    printf("Cannot open %s\n", argv[1]);
+    return 1;
+  }
+
+  Harness cfu;
+  std::map<std::string, OpStats> stats;
+  uint64_t ops = 0, mismatches = 0;
+  bool polled = false;
+  char line[256];
+  int line_no = 0;
+  while (fgets(line, sizeof(line), trace) && (max_ops == 0 || ops < max_ops)) {
+    ++line_no;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    int funct3, funct7;
+    unsigned long rs1, rs2, expected;
+    if (sscanf(line, "%d %x %lx %lx %lx", &funct3, &funct7, &rs1, &rs2, &expected) != 5) {
+      printf("Bad trace line %d: %s", line_no, line);
+      return 1;
+    }
+    const bool poll = is_poll(funct3, funct7, rs2);
+    if (poll && polled) {
+      continue;
+    }
+    polled = poll;
+
+    uint64_t op_cycles = 0, poll_cycles = 0;
+    uint32_t rsp;
+    do {
+      cfu.idle(gap);
+      rsp = cfu.op(funct3, funct7, rs1, rs2, &op_cycles);
+      poll_cycles += op_cycles;
+    } while (poll && (rsp & 1));
+    if (poll) {
+      op_cycles = poll_cycles;
+    } else if (rsp != expected) {
+      if (mismatches < 10) {
+        printf("Mismatch at line %d (%s): rtl %08x, model %08lx\n", line_no,
+               op_name(funct3, funct7, rs2), rsp, expected);
+      }
+      ++mismatches;
+    }
+    OpStats& s = stats[op_name(funct3, funct7, rs2)];
+    ++s.count;
+    s.cycles += op_cycles;
+    if (op_cycles > s.max_cycles) {
+      s.max_cycles = op_cycles;
+    }
+    ++ops;
+  }
+  fclose(trace);
+
+  printf("op,count,cycles,avg,max\n");
+  for (const auto& it : stats) {
+    const OpStats& s = it.second;
+    printf("%s,%llu,%llu,%.2f,%llu\n", it.first.c_str(),
+           static_cast<unsigned long long>(s.count), static_cast<unsigned long long>(s.cycles),
+           static_cast<double>(s.cycles) / s.count, static_cast<unsigned long long>(s.max_cycles));
+  }
+  printf("Ops: %llu\n", static_cast<unsigned long long>(ops));
+  printf("Cycles: %llu (busy %llu, idle %llu)\n", static_cast<unsigned long long>(cfu.cycles()),
+         static_cast<unsigned long long>(cfu.busy_cycles()),
+         static_cast<unsigned long long>(cfu.idle_cycles()));
+  printf("Mismatches: %llu\n", static_cast<unsigned long long>(mismatches));
+  return mismatches ? 1 : 0;
+}
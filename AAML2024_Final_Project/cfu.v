@@ -15,11 +15,17 @@
 `include "cfuop_simd.v"
 `include "cfuop_add.v"
 `include "cfuop_sa.v"
+`include "cfuop_softmax.v"
+`include "cfuop_act.v"
+`include "cfuop_pool.v"
 
-`define NUM_CFUOP 3
+`define NUM_CFUOP 6
 `define CFUOP_ADD  1
 `define CFUOP_SIMD 2
 `define CFUOP_SA   0
+`define CFUOP_SOFTMAX 3
+`define CFUOP_ACT  4
+`define CFUOP_POOL 5
 
 module Cfu (
   input             cmd_valid,
@@ -114,6 +120,48 @@ module Cfu (
     .clk                    (clk)
   );
 `endif
+`ifdef CFUOP_SOFTMAX
+  cfuop_softmax fu_softmax(
+    .cmd_valid              (w_cmd_valid[`CFUOP_SOFTMAX]),
+    .cmd_ready              (w_cmd_ready[`CFUOP_SOFTMAX]),
+    .cmd_payload_function_id(cmd_payload_function_id),
+    .cmd_payload_inputs_0   (cmd_payload_inputs_0),
+    .cmd_payload_inputs_1   (cmd_payload_inputs_1),
+    .rsp_valid              (w_rsp_valid[`CFUOP_SOFTMAX]),
+    .rsp_ready              (rsp_ready),
+    .rsp_payload_outputs_0  (w_rsp_output[`CFUOP_SOFTMAX]),
+    .reset                  (reset),
+    .clk                    (clk)
+  );
+`endif
+`ifdef CFUOP_ACT
+  cfuop_act fu_act(
+    .cmd_valid              (w_cmd_valid[`CFUOP_ACT]),
+    .cmd_ready              (w_cmd_ready[`CFUOP_ACT]),
+    .cmd_payload_function_id(cmd_payload_function_id),
+    .cmd_payload_inputs_0   (cmd_payload_inputs_0),
+    .cmd_payload_inputs_1   (cmd_payload_inputs_1),
+    .rsp_valid              (w_rsp_valid[`CFUOP_ACT]),
+    .rsp_ready              (rsp_ready),
+    .rsp_payload_outputs_0  (w_rsp_output[`CFUOP_ACT]),
+    .reset                  (reset),
+    .clk                    (clk)
+  );
+`endif
+`ifdef CFUOP_POOL
+  cfuop_pool fu_pool(
+    .cmd_valid              (w_cmd_valid[`CFUOP_POOL]),
+    .cmd_ready              (w_cmd_ready[`CFUOP_POOL]),
+    .cmd_payload_function_id(cmd_payload_function_id),
+    .cmd_payload_inputs_0   (cmd_payload_inputs_0),
+    .cmd_payload_inputs_1   (cmd_payload_inputs_1),
+    .rsp_valid              (w_rsp_valid[`CFUOP_POOL]),
+    .rsp_ready              (rsp_ready),
+    .rsp_payload_outputs_0  (w_rsp_output[`CFUOP_POOL]),
+    .reset                  (reset),
+    .clk                    (clk)
+  );
+`endif
 
   // Output
   assign sel = busy ? funct3_reg : funct3;
@@ -139,6 +187,27 @@ module Cfu (
         rsp_valid = w_rsp_valid[`CFUOP_SA];
         rsp_payload_outputs_0 = w_rsp_output[`CFUOP_SA];
       end
+`endif
+`ifdef CFUOP_SOFTMAX
+      `CFUOP_SOFTMAX: begin
+        cmd_ready = w_cmd_ready[`CFUOP_SOFTMAX];
+        rsp_valid = w_rsp_valid[`CFUOP_SOFTMAX];
+        rsp_payload_outputs_0 = w_rsp_output[`CFUOP_SOFTMAX];
+      end
+`endif
+`ifdef CFUOP_ACT
+      `CFUOP_ACT: begin
+        cmd_ready = w_cmd_ready[`CFUOP_ACT];
+        rsp_valid = w_rsp_valid[`CFUOP_ACT];
+        rsp_payload_outputs_0 = w_rsp_output[`CFUOP_ACT];
+      end
+`endif
+`ifdef CFUOP_POOL
+      `CFUOP_POOL: begin
+        cmd_ready = w_cmd_ready[`CFUOP_POOL];
+        rsp_valid = w_rsp_valid[`CFUOP_POOL];
+        rsp_payload_outputs_0 = w_rsp_output[`CFUOP_POOL];
+      end
 `endif
       default: begin
         cmd_ready = 1'b0;
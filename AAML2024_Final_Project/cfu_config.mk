@@ -0,0 +1,7 @@
+# AAML: src/cfu_config.h is generated from cfu_config.vh by gen_cfu_config.py.
+# Included by Makefile and Makefile_verilator, so the firmware, the native
+# build and the trace never build kernels against a header older than the RTL.
+CFU_CONFIG_H := src/cfu_config.h
+
+$(CFU_CONFIG_H): cfu_config.vh gen_cfu_config.py
+	python3 gen_cfu_config.py $< $@
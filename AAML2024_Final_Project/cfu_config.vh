@@ -0,0 +1,25 @@
+/*
+ * cfu_config.vh
+ *
+ * Build-time configuration of the GEMM unit. src/cfu_config.h is generated
+ * from this file by gen_cfu_config.py, which make runs after any change here.
+ *
+ */
+`ifndef CFU_CONFIG_VH
+`define CFU_CONFIG_VH
+
+// Systolic array is CFU_SA_SIZE x CFU_SA_SIZE (4, 8 or 16)
+`define CFU_SA_SIZE 4
+// Words per buffer bank (A/B word = CFU_SA_SIZE bytes, C word = CFU_SA_SIZE int32)
+`define CFU_BUFF_ADDR_BITS 10
+// Width of the K/M/N tile registers
+`define CFU_DIM_BITS 8
+// Requantization tables hold 2**CFU_QPARAM_CH_BITS channels (max n_tile)
+`define CFU_QPARAM_CH_BITS 6
+// Host address bit that selects the buffer bank
+`define CFU_BANK_BIT 16
+// 1: the MACs of cfuop_sa and cfuop_simd take the raw int8 input, and the
+// kernels fold the input offset into the bias (9x8 -> 8x8 multipliers)
+`define CFU_FOLD_INPUT_OFFSET 0
+
+`endif
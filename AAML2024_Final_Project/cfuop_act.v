@@ -0,0 +1,189 @@
+module cfuop_act (
+  input               cmd_valid,
+  output              cmd_ready,
+  input      [9:0]    cmd_payload_function_id,
+  input      [31:0]   cmd_payload_inputs_0,
+  input      [31:0]   cmd_payload_inputs_1,
+  output reg          rsp_valid,
+  input               rsp_ready,
+  output reg [31:0]   rsp_payload_outputs_0,
+  input               reset,
+  input               clk
+);
+
+  // Only not ready for a command when we have a response.
+  assign cmd_ready = ~rsp_valid;
+
+  /******** function7 ********/
+  // 0: write table word rs2 at word address rs1
+  // 1: int8 lookup of the 4 lanes of rs1, byte table: out = table[x + 128]
+  // 2: int16 mode: input multiplier (rs1), rs2 = tanh << 8 | input left shift
+  // 3: int16 logistic/tanh of the 2 lanes of rs1, halfword table:
+  //    sigmoid_table_uint16, interpolated as in reference_integer_ops
+  //
+  // The table is loaded by the host: any int8 elementwise function as a
+  // 256-entry byte table (logistic, tanh, hard-swish...), or the 256-entry
+  // uint16 sigmoid table of the int16 kernels.
+  localparam TABLE_WORDS = 128;
+
+  /******** state definition ********/
+  reg [3:0] state, next_state;
+  reg [3:0] calc_state, next_calc_state;
+
+  parameter IDLE            = 4'd0;
+  parameter CALC            = 4'd1;
+  parameter CFU_DONE        = 4'd2;
+
+  parameter SCALE           = 4'd0;
+  parameter SPLIT           = 4'd1;
+  parameter INTERP          = 4'd2;
+  parameter RESULT          = 4'd3;
+
+  /******** table and int16 parameters ********/
+  reg        [31:0] table_mem [0:TABLE_WORDS-1];
+  reg signed [31:0] input_multiplier;
+  reg        [4:0]  input_left_shift;
+  reg               tanh_mode;
+
+  /******* internal register ********/
+  reg signed [15:0] x_val [0:1];
+  reg signed [31:0] scaled [0:1];
+  reg        [31:0] abs_val [0:1];
+  reg        [7:0]  uh [0:1];
+  reg               saturate [0:1];
+  reg        [31:0] interp [0:1];
+  reg        [31:0] result [0:1];
+
+  integer lane;
+
+  /********* internal wire **********/
+  // int8 lookup: byte (x ^ 0x80) of the table
+  function [7:0] table_byte;
+    input [7:0] x;
+    reg [7:0] index;
+    reg [31:0] word;
+    begin
+      index = x ^ 8'h80;
+      word = table_mem[index[7:2]];
+      table_byte = word >> (8 * index[1:0]);
+    end
+  endfunction
+
+  function [15:0] table_half;
+    input [7:0] index;
+    reg [31:0] word;
+    begin
+      word = table_mem[index[7:1]];
+      table_half = index[0] ? word[31:16] : word[15:0];
+    end
+  endfunction
+
+  wire [31:0] round;
+  assign round = (input_left_shift != 5'd0) ? (32'd1 << (input_left_shift - 1'b1)) : 32'd0;
+
+  always @(posedge clk or posedge reset) begin
+     if (reset) begin
+      state <= IDLE;
+      next_state <= IDLE;
+      calc_state <= SCALE;
+      next_calc_state <= SCALE;
+      input_multiplier <= 32'd0;
+      input_left_shift <= 5'd0;
+      tanh_mode <= 1'b0;
+     end else if (rsp_valid) rsp_valid <= 1'b0;
+     else begin
+      state = next_state;
+      case (state)
+        IDLE: begin
+          if (cmd_valid) begin
+            if (cmd_payload_function_id[9:3] == 7'd0) begin
+              table_mem[cmd_payload_inputs_0[6:0]] <= cmd_payload_inputs_1;
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd1) begin
+              rsp_payload_outputs_0 <= {table_byte(cmd_payload_inputs_0[31:24]),
+                                        table_byte(cmd_payload_inputs_0[23:16]),
+                                        table_byte(cmd_payload_inputs_0[15: 8]),
+                                        table_byte(cmd_payload_inputs_0[7 : 0])};
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd2) begin
+              input_multiplier <= cmd_payload_inputs_0;
+              input_left_shift <= cmd_payload_inputs_1[4:0];
+              tanh_mode <= cmd_payload_inputs_1[8];
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd3) begin
+              x_val[0] <= cmd_payload_inputs_0[15:0];
+              x_val[1] <= cmd_payload_inputs_0[31:16];
+              next_calc_state <= SCALE;
+              next_state <= CALC;
+            end
+            else begin
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+          end else begin
+            next_state <= IDLE;
+          end
+        end
+        CALC: begin
+          calc_state = next_calc_state;
+          case (calc_state)
+            SCALE: begin
+              for (lane = 0; lane < 2; lane = lane + 1)
+                scaled[lane] <= (x_val[lane] * input_multiplier + $signed(round)) >>> input_left_shift;
+              next_calc_state <= SPLIT;
+            end
+            SPLIT: begin
+              // Integer part selects the table entry, tanh has one bit less
+              for (lane = 0; lane < 2; lane = lane + 1) begin
+                abs_val[lane] <= scaled[lane][31] ? -scaled[lane] : scaled[lane];
+                if (tanh_mode) begin
+                  uh[lane] <= (scaled[lane][31] ? -scaled[lane] : scaled[lane]) >> 8;
+                  saturate[lane] <= ((scaled[lane][31] ? -scaled[lane] : scaled[lane]) >> 8) >= 32'd255;
+                end else begin
+                  uh[lane] <= (scaled[lane][31] ? -scaled[lane] : scaled[lane]) >> 9;
+                  saturate[lane] <= ((scaled[lane][31] ? -scaled[lane] : scaled[lane]) >> 9) >= 32'd255;
+                end
+              end
+              next_calc_state <= INTERP;
+            end
+            INTERP: begin
+              for (lane = 0; lane < 2; lane = lane + 1) begin
+                if (tanh_mode)
+                  interp[lane] <= saturate[lane] ? (32'hffff << 8)
+                                : ({16'd0, table_half(uh[lane])} << 8)
+                                  + abs_val[lane][7:0] * ({16'd0, table_half(uh[lane] + 1'b1)} - table_half(uh[lane]));
+                else
+                  interp[lane] <= saturate[lane] ? (32'h7fff << 10)
+                                : ({16'd0, table_half(uh[lane])} << 9)
+                                  + abs_val[lane][8:0] * ({16'd0, table_half(uh[lane] + 1'b1)} - table_half(uh[lane]));
+              end
+              next_calc_state <= RESULT;
+            end
+            RESULT: begin
+              for (lane = 0; lane < 2; lane = lane + 1) begin
+                if (tanh_mode)
+                  result[lane] <= $signed(scaled[lane][31] ? (32'd1 << 23) + (32'd1 << 7) - 1 - interp[lane]
+                                                           : interp[lane] - (32'd1 << 23) + (32'd1 << 7)) >>> 8;
+                else
+                  result[lane] <= (scaled[lane][31] ? (32'd1 << 25) - interp[lane] + (32'd1 << 9) - 1
+                                                    : interp[lane] + (32'd1 << 9)) >> 10;
+              end
+              next_calc_state <= SCALE;
+              next_state <= CFU_DONE;
+            end
+          endcase
+        end
+        CFU_DONE: begin
+          rsp_valid <= 1'b1;
+          rsp_payload_outputs_0 <= {result[1][15:0], result[0][15:0]};
+          next_state <= IDLE;
+        end
+      endcase
+    end
+  end
+endmodule
@@ -14,14 +14,32 @@ module cfuop_add (
   // Only not ready for a command when we have a response.
   assign cmd_ready = ~rsp_valid;
   
-  /******** fixed parameters ********/
-  localparam left_shift               = $signed(22'd1048576); // 1 << 20 = 2 ^ 20 = 1048576
-  localparam round_input1             = $signed(64'd1) << 32; // input1_shift: -2
-  localparam input2_multiplier        = $signed(32'd1073741824);
-  localparam round_input2             = $signed(64'd1) << 30; // input2_shift: 0
-  localparam output_offset            = $signed(-8'd128);
-  localparam quantized_activation_min = $signed(-32'd128);
-  localparam quantized_activation_max = $signed(32'd127);
+  /******** function7 ********/
+  // 0: input offsets (rs1 = in1 << 16 | in2), output shift (rs2)
+  // 1: input1 multiplier (rs1), output multiplier (rs2)
+  // 2: add 4 lanes of rs1 (input1) and rs2 (input2)
+  // 3: write broadcast word rs1 at address rs2
+  // 4: broadcast period rs1 in words, rs2[0]: the broadcast operand is input1
+  // 5: add 4 lanes of rs1 to the next broadcast word, which wraps at the period
+  // 6: input2 multiplier (rs1), rs2 = left_shift << 16 | in2_shift << 8 | in1_shift
+  // 7: output offset (rs1), rs2 = act_max << 16 | act_min
+  localparam BCAST_ADDR_BITS          = 6; // 64 words = 256 int8 channels
+
+  /******** parameters, reset to the values of the final project model ********/
+  reg        [4:0]  left_shift;           // 20
+  reg signed [31:0] input2_multiplier;    // 1 << 30
+  reg signed [63:0] round_input1;         // input1_shift: -2
+  reg signed [63:0] round_input2;         // input2_shift: 0
+  reg signed [7:0]  total_input1_shift;
+  reg signed [7:0]  total_input2_shift;
+  reg signed [31:0] output_offset;        // -128
+  reg signed [31:0] quantized_activation_min;
+  reg signed [31:0] quantized_activation_max;
+
+  /******** broadcast operand ********/
+  reg [31:0] bcast_mem [0:(1 << BCAST_ADDR_BITS) - 1];
+  reg [BCAST_ADDR_BITS-1:0] bcast_ptr, bcast_last;
+  reg bcast_input1;
 
   /******** state definition ********/
   reg [3:0] state, next_state;
@@ -101,6 +119,18 @@ module cfuop_add (
       next_state <= IDLE;
       calc_state <= SCALED;
       next_calc_state <= SCALED;
+      left_shift <= 5'd20;
+      input2_multiplier <= $signed(32'd1073741824);
+      round_input1 <= $signed(64'd1) << 32;
+      round_input2 <= $signed(64'd1) << 30;
+      total_input1_shift <= $signed(8'd33);
+      total_input2_shift <= $signed(8'd31);
+      output_offset <= $signed(-32'd128);
+      quantized_activation_min <= $signed(-32'd128);
+      quantized_activation_max <= $signed(32'd127);
+      bcast_ptr <= 0;
+      bcast_last <= 0;
+      bcast_input1 <= 1'b0;
      end else if (rsp_valid) rsp_valid <= 1'b0;
      else begin
       state = next_state;
@@ -125,6 +155,37 @@ module cfuop_add (
               y_val <= cmd_payload_inputs_1;
               next_state <= CALC;
             end
+            else if(cmd_payload_function_id[9:3] == 7'd3) begin
+              bcast_mem[cmd_payload_inputs_1[BCAST_ADDR_BITS-1:0]] <= cmd_payload_inputs_0;
+              rsp_valid <= 1'b1;
+            end
+            else if(cmd_payload_function_id[9:3] == 7'd4) begin
+              bcast_last <= cmd_payload_inputs_0[BCAST_ADDR_BITS-1:0] - 1'b1;
+              bcast_input1 <= cmd_payload_inputs_1[0];
+              bcast_ptr <= 0;
+              rsp_valid <= 1'b1;
+            end
+            else if(cmd_payload_function_id[9:3] == 7'd5) begin
+              x_val <= bcast_input1 ? bcast_mem[bcast_ptr] : cmd_payload_inputs_0;
+              y_val <= bcast_input1 ? cmd_payload_inputs_0 : bcast_mem[bcast_ptr];
+              bcast_ptr <= (bcast_ptr == bcast_last) ? 0 : bcast_ptr + 1'b1;
+              next_state <= CALC;
+            end
+            else if(cmd_payload_function_id[9:3] == 7'd6) begin
+              input2_multiplier <= cmd_payload_inputs_0;
+              left_shift <= cmd_payload_inputs_1[20:16];
+              round_input1 <= $signed(64'd1) << ($signed(8'd30) - $signed(cmd_payload_inputs_1[7:0]));
+              total_input1_shift <= $signed(8'd31) - $signed(cmd_payload_inputs_1[7:0]);
+              round_input2 <= $signed(64'd1) << ($signed(8'd30) - $signed(cmd_payload_inputs_1[15:8]));
+              total_input2_shift <= $signed(8'd31) - $signed(cmd_payload_inputs_1[15:8]);
+              rsp_valid <= 1'b1;
+            end
+            else if(cmd_payload_function_id[9:3] == 7'd7) begin
+              output_offset <= $signed(cmd_payload_inputs_0);
+              quantized_activation_min <= $signed(cmd_payload_inputs_1[15:0]);
+              quantized_activation_max <= $signed(cmd_payload_inputs_1[31:16]);
+              rsp_valid <= 1'b1;
+            end
           end else begin
             next_state <= IDLE;
           end
@@ -133,26 +194,26 @@ module cfuop_add (
           calc_state = next_calc_state;
           case (calc_state)
             SCALED: begin
-              shifted_input1_val_0 <= ($signed(x_val[7 : 0]) + input1_offset) * left_shift;
-              shifted_input1_val_1 <= ($signed(x_val[15: 8]) + input1_offset) * left_shift;
-              shifted_input1_val_2 <= ($signed(x_val[23:16]) + input1_offset) * left_shift;
-              shifted_input1_val_3 <= ($signed(x_val[31:24]) + input1_offset) * left_shift;
-
-              shifted_input2_val_0 <= ($signed(y_val[7 : 0]) + input2_offset) * left_shift;
-              shifted_input2_val_1 <= ($signed(y_val[15: 8]) + input2_offset) * left_shift;
-              shifted_input2_val_2 <= ($signed(y_val[23:16]) + input2_offset) * left_shift;
-              shifted_input2_val_3 <= ($signed(y_val[31:24]) + input2_offset) * left_shift; 
+              shifted_input1_val_0 <= ($signed(x_val[7:0]) + input1_offset) <<< left_shift;
+              shifted_input1_val_1 <= ($signed(x_val[15:8]) + input1_offset) <<< left_shift;
+              shifted_input1_val_2 <= ($signed(x_val[23:16]) + input1_offset) <<< left_shift;
+              shifted_input1_val_3 <= ($signed(x_val[31:24]) + input1_offset) <<< left_shift;
+
+              shifted_input2_val_0 <= ($signed(y_val[7:0]) + input2_offset) <<< left_shift;
+              shifted_input2_val_1 <= ($signed(y_val[15:8]) + input2_offset) <<< left_shift;
+              shifted_input2_val_2 <= ($signed(y_val[23:16]) + input2_offset) <<< left_shift;
+              shifted_input2_val_3 <= ($signed(y_val[31:24]) + input2_offset) <<< left_shift; 
               next_calc_state <= RAW_SUM;
             end
             RAW_SUM: begin
-              raw_sum_0 <= ((shifted_input1_val_0 * input1_multiplier + round_input1) >>> 33) + 
-                           ((shifted_input2_val_0 * input2_multiplier + round_input2) >>> 31);
-              raw_sum_1 <= ((shifted_input1_val_1 * input1_multiplier + round_input1) >>> 33) + 
-                           ((shifted_input2_val_1 * input2_multiplier + round_input2) >>> 31);
-              raw_sum_2 <= ((shifted_input1_val_2 * input1_multiplier + round_input1) >>> 33) + 
-                           ((shifted_input2_val_2 * input2_multiplier + round_input2) >>> 31);
-              raw_sum_3 <= ((shifted_input1_val_3 * input1_multiplier + round_input1) >>> 33) + 
-                           ((shifted_input2_val_3 * input2_multiplier + round_input2) >>> 31);
+              raw_sum_0 <= ((shifted_input1_val_0 * input1_multiplier + round_input1) >>> total_input1_shift) + 
+                           ((shifted_input2_val_0 * input2_multiplier + round_input2) >>> total_input2_shift);
+              raw_sum_1 <= ((shifted_input1_val_1 * input1_multiplier + round_input1) >>> total_input1_shift) + 
+                           ((shifted_input2_val_1 * input2_multiplier + round_input2) >>> total_input2_shift);
+              raw_sum_2 <= ((shifted_input1_val_2 * input1_multiplier + round_input1) >>> total_input1_shift) + 
+                           ((shifted_input2_val_2 * input2_multiplier + round_input2) >>> total_input2_shift);
+              raw_sum_3 <= ((shifted_input1_val_3 * input1_multiplier + round_input1) >>> total_input1_shift) + 
+                           ((shifted_input2_val_3 * input2_multiplier + round_input2) >>> total_input2_shift);
               next_calc_state <= WITHOUT_SHIFT;
             end
             WITHOUT_SHIFT: begin
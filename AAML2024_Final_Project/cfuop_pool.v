@@ -0,0 +1,191 @@
+module cfuop_pool (
+  input               cmd_valid,
+  output              cmd_ready,
+  input      [9:0]    cmd_payload_function_id,
+  input      [31:0]   cmd_payload_inputs_0,
+  input      [31:0]   cmd_payload_inputs_1,
+  output reg          rsp_valid,
+  input               rsp_ready,
+  output reg [31:0]   rsp_payload_outputs_0,
+  input               reset,
+  input               clk
+);
+
+  // Only not ready for a command when we have a response.
+  assign cmd_ready = ~rsp_valid;
+
+  /******** function7 ********/
+  // 0: activation min (rs1), activation max (rs2)
+  // 1: divisor: reciprocal (rs1), rs2 = count / 2 << 8 | shift
+  // 2: clear the 4 lane sums to 0 and the 4 lane maxes to -128
+  // 3: add the 4 int8 lanes of rs1 and of rs2 to the lane sums
+  // 4: fold the 4 int8 lanes of rs1 and of rs2 into the lane maxes
+  // 5: int8 averages of the 4 lane sums, clamped to the activation range
+  // 6: int8 lane maxes, clamped to the activation range
+  //
+  // An average is (|sum| + count / 2) / count with the sign of the sum, as
+  // in reference_integer_ops::AveragePool. The division is a multiply by
+  // reciprocal = ceil(2**shift / count) with shift = 31 + ceil(log2(count)),
+  // which is exact for every sum of count int8 values.
+
+  /******** state definition ********/
+  reg [3:0] state, next_state;
+  reg [3:0] calc_state, next_calc_state;
+
+  parameter IDLE            = 4'd0;
+  parameter CALC            = 4'd1;
+  parameter CFU_DONE        = 4'd2;
+
+  parameter ROUND           = 4'd0;
+  parameter DIVIDE          = 4'd1;
+  parameter RESULT          = 4'd2;
+
+  /******** parameters of the op ********/
+  reg signed [31:0] act_min;
+  reg signed [31:0] act_max;
+  reg        [31:0] reciprocal;
+  reg        [23:0] half_count;
+  reg        [5:0]  shift;
+
+  /******* internal register ********/
+  reg signed [31:0] lane_sum [0:3];
+  reg signed [7:0]  lane_max [0:3];
+  reg        [31:0] rounded [0:3];
+  reg        [31:0] quotient [0:3];
+  reg        [7:0]  average [0:3];
+
+  integer lane;
+
+  /********* internal wire **********/
+  wire signed [7:0] in0 [0:3];
+  wire signed [7:0] in1 [0:3];
+  assign in0[0] = cmd_payload_inputs_0[7 : 0];
+  assign in0[1] = cmd_payload_inputs_0[15: 8];
+  assign in0[2] = cmd_payload_inputs_0[23:16];
+  assign in0[3] = cmd_payload_inputs_0[31:24];
+  assign in1[0] = cmd_payload_inputs_1[7 : 0];
+  assign in1[1] = cmd_payload_inputs_1[15: 8];
+  assign in1[2] = cmd_payload_inputs_1[23:16];
+  assign in1[3] = cmd_payload_inputs_1[31:24];
+
+  function signed [7:0] max8;
+    input signed [7:0] a;
+    input signed [7:0] b;
+    begin
+      max8 = (a > b) ? a : b;
+    end
+  endfunction
+
+  function [7:0] clamp8;
+    input signed [31:0] x;
+    input signed [31:0] lo;
+    input signed [31:0] hi;
+    begin
+      clamp8 = (x < lo) ? lo[7:0] : (x > hi) ? hi[7:0] : x[7:0];
+    end
+  endfunction
+
+  always @(posedge clk or posedge reset) begin
+     if (reset) begin
+      state <= IDLE;
+      next_state <= IDLE;
+      calc_state <= ROUND;
+      next_calc_state <= ROUND;
+      act_min <= -32'sd128;
+      act_max <= 32'sd127;
+      reciprocal <= 32'd0;
+      half_count <= 24'd0;
+      shift <= 6'd0;
+      for (lane = 0; lane < 4; lane = lane + 1) begin
+        lane_sum[lane] <= 32'd0;
+        lane_max[lane] <= -8'sd128;
+      end
+     end else if (rsp_valid) rsp_valid <= 1'b0;
+     else begin
+      state = next_state;
+      case (state)
+        IDLE: begin
+          if (cmd_valid) begin
+            if (cmd_payload_function_id[9:3] == 7'd0) begin
+              act_min <= cmd_payload_inputs_0;
+              act_max <= cmd_payload_inputs_1;
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd1) begin
+              reciprocal <= cmd_payload_inputs_0;
+              half_count <= cmd_payload_inputs_1[31:8];
+              shift <= cmd_payload_inputs_1[5:0];
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd2) begin
+              for (lane = 0; lane < 4; lane = lane + 1) begin
+                lane_sum[lane] <= 32'd0;
+                lane_max[lane] <= -8'sd128;
+              end
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd3) begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                lane_sum[lane] <= lane_sum[lane] + in0[lane] + in1[lane];
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd4) begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                lane_max[lane] <= max8(lane_max[lane], max8(in0[lane], in1[lane]));
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd5) begin
+              next_calc_state <= ROUND;
+              next_state <= CALC;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd6) begin
+              rsp_payload_outputs_0 <= {clamp8(lane_max[3], act_min, act_max),
+                                        clamp8(lane_max[2], act_min, act_max),
+                                        clamp8(lane_max[1], act_min, act_max),
+                                        clamp8(lane_max[0], act_min, act_max)};
+              rsp_valid <= 1'b1;
+            end
+            else begin
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+          end else begin
+            next_state <= IDLE;
+          end
+        end
+        CALC: begin
+          calc_state = next_calc_state;
+          case (calc_state)
+            ROUND: begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                rounded[lane] <= (lane_sum[lane][31] ? -lane_sum[lane] : lane_sum[lane]) + half_count;
+              next_calc_state <= DIVIDE;
+            end
+            DIVIDE: begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                quotient[lane] <= ({32'd0, rounded[lane]} * {32'd0, reciprocal}) >> shift;
+              next_calc_state <= RESULT;
+            end
+            RESULT: begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                average[lane] <= clamp8(lane_sum[lane][31] ? -$signed(quotient[lane]) : $signed(quotient[lane]),
+                                        act_min, act_max);
+              next_calc_state <= ROUND;
+              next_state <= CFU_DONE;
+            end
+          endcase
+        end
+        CFU_DONE: begin
+          rsp_valid <= 1'b1;
+          rsp_payload_outputs_0 <= {average[3], average[2], average[1], average[0]};
+          next_state <= IDLE;
+        end
+      endcase
+    end
+  end
+endmodule
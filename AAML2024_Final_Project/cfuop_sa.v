@@ -1,5 +1,7 @@
+`include "cfu_config.vh"
 `include "gemm.v"
-`include "global_buffer_bram.v"
+`include "pingpong_buffer.v"
+`include "post_process.v"
 
 `define INDEX_CONGIG 2'b00
 `define INDEX_BUFF_A 2'b01
@@ -10,6 +12,15 @@
 `define OFFSET_CONFIG_M 1
 `define OFFSET_CONFIG_N 2
 `define OFFSET_CONFIG_O 3
+`define OFFSET_CONFIG_F 4
+`define OFFSET_CONFIG_S 5
+
+`define FLAG_ACCUMULATE 0
+`define FLAG_BANK_A     1
+`define FLAG_BANK_B     2
+`define FLAG_BANK_C     3
+
+`define STATUS_BUSY     0
 
 `define CMD_WRITE_CONFIG 7'b100_0000
 `define CMD_READ_CONFIG  7'b000_0000
@@ -20,15 +31,35 @@
 `define CMD_WRITE_BUFF_C 7'b111_0000
 `define CMD_READ_BUFF_C  7'b011_0000
 `define CMD_COMPUTE      7'b000_0001
+`define CMD_COMPUTE_ASYNC 7'b000_0011
+// Requantization epilogue (function7[1])
+`define CMD_WRITE_QPARAM  7'b100_0010
+`define CMD_READ_BUFF_C_Q 7'b011_0010
 
 /*
  * gemm_wrapper
  *
  * Wrapper cfu interface and buffer with gemm unit.
  *
+ * Every buffer has two banks. The host addresses them with bit BANK_BIT of
+ * inputs_1, the gemm unit uses the banks selected in the flags at compute
+ * start. A/B words hold ArraySize bytes and are written as ArraySize/4 host
+ * lanes ({word, lane} in inputs_1), C words hold ArraySize int32 lanes
+ * (lane in inputs_0). COMPUTE_ASYNC responds as soon as the gemm unit accepts it, so the
+ * host can load the other banks meanwhile; the status config reads busy.
+ *
+ * With FOLD_INPUT_OFFSET the PEs multiply the raw int8 A by B and the offset
+ * config is kept for readback only; the host folds the input offset into the
+ * bias instead.
+ *
  */
 module cfuop_sa #(
-    parameter ADDR_BITS = 10
+    parameter ArraySize = `CFU_SA_SIZE,
+    parameter ADDR_BITS = `CFU_BUFF_ADDR_BITS,
+    parameter DimBits = `CFU_DIM_BITS,
+    parameter QPARAM_CH_BITS = `CFU_QPARAM_CH_BITS,
+    parameter BANK_BIT = `CFU_BANK_BIT,
+    parameter FOLD_INPUT_OFFSET = `CFU_FOLD_INPUT_OFFSET
 ) (
     input               cmd_valid,
     output reg          cmd_ready,
@@ -45,32 +76,45 @@ module cfuop_sa #(
 // Params
 // --------------------
 localparam CHANNEL_WIDTH = 32;
+localparam LANE_BITS = $clog2(ArraySize);          // C lanes
+localparam HOST_LANE_BITS = $clog2(ArraySize / 4); // 32-bit lanes of an A/B word
 
 // --------------------
 // Wire & Reg
 // --------------------
 wire rst_n;
 // control
-wire cmd_data, cmd_write, cmd_read, cmd_comp;
+wire cmd_data, cmd_write, cmd_read, cmd_comp, cmd_async;
 wire cmd_config, cmd_buff_a, cmd_buff_b, cmd_buff_c;
 wire cmd_a_we, cmd_b_we, cmd_c_we;
+wire cmd_quant, cmd_qparam_we, cmd_read_q;
 wire [6:0] cmd_payload_function7;
 // configure
-reg [7:0] k_reg, m_reg, n_reg;
+reg [DimBits-1:0] k_reg, m_reg, n_reg;
 reg [8:0] input_offset_reg;
+reg [3:0] flag_reg;
+// latched at compute start
+reg [8:0] comp_offset_reg;
+reg [3:0] comp_flag_reg;
+reg comp_sync_reg;
 // buffer
-wire buff_sel;
-wire buff_a_we, buff_b_we, buff_c_we;
-wire [ADDR_BITS-1:0] buff_a_addr, buff_b_addr, buff_c_addr;
-wire [CHANNEL_WIDTH-1:0] buff_a_din, buff_b_din, buff_a_dout, buff_b_dout;
-wire [4*CHANNEL_WIDTH-1:0] buff_c_din, buff_c_dout;
+wire [CHANNEL_WIDTH-1:0] host_a_dout, host_b_dout;
+wire [ArraySize*8-1:0] gemm_a_dout, gemm_b_dout;
+wire [ArraySize*CHANNEL_WIDTH-1:0] host_c_dout, gemm_c_dout;
+wire [ArraySize*CHANNEL_WIDTH-1:0] gemm_c_din, gemm_c_acc;
+wire [CHANNEL_WIDTH-1:0] host_c_lane;
 // gemm unit
+wire comp_start;
 wire gemm_in_valid, gemm_busy, gemm_complete;
 wire gemm_a_we, gemm_b_we, gemm_c_we;
-wire [7:0] gemm_k, gemm_m, gemm_n;
+wire [DimBits-1:0] gemm_k, gemm_m, gemm_n;
 wire [8:0] gemm_offset;
 wire [ADDR_BITS-1:0] gemm_a_addr, gemm_b_addr, gemm_c_addr;
-wire [4*CHANNEL_WIDTH-1:0] gemm_c_data;
+wire [ArraySize*CHANNEL_WIDTH-1:0] gemm_c_data;
+// post process
+wire post_start, post_busy, post_done;
+wire [4*CHANNEL_WIDTH-1:0] post_acc;
+wire [CHANNEL_WIDTH-1:0] post_result;
 
 // --------------------
 // Control Signal
@@ -80,25 +124,32 @@ assign rst_n = ~reset;
 assign cmd_payload_function7 = cmd_payload_function_id[9:3];
 assign cmd_data = ~cmd_payload_function7[0];
 assign cmd_comp = cmd_payload_function7[0];
+assign cmd_async = cmd_comp & cmd_payload_function7[1];
 assign cmd_write = cmd_data & cmd_payload_function7[6];
 assign cmd_read = cmd_data & ~cmd_payload_function7[6];
 assign cmd_config = cmd_payload_function7[5:4] == `INDEX_CONGIG;
 assign cmd_buff_a = cmd_payload_function7[5:4] == `INDEX_BUFF_A;
 assign cmd_buff_b = cmd_payload_function7[5:4] == `INDEX_BUFF_B;
 assign cmd_buff_c = cmd_payload_function7[5:4] == `INDEX_BUFF_C;
+assign cmd_quant = cmd_payload_function7[1];
 
 // buffer
 assign cmd_a_we = cmd_valid & cmd_buff_a & cmd_write;
 assign cmd_b_we = cmd_valid & cmd_buff_b & cmd_write;
 assign cmd_c_we = cmd_valid & cmd_buff_c & cmd_write;
-assign buff_sel = cmd_comp | gemm_busy;
 
 // gemm unit
-assign gemm_in_valid = cmd_valid & cmd_comp;
+// K, M and N are latched by the controller, offset and flags here, so the
+// host may configure the next tile while this one runs. COMPUTE_ASYNC starts
+// only in the cycle it is accepted (cmd_ready), so a command held while
+// rsp_ready is low is not started again once the gemm unit goes idle.
+assign comp_start = cmd_valid & cmd_comp & ~gemm_busy & ~comp_sync_reg &
+                    (~cmd_async | rsp_ready);
+assign gemm_in_valid = comp_start;
 assign gemm_k = k_reg;
 assign gemm_m = m_reg;
 assign gemm_n = n_reg;
-assign gemm_offset = input_offset_reg;
+assign gemm_offset = comp_offset_reg;
 
 // --------------------
 // Configure
@@ -109,88 +160,114 @@ always @(posedge clk or posedge reset) begin
         m_reg <= 'd0;
         n_reg <= 'd0;
         input_offset_reg <= 'd0;
+        flag_reg <= 'd0;
     end else begin
-        if (cmd_valid & cmd_write & cmd_config) begin
-            case (cmd_payload_inputs_1[1:0])
+        if (cmd_valid & cmd_write & cmd_config & ~cmd_quant) begin
+            case (cmd_payload_inputs_1[2:0])
                 `OFFSET_CONFIG_K: k_reg <= cmd_payload_inputs_0;
                 `OFFSET_CONFIG_M: m_reg <= cmd_payload_inputs_0;
                 `OFFSET_CONFIG_N: n_reg <= cmd_payload_inputs_0;
                 `OFFSET_CONFIG_O: input_offset_reg <= cmd_payload_inputs_0;
+                `OFFSET_CONFIG_F: flag_reg <= cmd_payload_inputs_0;
             endcase
         end
     end
 end
+always @(posedge clk or posedge reset) begin
+    if (reset) begin
+        comp_offset_reg <= 'd0;
+        comp_flag_reg <= 'd0;
+        comp_sync_reg <= 1'b0;
+    end else begin
+        if (comp_start) begin
+            comp_offset_reg <= input_offset_reg;
+            comp_flag_reg <= flag_reg;
+        end
+        if (comp_start & ~cmd_async)
+            comp_sync_reg <= 1'b1;
+        else if (gemm_complete)
+            comp_sync_reg <= 1'b0;
+    end
+end
 
 // --------------------
 // Data Buffer
 // --------------------
-global_buffer_bram #(
-    .ADDR_BITS(ADDR_BITS),
-    .DATA_BITS(CHANNEL_WIDTH)
+pingpong_buffer #(
+    .ADDR_BITS     (ADDR_BITS),
+    .DATA_BITS     (ArraySize*8),
+    .HOST_LANE_BITS(HOST_LANE_BITS)
 ) input_buffer (
-    .clk     (clk),
-    .rst_n   (1'b1),
-    .ram_en  (1'b1),
-    .wr_en   (buff_a_we),
-    .index   (buff_a_addr),
-    .data_in (buff_a_din),
-    .data_out(buff_a_dout)
+    .clk      (clk),
+    .host_we  (cmd_a_we),
+    .host_bank(cmd_payload_inputs_1[BANK_BIT]),
+    .host_addr(cmd_payload_inputs_1[ADDR_BITS+HOST_LANE_BITS-1:0]),
+    .host_din (cmd_payload_inputs_0),
+    .host_dout(host_a_dout),
+    .gemm_en  (gemm_busy),
+    .gemm_bank(comp_flag_reg[`FLAG_BANK_A]),
+    .gemm_we  (gemm_a_we),
+    .gemm_addr(gemm_a_addr),
+    .gemm_din (),
+    .gemm_dout(gemm_a_dout)
 );
-assign buff_a_we = buff_sel ? gemm_a_we : cmd_a_we;
-assign buff_a_addr = buff_sel ? gemm_a_addr : cmd_payload_inputs_1;
-assign buff_a_din = cmd_payload_inputs_0;
 
-// global_buffer_bram #(
-//     .ADDR_BITS(ADDR_BITS),
-//     .DATA_BITS(CHANNEL_WIDTH)
-// ) weight_buffer (
-//     .clk     (clk),
-//     .rst_n   (1'b1),
-//     .ram_en  (1'b1),
-//     .wr_en   (biff_b_we),
-//     .index   (buff_b_addr),
-//     .data_in (buff_b_din),
-//     .data_out(buff_b_dout)
-// );
-// assign buff_b_we = buff_sel ? gemm_b_we : cmd_b_we;
-assign buff_b_we = cmd_b_we;
-assign buff_b_addr = buff_sel ? gemm_b_addr : cmd_payload_inputs_1;
-assign buff_b_din = cmd_payload_inputs_0;
-//
-reg [CHANNEL_WIDTH-1:0] buff_b_reg[0:2**ADDR_BITS-1];
-integer i;
-always @(posedge clk or posedge reset) begin
-    if (reset) begin
-        for (i = 0; i < 2**ADDR_BITS-1 ; i = i + 1) begin
-            buff_b_reg[i] <= 'd0;
-        end 
-    end else if (buff_b_we) begin
-        buff_b_reg[buff_b_addr] <= cmd_payload_inputs_0;
-    end
-end
-assign buff_b_dout = buff_b_reg[buff_b_addr];
-//
+pingpong_buffer #(
+    .ADDR_BITS     (ADDR_BITS),
+    .DATA_BITS     (ArraySize*8),
+    .HOST_LANE_BITS(HOST_LANE_BITS)
+) weight_buffer (
+    .clk      (clk),
+    .host_we  (cmd_b_we),
+    .host_bank(cmd_payload_inputs_1[BANK_BIT]),
+    .host_addr(cmd_payload_inputs_1[ADDR_BITS+HOST_LANE_BITS-1:0]),
+    .host_din (cmd_payload_inputs_0),
+    .host_dout(host_b_dout),
+    .gemm_en  (gemm_busy),
+    .gemm_bank(comp_flag_reg[`FLAG_BANK_B]),
+    .gemm_we  (gemm_b_we),
+    .gemm_addr(gemm_b_addr),
+    .gemm_din (),
+    .gemm_dout(gemm_b_dout)
+);
 
-global_buffer_bram #(
+pingpong_buffer #(
     .ADDR_BITS(ADDR_BITS),
-    .DATA_BITS(4*CHANNEL_WIDTH)
+    .DATA_BITS(ArraySize*CHANNEL_WIDTH)
 ) output_buffer (
-    .clk     (clk),
-    .rst_n   (1'b1),
-    .ram_en  (1'b1),
-    .wr_en   (buff_c_we),
-    .index   (buff_c_addr),
-    .data_in (buff_c_din),
-    .data_out(buff_c_dout)
+    .clk      (clk),
+    .host_we  (cmd_c_we),
+    .host_bank(cmd_payload_inputs_1[BANK_BIT]),
+    .host_addr(cmd_payload_inputs_1[ADDR_BITS-1:0]),
+    .host_din ({{(ArraySize-1)*CHANNEL_WIDTH{1'b0}}, cmd_payload_inputs_0}),
+    .host_dout(host_c_dout),
+    .gemm_en  (gemm_busy),
+    .gemm_bank(comp_flag_reg[`FLAG_BANK_C]),
+    .gemm_we  (gemm_c_we),
+    .gemm_addr(gemm_c_addr),
+    .gemm_din (gemm_c_din),
+    .gemm_dout(gemm_c_dout)
 );
-assign buff_c_we = buff_sel ? gemm_c_we : cmd_c_we;
-assign buff_c_addr = buff_sel ? gemm_c_addr : cmd_payload_inputs_1;
-assign buff_c_din = buff_sel ? gemm_c_data :  cmd_payload_inputs_0;
+assign gemm_c_din = comp_flag_reg[`FLAG_ACCUMULATE] ? gemm_c_acc : gemm_c_data;
+
+// Accumulate mode: C += A*B, so the host can keep C stationary across K tiles
+// and read it back once per (m_tile, n_tile).
+generate
+    genvar lane;
+    for (lane = 0; lane < ArraySize; lane = lane + 1) begin : c_acc
+        assign gemm_c_acc[lane*CHANNEL_WIDTH +: CHANNEL_WIDTH] =
+            gemm_c_dout[lane*CHANNEL_WIDTH +: CHANNEL_WIDTH] + gemm_c_data[lane*CHANNEL_WIDTH +: CHANNEL_WIDTH];
+    end
+endgenerate
 
 // --------------------
 // GEMM unit
 // --------------------
-gemm u_gemm(
+gemm #(
+    .ArraySize(ArraySize),
+    .DimBits  (DimBits),
+    .FoldOffset(FOLD_INPUT_OFFSET)
+) u_gemm (
     .clk       (clk),
     .rst_n     (rst_n),
 
@@ -205,12 +282,12 @@ gemm u_gemm(
     .A_wr_en   (gemm_a_we),
     .A_index   (gemm_a_addr),
     .A_data_in (),
-    .A_data_out(buff_a_dout),
+    .A_data_out(gemm_a_dout),
 
     .B_wr_en   (gemm_b_we),
     .B_index   (gemm_b_addr),
     .B_data_in (),
-    .B_data_out(buff_b_dout),
+    .B_data_out(gemm_b_dout),
 
     .C_wr_en   (gemm_c_we),
     .C_index   (gemm_c_addr),
@@ -218,30 +295,71 @@ gemm u_gemm(
     .C_data_out()
 );
 
+// --------------------
+// Requantization
+// --------------------
+// WRITE_QPARAM: inputs_1 = {table[9:8], channel}, inputs_0 = value
+// READ_BUFF_C_Q: inputs_1 = BUFF_C address, inputs_0 = channel of lane 0
+//                (a multiple of 4, selects the 4 lanes of the C word)
+assign cmd_qparam_we = cmd_valid & cmd_write & cmd_config & cmd_quant;
+assign cmd_read_q = cmd_read & cmd_buff_c & cmd_quant;
+assign post_start = cmd_valid & cmd_read_q & ~post_busy;
+
+generate
+    if (ArraySize == 4) begin : post_whole_word
+        assign post_acc = host_c_dout;
+    end else begin : post_lanes
+        wire [LANE_BITS-3:0] group = cmd_payload_inputs_0[LANE_BITS-1:2];
+        assign post_acc = host_c_dout >> ((ArraySize/4-1-group)*4*CHANNEL_WIDTH);
+    end
+endgenerate
+
+post_process #(
+    .LANES  (4),
+    .CH_BITS(QPARAM_CH_BITS)
+) u_post (
+    .clk       (clk),
+    .rst_n     (rst_n),
+
+    .param_we  (cmd_qparam_we),
+    .param_sel (cmd_payload_inputs_1[9:8]),
+    .param_idx (cmd_payload_inputs_1[QPARAM_CH_BITS-1:0]),
+    .param_data(cmd_payload_inputs_0),
+
+    .start     (post_start),
+    .ack       (rsp_ready),
+    .channel   (cmd_payload_inputs_0[QPARAM_CH_BITS-1:0]),
+    .acc       (post_acc),
+    .busy      (post_busy),
+    .done      (post_done),
+    .result    (post_result)
+);
+
 // --------------------
 // Output
 // --------------------
+// C lane 0 is in the MSB
+assign host_c_lane = host_c_dout >> ((ArraySize-1-cmd_payload_inputs_0[LANE_BITS-1:0])*CHANNEL_WIDTH);
+
 always @(*) begin
     if (cmd_read) begin
         case (cmd_payload_function7[5:4])
             `INDEX_CONGIG: begin
-                case (cmd_payload_inputs_1[1:0])
+                case (cmd_payload_inputs_1[2:0])
                     `OFFSET_CONFIG_K: rsp_payload_outputs_0 = k_reg;
                     `OFFSET_CONFIG_M: rsp_payload_outputs_0 = m_reg;
                     `OFFSET_CONFIG_N: rsp_payload_outputs_0 = n_reg;
                     `OFFSET_CONFIG_O: rsp_payload_outputs_0 = input_offset_reg;
+                    `OFFSET_CONFIG_F: rsp_payload_outputs_0 = flag_reg;
+                    `OFFSET_CONFIG_S: rsp_payload_outputs_0 = gemm_busy << `STATUS_BUSY;
                     default: rsp_payload_outputs_0 = 'd0;
                 endcase
             end
-            `INDEX_BUFF_A: rsp_payload_outputs_0 = buff_a_dout;
-            `INDEX_BUFF_B: rsp_payload_outputs_0 = buff_b_dout;
+            `INDEX_BUFF_A: rsp_payload_outputs_0 = host_a_dout;
+            `INDEX_BUFF_B: rsp_payload_outputs_0 = host_b_dout;
             `INDEX_BUFF_C: begin
-                case (cmd_payload_inputs_0[1:0])
-                    2'd3: rsp_payload_outputs_0 = buff_c_dout[31:0];
-                    2'd2: rsp_payload_outputs_0 = buff_c_dout[63:32];
-                    2'd1: rsp_payload_outputs_0 = buff_c_dout[95:64];
-                    default: rsp_payload_outputs_0 = buff_c_dout[127:96];
-                endcase
+                if (cmd_quant) rsp_payload_outputs_0 = post_result;
+                else rsp_payload_outputs_0 = host_c_lane;
             end
             default: rsp_payload_outputs_0 = 'd0;
         endcase
@@ -251,9 +369,15 @@ always @(*) begin
     // rsp_payload_outputs_0 = {buff_b_din, buff_b_addr[3:0], 3'b000, neg_b_we, 3'b000, buff_b_we};
 end
 always @(*) begin
-    if (cmd_comp | gemm_busy) begin
-        cmd_ready = gemm_complete;
-        rsp_valid = gemm_complete;
+    if (cmd_async) begin
+        cmd_ready = ~gemm_busy & rsp_ready;
+        rsp_valid = ~gemm_busy & cmd_valid;
+    end else if (cmd_comp) begin
+        cmd_ready = comp_sync_reg & gemm_complete;
+        rsp_valid = comp_sync_reg & gemm_complete;
+    end else if (cmd_read_q) begin
+        cmd_ready = post_done & rsp_ready;
+        rsp_valid = post_done;
     end else begin
         cmd_ready = rsp_ready;
         rsp_valid = cmd_valid;
@@ -1,4 +1,10 @@
-module cfuop_simd (
+`include "cfu_config.vh"
+
+module cfuop_simd #(
+  // 1: the MACs take the raw int8 input and InputOffset is not used (the
+  // host folds the input offset into the bias)
+  parameter FOLD_INPUT_OFFSET = `CFU_FOLD_INPUT_OFFSET
+) (
   input               cmd_valid,
   output              cmd_ready,
   input      [9:0]    cmd_payload_function_id,
@@ -12,7 +18,6 @@ module cfuop_simd (
 );
 
   /******** fixed parameters ********/
-  localparam InputOffset = $signed(9'd128);
   localparam output_activation_min = $signed(-32'd128);
   localparam output_activation_max = $signed(32'd127);
 
@@ -41,23 +46,52 @@ module cfuop_simd (
 
   reg signed [31:0] total_sum;
 
+  // Input offset of the MACs (-input zero point), 128 after reset
+  reg signed [8:0] InputOffset;
+
+  // Per-lane accumulators of the channel-parallel (depthwise) MAC
+  reg signed [31:0] lane_sum_0, lane_sum_1, lane_sum_2, lane_sum_3;
+
   /********** internal wire **********/
   wire signed [31:0] clamped_output_min, clamped_output_max;
 
   // SIMD multiply step:
   wire signed [15:0] prod_0, prod_1, prod_2, prod_3;
-  assign prod_0 =  ($signed(cmd_payload_inputs_0[7 : 0]) + InputOffset)
-                  * $signed(cmd_payload_inputs_1[7 : 0]);
-  assign prod_1 =  ($signed(cmd_payload_inputs_0[15: 8]) + InputOffset)
-                  * $signed(cmd_payload_inputs_1[15: 8]);
-  assign prod_2 =  ($signed(cmd_payload_inputs_0[23:16]) + InputOffset)
-                  * $signed(cmd_payload_inputs_1[23:16]);
-  assign prod_3 =  ($signed(cmd_payload_inputs_0[31:24]) + InputOffset)
-                  * $signed(cmd_payload_inputs_1[31:24]);
+  generate
+    if (FOLD_INPUT_OFFSET) begin : raw_mac
+      assign prod_0 =  $signed(cmd_payload_inputs_0[7 : 0])
+                      * $signed(cmd_payload_inputs_1[7 : 0]);
+      assign prod_1 =  $signed(cmd_payload_inputs_0[15: 8])
+                      * $signed(cmd_payload_inputs_1[15: 8]);
+      assign prod_2 =  $signed(cmd_payload_inputs_0[23:16])
+                      * $signed(cmd_payload_inputs_1[23:16]);
+      assign prod_3 =  $signed(cmd_payload_inputs_0[31:24])
+                      * $signed(cmd_payload_inputs_1[31:24]);
+    end else begin : offset_mac
+      assign prod_0 =  ($signed(cmd_payload_inputs_0[7 : 0]) + InputOffset)
+                      * $signed(cmd_payload_inputs_1[7 : 0]);
+      assign prod_1 =  ($signed(cmd_payload_inputs_0[15: 8]) + InputOffset)
+                      * $signed(cmd_payload_inputs_1[15: 8]);
+      assign prod_2 =  ($signed(cmd_payload_inputs_0[23:16]) + InputOffset)
+                      * $signed(cmd_payload_inputs_1[23:16]);
+      assign prod_3 =  ($signed(cmd_payload_inputs_0[31:24]) + InputOffset)
+                      * $signed(cmd_payload_inputs_1[31:24]);
+    end
+  endgenerate
 
   wire signed [31:0] sum_prods;
   assign sum_prods = prod_0 + prod_1 + prod_2 + prod_3;
 
+  reg signed [31:0] lane_sum_sel;
+  always @(*) begin
+    case (cmd_payload_inputs_0[1:0])
+      2'd0: lane_sum_sel = lane_sum_0;
+      2'd1: lane_sum_sel = lane_sum_1;
+      2'd2: lane_sum_sel = lane_sum_2;
+      default: lane_sum_sel = lane_sum_3;
+    endcase
+  end
+
   // Only not ready for a command when we have a response.
   assign cmd_ready = ~rsp_valid;
 
@@ -66,6 +100,7 @@ module cfuop_simd (
 
   always @(posedge clk or posedge reset) begin
      if (reset) begin
+      InputOffset <= $signed(9'd128);
       state <= INPUT_DATA;
       next_state <= INPUT_DATA;
       calc_state <= WITHOUT_SHIFT;
@@ -97,6 +132,25 @@ module cfuop_simd (
             end else if (cmd_payload_function_id[9:3] == 7'd4) begin
               total_sum <= cmd_payload_inputs_0;
               rsp_valid <= 1'b1;
+            end else if (cmd_payload_function_id[9:3] == 7'd5) begin
+              lane_sum_0 <= 32'b0;
+              lane_sum_1 <= 32'b0;
+              lane_sum_2 <= 32'b0;
+              lane_sum_3 <= 32'b0;
+              rsp_valid <= 1'b1;
+            end else if (cmd_payload_function_id[9:3] == 7'd6) begin
+              lane_sum_0 <= lane_sum_0 + prod_0;
+              lane_sum_1 <= lane_sum_1 + prod_1;
+              lane_sum_2 <= lane_sum_2 + prod_2;
+              lane_sum_3 <= lane_sum_3 + prod_3;
+              rsp_valid <= 1'b1;
+            end else if (cmd_payload_function_id[9:3] == 7'd7) begin
+              total_sum <= lane_sum_sel;
+              rsp_payload_outputs_0 <= lane_sum_sel;
+              rsp_valid <= 1'b1;
+            end else if (cmd_payload_function_id[9:3] == 7'd8) begin
+              InputOffset <= cmd_payload_inputs_0[8:0];
+              rsp_valid <= 1'b1;
             end
           end else begin
             next_state <= INPUT_DATA;
@@ -0,0 +1,462 @@
+module cfuop_softmax (
+  input               cmd_valid,
+  output              cmd_ready,
+  input      [9:0]    cmd_payload_function_id,
+  input      [31:0]   cmd_payload_inputs_0,
+  input      [31:0]   cmd_payload_inputs_1,
+  output reg          rsp_valid,
+  input               rsp_ready,
+  output reg [31:0]   rsp_payload_outputs_0,
+  input               reset,
+  input               clk
+);
+
+  // Only not ready for a command when we have a response.
+  assign cmd_ready = ~rsp_valid;
+
+  /******** function7 ********/
+  // 0: input beta multiplier (rs1), input beta left shift (rs2)
+  // 1: start a row: max of the row (rs1), diff_min (rs2); clears the sum
+  // 2: add exp() of the first rs2 (1..4) lanes of rs1 to the sum, returns the sum
+  // 3: reciprocal of the sum, 2**50 / sum saturated to 32 bits, returns it
+  // 4: int8 probabilities of the 4 lanes of rs1, -128 below diff_min
+  //
+  // The scaled diff is Q5.26 as in reference_ops::Softmax; exp() is Q0.31 and
+  // the sum Q12.19, so it holds up to 4096 exps. exp() is the Lab4 LUT
+  // (cfu_lut.v) with 4 points below -5 added: linear interpolation between
+  // the LUT_SIZE points of [-9, 0], 0 below -9. A probability is
+  // (exp * reciprocal) >> 54 rounded, which is exp / sum in Q0.8.
+  localparam LUT_SIZE   = 68;
+  localparam RECIP_BITS = 50;
+
+  /******** state definition ********/
+  reg [3:0] state, next_state;
+  reg [3:0] calc_state, next_calc_state;
+
+  parameter IDLE            = 4'd0;
+  parameter CALC            = 4'd1;
+  parameter RECIP           = 4'd2;
+  parameter CFU_DONE        = 4'd3;
+
+  parameter SCALE           = 4'd0;
+  parameter ROUND           = 4'd1;
+  parameter SEGMENT         = 4'd2;
+  parameter INTERP          = 4'd3;
+  parameter REDUCE          = 4'd4;
+
+  /******** parameters of the op and the row ********/
+  reg signed [31:0] beta_multiplier;
+  reg        [4:0]  beta_left_shift;
+  reg signed [31:0] max_in_row;
+  reg signed [31:0] diff_min;
+  reg        [31:0] sum;
+  reg        [31:0] reciprocal;
+
+  /******* internal register ********/
+  reg        [6:0]  mode;
+  reg        [3:0]  lane_valid;
+  reg signed [8:0]  diff [0:3];
+  reg signed [63:0] scaled_prod [0:3];
+  reg signed [31:0] scaled [0:3];
+  reg        [6:0]  seg [0:3];
+  reg        [31:0] exp_val [0:3];
+  reg        [31:0] prob [0:3];
+
+  reg        [32:0] recip_rem;
+  reg        [RECIP_BITS:0] recip_quot;
+  reg        [5:0]  recip_bit;
+
+  integer lane;
+
+  /********* internal wire **********/
+  wire signed [8:0] in_diff_0, in_diff_1, in_diff_2, in_diff_3;
+  assign in_diff_0 = $signed(cmd_payload_inputs_0[7 : 0]) - max_in_row;
+  assign in_diff_1 = $signed(cmd_payload_inputs_0[15: 8]) - max_in_row;
+  assign in_diff_2 = $signed(cmd_payload_inputs_0[23:16]) - max_in_row;
+  assign in_diff_3 = $signed(cmd_payload_inputs_0[31:24]) - max_in_row;
+
+  wire [32:0] recip_shifted;
+  assign recip_shifted = {recip_rem[31:0], recip_bit == RECIP_BITS};
+
+  wire [31:0] exp_rescaled_sum;
+  assign exp_rescaled_sum = ((exp_val[0] + 32'd2048) >> 12) + ((exp_val[1] + 32'd2048) >> 12)
+                          + ((exp_val[2] + 32'd2048) >> 12) + ((exp_val[3] + 32'd2048) >> 12);
+
+  /******** exp() LUT ********/
+  // Last point at or below x
+  function [6:0] lut_seg;
+    input signed [31:0] x;
+    integer i;
+    begin
+      lut_seg = 7'd0;
+      for (i = 1; i < LUT_SIZE; i = i + 1) begin
+        if (x >= $signed(lut_x(i))) lut_seg = i;
+      end
+    end
+  endfunction
+
+  function [31:0] lut_exp;
+    input signed [31:0] x;
+    input [6:0] i;
+    reg signed [63:0] step;
+    begin
+      step = $signed({1'b0, lut_slope(i)}) * (x - $signed(lut_x(i))) + $signed(64'd1 << 23);
+      lut_exp = lut_y(i) + step[55:24];
+    end
+  endfunction
+
+
+  function [31:0] lut_x;
+    input [6:0] i;
+    case (i)
+      7'd0: lut_x = 32'hdc000000; // x = -9.000
+      7'd1: lut_x = 32'he0000000; // x = -8.000
+      7'd2: lut_x = 32'he4000000; // x = -7.000
+      7'd3: lut_x = 32'he8000000; // x = -6.000
+      7'd4: lut_x = 32'hec000000; // x = -5.000
+      7'd5: lut_x = 32'hee000000; // x = -4.500
+      7'd6: lut_x = 32'hf0000000; // x = -4.000
+      7'd7: lut_x = 32'hf2000000; // x = -3.500
+      7'd8: lut_x = 32'hf4000000; // x = -3.000
+      7'd9: lut_x = 32'hf5000000; // x = -2.750
+      7'd10: lut_x = 32'hf6000000; // x = -2.500
+      7'd11: lut_x = 32'hf7000000; // x = -2.250
+      7'd12: lut_x = 32'hf8000000; // x = -2.000
+      7'd13: lut_x = 32'hf9851eb8; // x = -1.620
+      7'd14: lut_x = 32'hfa51eb85; // x = -1.420
+      7'd15: lut_x = 32'hfb1eb852; // x = -1.220
+      7'd16: lut_x = 32'hfbc28f5e; // x = -1.060
+      7'd17: lut_x = 32'hfbeb851e; // x = -1.020
+      7'd18: lut_x = 32'hfc000000; // x = -1.000
+      7'd19: lut_x = 32'hfc51eb85; // x = -0.920
+      7'd20: lut_x = 32'hfc666666; // x = -0.900
+      7'd21: lut_x = 32'hfc7ae147; // x = -0.880
+      7'd22: lut_x = 32'hfc999999; // x = -0.850
+      7'd23: lut_x = 32'hfcb851eb; // x = -0.820
+      7'd24: lut_x = 32'hfccccccd; // x = -0.800
+      7'd25: lut_x = 32'hfce147ae; // x = -0.780
+      7'd26: lut_x = 32'hfd000000; // x = -0.750
+      7'd27: lut_x = 32'hfd1eb852; // x = -0.720
+      7'd28: lut_x = 32'hfd333333; // x = -0.700
+      7'd29: lut_x = 32'hfd47ae14; // x = -0.680
+      7'd30: lut_x = 32'hfd666666; // x = -0.650
+      7'd31: lut_x = 32'hfd851eb8; // x = -0.620
+      7'd32: lut_x = 32'hfd999999; // x = -0.600
+      7'd33: lut_x = 32'hfdae147b; // x = -0.580
+      7'd34: lut_x = 32'hfdcccccd; // x = -0.550
+      7'd35: lut_x = 32'hfdeb851e; // x = -0.520
+      7'd36: lut_x = 32'hfe000000; // x = -0.500
+      7'd37: lut_x = 32'hfe1eb852; // x = -0.470
+      7'd38: lut_x = 32'hfe333333; // x = -0.450
+      7'd39: lut_x = 32'hfe51eb85; // x = -0.420
+      7'd40: lut_x = 32'hfe666666; // x = -0.400
+      7'd41: lut_x = 32'hfe851eb8; // x = -0.370
+      7'd42: lut_x = 32'hfe999999; // x = -0.350
+      7'd43: lut_x = 32'hfeb851eb; // x = -0.320
+      7'd44: lut_x = 32'hfecccccd; // x = -0.300
+      7'd45: lut_x = 32'hfeeb851e; // x = -0.270
+      7'd46: lut_x = 32'hff000000; // x = -0.250
+      7'd47: lut_x = 32'hff1eb852; // x = -0.220
+      7'd48: lut_x = 32'hff333333; // x = -0.200
+      7'd49: lut_x = 32'hff428f5c; // x = -0.185
+      7'd50: lut_x = 32'hff570a3d; // x = -0.165
+      7'd51: lut_x = 32'hff666666; // x = -0.150
+      7'd52: lut_x = 32'hff999999; // x = -0.100
+      7'd53: lut_x = 32'hffa8f5c2; // x = -0.085
+      7'd54: lut_x = 32'hffb851eb; // x = -0.070
+      7'd55: lut_x = 32'hffcccccd; // x = -0.050
+      7'd56: lut_x = 32'hffd70a3d; // x = -0.040
+      7'd57: lut_x = 32'hffe147ae; // x = -0.030
+      7'd58: lut_x = 32'hffeb851e; // x = -0.020
+      7'd59: lut_x = 32'hffee978d; // x = -0.017
+      7'd60: lut_x = 32'hfff0a3d7; // x = -0.015
+      7'd61: lut_x = 32'hfff2b021; // x = -0.013
+      7'd62: lut_x = 32'hfff5c28f; // x = -0.010
+      7'd63: lut_x = 32'hfff6c8b4; // x = -0.009
+      7'd64: lut_x = 32'hfff8d4fe; // x = -0.007
+      7'd65: lut_x = 32'hfffae147; // x = -0.005
+      7'd66: lut_x = 32'hfffced91; // x = -0.003
+      7'd67: lut_x = 32'h00000000; // x = 0.000
+      default: lut_x = 32'h0;
+    endcase
+  endfunction
+
+  function [31:0] lut_y;
+    input [6:0] i;
+    case (i)
+      7'd0: lut_y = 32'h00040b3d;
+      7'd1: lut_y = 32'h000afe11;
+      7'd2: lut_y = 32'h001de16c;
+      7'd3: lut_y = 32'h00513948;
+      7'd4: lut_y = 32'h00dcc9ff;
+      7'd5: lut_y = 32'h016c0504;
+      7'd6: lut_y = 32'h02582ab7;
+      7'd7: lut_y = 32'h03dd8203;
+      7'd8: lut_y = 32'h065f6c33;
+      7'd9: lut_y = 32'h082ec9c5;
+      7'd10: lut_y = 32'h0a81c2e0;
+      7'd11: lut_y = 32'h0d7db8c7;
+      7'd12: lut_y = 32'h1152aaa4;
+      7'd13: lut_y = 32'h1954be9a;
+      7'd14: lut_y = 32'h1ef07c22;
+      7'd15: lut_y = 32'h25ca1a25;
+      7'd16: lut_y = 32'h2c58aa10;
+      7'd17: lut_y = 32'h2e27f991;
+      7'd18: lut_y = 32'h2f16ac6c;
+      7'd19: lut_y = 32'h3302ac03;
+      7'd20: lut_y = 32'h340a797b;
+      7'd21: lut_y = 32'h35179b37;
+      7'd22: lut_y = 32'h36b58849;
+      7'd23: lut_y = 32'h38601079;
+      7'd24: lut_y = 32'h39839c8e;
+      7'd25: lut_y = 32'h3aad0c54;
+      7'd26: lut_y = 32'h3c7681d8;
+      7'd27: lut_y = 32'h3e4de5e0;
+      7'd28: lut_y = 32'h3f901b71;
+      7'd29: lut_y = 32'h40d8d353;
+      7'd30: lut_y = 32'h42d2655a;
+      7'd31: lut_y = 32'h44db5cfe;
+      7'd32: lut_y = 32'h463f75a4;
+      7'd33: lut_y = 32'h47aabfed;
+      7'd34: lut_y = 32'h49d97dcf;
+      7'd35: lut_y = 32'h4c193fc5;
+      7'd36: lut_y = 32'h4da2cbf2;
+      7'd37: lut_y = 32'h50001309;
+      7'd38: lut_y = 32'h519dcc99;
+      7'd39: lut_y = 32'h541a1c33;
+      7'd40: lut_y = 32'h55cd0c11;
+      7'd41: lut_y = 32'h5869fb81;
+      7'd42: lut_y = 32'h5a333818;
+      7'd43: lut_y = 32'h5cf27393;
+      7'd44: lut_y = 32'h5ed321ac;
+      7'd45: lut_y = 32'h61b66b44;
+      7'd46: lut_y = 32'h63afbe7b;
+      7'd47: lut_y = 32'h66b8ef9e;
+      7'd48: lut_y = 32'h68cc2b53;
+      7'd49: lut_y = 32'h6a61a007;
+      7'd50: lut_y = 32'h6c87c7dd;
+      7'd51: lut_y = 32'h6e2badc6;
+      7'd52: lut_y = 32'h73d1b656;
+      7'd53: lut_y = 32'h7591cf6f;
+      7'd54: lut_y = 32'h7758ae32;
+      7'd55: lut_y = 32'h79c1e2c9;
+      7'd56: lut_y = 32'h7afb25ec;
+      7'd57: lut_y = 32'h7c378f28;
+      7'd58: lut_y = 32'h7d772658;
+      7'd59: lut_y = 32'h7dd7a6f1;
+      7'd60: lut_y = 32'h7e1825e4;
+      7'd61: lut_y = 32'h7e58c5e6;
+      7'd62: lut_y = 32'h7eb9f3e9;
+      7'd63: lut_y = 32'h7eda6939;
+      7'd64: lut_y = 32'h7f1b6ccb;
+      7'd65: lut_y = 32'h7f5c918f;
+      7'd66: lut_y = 32'h7f9dd7d6;
+      7'd67: lut_y = 32'h7fffffff;
+      default: lut_y = 32'h0;
+    endcase
+  endfunction
+
+  function [31:0] lut_slope;
+    input [6:0] i;
+    case (i)
+      7'd0: lut_slope = 32'h0001bcb5;
+      7'd1: lut_slope = 32'h0004b8d7;
+      7'd2: lut_slope = 32'h000cd5f7;
+      7'd3: lut_slope = 32'h0022e42e;
+      7'd4: lut_slope = 32'h00479d82;
+      7'd5: lut_slope = 32'h007612da;
+      7'd6: lut_slope = 32'h00c2aba6;
+      7'd7: lut_slope = 32'h0140f518;
+      7'd8: lut_slope = 32'h01cf5d92;
+      7'd9: lut_slope = 32'h0252f91b;
+      7'd10: lut_slope = 32'h02fbf5e7;
+      7'd11: lut_slope = 32'h03d4f1dd;
+      7'd12: lut_slope = 32'h0544bc4b;
+      7'd13: lut_slope = 32'h0702ace8;
+      7'd14: lut_slope = 32'h08900582;
+      7'd15: lut_slope = 32'h0a3ec0c3;
+      7'd16: lut_slope = 32'h0b4fb19b;
+      7'd17: lut_slope = 32'h0ba7bb49;
+      7'd18: lut_slope = 32'h0c417ebc;
+      7'd19: lut_slope = 32'h0ce18889;
+      7'd20: lut_slope = 32'h0d2425dc;
+      7'd21: lut_slope = 32'h0d796238;
+      7'd22: lut_slope = 32'h0de26edc;
+      7'd23: lut_slope = 32'h0e3c5686;
+      7'd24: lut_slope = 32'h0e85f55e;
+      7'd25: lut_slope = 32'h0ee42897;
+      7'd26: lut_slope = 32'h0f58418e;
+      7'd27: lut_slope = 32'h0fbb9dcc;
+      7'd28: lut_slope = 32'h100cfac1;
+      7'd29: lut_slope = 32'h1075162f;
+      7'd30: lut_slope = 32'h10f564f6;
+      7'd31: lut_slope = 32'h11633458;
+      7'd32: lut_slope = 32'h11bd1ff1;
+      7'd33: lut_slope = 32'h12302e4f;
+      7'd34: lut_slope = 32'h12bdfb92;
+      7'd35: lut_slope = 32'h13375786;
+      7'd36: lut_slope = 32'h13b3fb08;
+      7'd37: lut_slope = 32'h14338fcf;
+      7'd38: lut_slope = 32'h14b6974b;
+      7'd39: lut_slope = 32'h153cb6a1;
+      7'd40: lut_slope = 32'h15c675ec;
+      7'd41: lut_slope = 32'h165375ae;
+      7'd42: lut_slope = 32'h16e444f2;
+      7'd43: lut_slope = 32'h17787f65;
+      7'd44: lut_slope = 32'h1810bb56;
+      7'd45: lut_slope = 32'h18ac8f51;
+      7'd46: lut_slope = 32'h194c9968;
+      7'd47: lut_slope = 32'h19f06ab1;
+      7'd48: lut_slope = 32'h1a6598fc;
+      7'd49: lut_slope = 32'h1adcf251;
+      7'd50: lut_slope = 32'h1b564d19;
+      7'd51: lut_slope = 32'h1c3e2aec;
+      7'd52: lut_slope = 32'h1d2c4ce3;
+      7'd53: lut_slope = 32'h1d9d2b49;
+      7'd54: lut_slope = 32'h1e231050;
+      7'd55: lut_slope = 32'h1e979054;
+      7'd56: lut_slope = 32'h1ee645c6;
+      7'd57: lut_slope = 32'h1f35c5a3;
+      7'd58: lut_slope = 32'h1f69d84d;
+      7'd59: lut_slope = 32'h1f7df878;
+      7'd60: lut_slope = 32'h1f8e1cc9;
+      7'd61: lut_slope = 32'h1fa255bd;
+      7'd62: lut_slope = 32'h1fb28bea;
+      7'd63: lut_slope = 32'h1fbeba13;
+      7'd64: lut_slope = 32'h1fceff03;
+      7'd65: lut_slope = 32'h1fdf4c6f;
+      7'd66: lut_slope = 32'h1ff3b91a;
+      7'd67: lut_slope = 32'h00000000;
+      default: lut_slope = 32'h0;
+    endcase
+  endfunction
+
+  always @(posedge clk or posedge reset) begin
+     if (reset) begin
+      state <= IDLE;
+      next_state <= IDLE;
+      calc_state <= SCALE;
+      next_calc_state <= SCALE;
+      beta_multiplier <= 32'd0;
+      beta_left_shift <= 5'd0;
+      max_in_row <= 32'd0;
+      diff_min <= 32'd0;
+      sum <= 32'd0;
+      reciprocal <= 32'd0;
+     end else if (rsp_valid) rsp_valid <= 1'b0;
+     else begin
+      state = next_state;
+      case (state)
+        IDLE: begin
+          if (cmd_valid) begin
+            mode <= cmd_payload_function_id[9:3];
+            if (cmd_payload_function_id[9:3] == 7'd0) begin
+              beta_multiplier <= cmd_payload_inputs_0;
+              beta_left_shift <= cmd_payload_inputs_1[4:0];
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd1) begin
+              max_in_row <= $signed(cmd_payload_inputs_0[7:0]);
+              diff_min <= cmd_payload_inputs_1;
+              sum <= 32'd0;
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd2 || cmd_payload_function_id[9:3] == 7'd4) begin
+              diff[0] <= in_diff_0;
+              diff[1] <= in_diff_1;
+              diff[2] <= in_diff_2;
+              diff[3] <= in_diff_3;
+              // rs2 only limits the lanes that are summed
+              lane_valid[0] <= in_diff_0 >= diff_min;
+              lane_valid[1] <= in_diff_1 >= diff_min &&
+                               (cmd_payload_function_id[9:3] == 7'd4 || cmd_payload_inputs_1 > 32'd1);
+              lane_valid[2] <= in_diff_2 >= diff_min &&
+                               (cmd_payload_function_id[9:3] == 7'd4 || cmd_payload_inputs_1 > 32'd2);
+              lane_valid[3] <= in_diff_3 >= diff_min &&
+                               (cmd_payload_function_id[9:3] == 7'd4 || cmd_payload_inputs_1 > 32'd3);
+              next_calc_state <= SCALE;
+              next_state <= CALC;
+            end
+            else if (cmd_payload_function_id[9:3] == 7'd3) begin
+              recip_rem <= 33'd0;
+              recip_quot <= 0;
+              recip_bit <= RECIP_BITS;
+              next_state <= RECIP;
+            end
+            else begin
+              rsp_payload_outputs_0 <= 32'd0;
+              rsp_valid <= 1'b1;
+            end
+          end else begin
+            next_state <= IDLE;
+          end
+        end
+        CALC: begin
+          calc_state = next_calc_state;
+          case (calc_state)
+            SCALE: begin
+              // MultiplyByQuantizedMultiplierGreaterThanOne, diff <= 0
+              for (lane = 0; lane < 4; lane = lane + 1)
+                scaled_prod[lane] <= (diff[lane] * beta_multiplier) <<< beta_left_shift;
+              next_calc_state <= ROUND;
+            end
+            ROUND: begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                scaled[lane] <= -((-scaled_prod[lane] + $signed(64'd1 << 30) - 1) >>> 31);
+              next_calc_state <= SEGMENT;
+            end
+            SEGMENT: begin
+              for (lane = 0; lane < 4; lane = lane + 1) begin
+                seg[lane] <= lut_seg(scaled[lane]);
+                if (scaled[lane] < $signed(lut_x(0))) lane_valid[lane] <= 1'b0;
+              end
+              next_calc_state <= INTERP;
+            end
+            INTERP: begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                exp_val[lane] <= lane_valid[lane] ? lut_exp(scaled[lane], seg[lane]) : 32'd0;
+              next_calc_state <= REDUCE;
+            end
+            REDUCE: begin
+              for (lane = 0; lane < 4; lane = lane + 1)
+                prob[lane] <= (({32'd0, exp_val[lane]} * reciprocal + (64'd1 << 53)) >> 54);
+              if (mode == 7'd2) sum <= sum + exp_rescaled_sum;
+              next_calc_state <= SCALE;
+              next_state <= CFU_DONE;
+            end
+          endcase
+        end
+        RECIP: begin
+          // Restoring division of 2**RECIP_BITS by the sum, one bit per cycle
+          if (recip_shifted >= {1'b0, sum}) begin
+            recip_rem <= recip_shifted - {1'b0, sum};
+            recip_quot <= {recip_quot[RECIP_BITS-1:0], 1'b1};
+          end else begin
+            recip_rem <= recip_shifted;
+            recip_quot <= {recip_quot[RECIP_BITS-1:0], 1'b0};
+          end
+          if (recip_bit == 6'd0) next_state <= CFU_DONE;
+          else recip_bit <= recip_bit - 1'b1;
+        end
+        CFU_DONE: begin
+          rsp_valid <= 1'b1;
+          if (mode == 7'd2) begin
+            rsp_payload_outputs_0 <= sum;
+          end else if (mode == 7'd3) begin
+            reciprocal <= |recip_quot[RECIP_BITS:32] ? 32'hffffffff : recip_quot[31:0];
+            rsp_payload_outputs_0 <= |recip_quot[RECIP_BITS:32] ? 32'hffffffff : recip_quot[31:0];
+          end else begin
+            // prob is 0 .. 256, output is prob - 128 clamped to int8
+            rsp_payload_outputs_0 <= {prob[3] > 32'd255 ? 8'd127 : prob[3][7:0] - 8'd128,
+                                      prob[2] > 32'd255 ? 8'd127 : prob[2][7:0] - 8'd128,
+                                      prob[1] > 32'd255 ? 8'd127 : prob[1][7:0] - 8'd128,
+                                      prob[0] > 32'd255 ? 8'd127 : prob[0][7:0] - 8'd128};
+          end
+          next_state <= IDLE;
+        end
+      endcase
+    end
+  end
+endmodule
@@ -1,31 +1,34 @@
-module controller (
+module controller #(
+    parameter ArraySize = 4,
+    parameter DimBits = 8
+) (
     input clk,
     input rst_n,
     input in_valid,
-    input [7:0] K,
-    input [7:0] M,
-    input [7:0] N,
+    input [DimBits-1:0] K,
+    input [DimBits-1:0] M,
+    input [DimBits-1:0] N,
     output      busy,
     output      complete,
     // Memory
     output        a_wr_en,
     output [15:0] a_addr,
-    input  [31:0] a_data,
+    input  [ArraySize*8-1:0] a_data,
     output        b_wr_en,
     output [15:0] b_addr,
-    input  [31:0] b_data,
+    input  [ArraySize*8-1:0] b_data,
     output        c_wr_en,
     output [15:0] c_addr,
     // Systolic Array
     input      sa_busy,
     output     sa_start,
-    output reg [2:0] sa_row_en,
+    output reg [ArraySize-2:0] sa_row_en,
     input      sa_o_last,
     input      sa_o_valid,
     output reg sa_i_last,
     output reg sa_i_vaild,
-    output reg [31:0] sa_weight,
-    output reg [31:0] sa_input
+    output reg [ArraySize*8-1:0] sa_weight,
+    output reg [ArraySize*8-1:0] sa_input
 );
 // (6x7)*(7x5) for example:
 // M=6, K=7, N=5 
@@ -60,14 +63,16 @@ module controller (
 localparam S_IDLE = 'd0;
 localparam S_WAIT = 'd1;
 localparam S_READ = 'd2;
+localparam LOG2_SIZE = $clog2(ArraySize);
 
 // ==========
 //  WIRE & REG
 // ==========
 reg [1:0] cur_state, nxt_state;
-reg [7:0] max_cnt, cnt;
-reg [5:0] max_weight_reuse, max_input_loop, cnt_ifeature, cnt_weight;
-reg [1:0] row_offset;
+reg [DimBits-1:0] max_cnt, cnt;
+reg [DimBits-1:0] max_weight_reuse, max_input_loop, cnt_ifeature, cnt_weight;
+reg [LOG2_SIZE-1:0] row_offset;
+wire [ArraySize-1:0] last_row_en;
 reg [15:0] ifeature_addr, weight_addr, ofeature_addr;
 wire sa_run, finish;
 
@@ -102,16 +107,13 @@ end
 assign sa_start = (cur_state == S_WAIT) & (cnt_ifeature <= max_input_loop);
 assign sa_run = sa_start & ~sa_busy;
 assign finish = (cnt_ifeature > max_input_loop) & sa_o_last;
+// Rows 1..ArraySize-1 of the last (partial) row group
+assign last_row_en = ({{(ArraySize-1){1'b0}}, 1'b1} << (row_offset - 1'b1)) - 1'b1;
 always @(*) begin
-    if (cnt_weight == max_weight_reuse) begin
-        case (row_offset)
-            'd1: sa_row_en = 3'b000;
-            'd2: sa_row_en = 3'b001;
-            'd3: sa_row_en = 3'b011;
-            default: sa_row_en = 3'b111;
-        endcase
+    if (cnt_weight == max_weight_reuse && row_offset != 'd0) begin
+        sa_row_en = last_row_en[ArraySize-2:0];
     end else begin
-        sa_row_en = 3'b111;
+        sa_row_en = {(ArraySize-1){1'b1}};
     end
 end
 always @(posedge clk or negedge rst_n) begin
@@ -137,9 +139,9 @@ always @(posedge clk or negedge rst_n) begin
     end else begin
         if (cur_state==S_IDLE & in_valid) begin
             max_cnt <= K - 1'd1;
-            max_input_loop <= (N >> 2) - (~|N[1:0]);
-            max_weight_reuse <= (M >> 2) - (~|M[1:0]);
-            row_offset <= M[1:0];
+            max_input_loop <= (N >> LOG2_SIZE) - (~|N[LOG2_SIZE-1:0]);
+            max_weight_reuse <= (M >> LOG2_SIZE) - (~|M[LOG2_SIZE-1:0]);
+            row_offset <= M[LOG2_SIZE-1:0];
         end
     end
 end
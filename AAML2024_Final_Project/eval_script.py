@@ -8,6 +8,8 @@ import time
 
 READY_MSG='m-ready\r\n'
 SEND_BYTES=64
+BIN_FRAME_SYNC=0xA5
+BIN_FRAME_MAX=1024
 
 def parse_arg():
     parser = argparse.ArgumentParser()
@@ -17,8 +19,45 @@ def parse_arg():
                             help='Device port, e.g, --port /dev/ttyUSB1.')
     parser.add_argument("-p", nargs='?', dest='port', type=str,
                             help='Device port, e.g, -p /dev/ttyUSB1.')
+    parser.add_argument("--batch", nargs='?', default=1, type=int,
+                            help='Images per inference, must match MLPERF_TINY_BATCH of the firmware, e.g., --batch 4')
+    parser.add_argument("--binary", action='store_true',
+                            help='Upload images with binary `db bin` frames instead of hex `db` commands')
     return parser.parse_args()
 
+def fletcher16(data):
+    sum1, sum2 = 0, 0
+    for b in data:
+        sum1 = (sum1 + b) % 255
+        sum2 = (sum2 + sum1) % 255
+    return (sum2 << 8) | sum1
+
+def send_binary(com, data):
+    """Send the bytes announced by `db load` as `db bin` frames.
+
+    See ee_buffer_load_binary() in internally_implemented.cpp for the framing.
+    """
+    com.write("db bin%".encode())
+    msg = com.read_until(b'm-bin-ready\r\n').decode()
+    if 'e-[' in msg:
+        raise BaseException(f'db bin failed: {msg}')
+    pos = 0
+    while pos < len(data):
+        payload = data[pos:pos + BIN_FRAME_MAX]
+        header = len(payload).to_bytes(2, 'little')
+        header_check = fletcher16(bytes([BIN_FRAME_SYNC]) + header).to_bytes(2, 'little')
+        check = fletcher16(header + payload).to_bytes(2, 'little')
+        com.write(bytes([BIN_FRAME_SYNC]) + header + header_check + payload + check)
+        reply = com.read_until(b'\r\n').decode()
+        if 'm-bin-ack' in reply:
+            pos += len(payload)
+        else:
+            # Let the DUT drop what is left of the bad frame, and skip the
+            # NAKs of any false marker in it, then resend
+            time.sleep(0.1)
+            com.reset_input_buffer()
+    com.read_until(READY_MSG.encode())
+
 class PerfFormat:
     def __init__(self, filename, output_len, ground_truth) -> None:
         self.filename = filename
@@ -51,25 +90,36 @@ if __name__ == '__main__':
         raise(BaseException('Opening serial port failed!'))
 
     result = {'correct_cnt':0, 'latency':[]}
-    for testcase in tqdm(testcases):
-        with open(os.path.join('perf_samples', testcase.filename), 'rb') as test_input:
-            com.read_all()
-            com.write(f"db load {32*32*3}%".encode())
-            com.read_until(READY_MSG.encode()).decode()
-            data = test_input.read(SEND_BYTES//2)
-            while len(data) > 0:
-                com.write(f"db {data.hex()}%".encode())
-                s = com.read_until(READY_MSG.encode()).decode()
-                data = test_input.read(SEND_BYTES//2)
-            com.write(f"infer 1 0%".encode())
-            msg = com.read_until(READY_MSG.encode()).decode()
-            m = [ int(x) for x in re.findall('m-lap-us-([0-9]*)', msg)]
-            result['latency'].append(m[1]-m[0])
-            m = re.search('m-results-\\[((?:-?[0-9]+,?)+)\\]', msg).group(1)
-            m = [int(x) for x in m.split(',')]
+    batches = [testcases[i:i + args.batch] for i in range(0, len(testcases), args.batch)]
+    for batch in tqdm(batches):
+        com.read_all()
+        com.write(f"db load {input_size*len(batch)}%".encode())
+        com.read_until(READY_MSG.encode()).decode()
+        if args.binary:
+            data = b''
+            for testcase in batch:
+                with open(os.path.join('perf_samples', testcase.filename), 'rb') as test_input:
+                    data += test_input.read(input_size)
+            send_binary(com, data)
+        else:
+            for testcase in batch:
+                with open(os.path.join('perf_samples', testcase.filename), 'rb') as test_input:
+                    data = test_input.read(SEND_BYTES//2)
+                    while len(data) > 0:
+                        com.write(f"db {data.hex()}%".encode())
+                        s = com.read_until(READY_MSG.encode()).decode()
+                        data = test_input.read(SEND_BYTES//2)
+        com.write(f"infer 1 0%".encode())
+        msg = com.read_until(READY_MSG.encode()).decode()
+        m = [ int(x) for x in re.findall('m-lap-us-([0-9]*)', msg)]
+        # latency per image
+        result['latency'] += [(m[1]-m[0]) / len(batch)] * len(batch)
+        outputs = re.findall('m-results-\\[((?:-?[0-9]+,?)+)\\]', msg)
+        for testcase, output in zip(batch, outputs):
+            m = [int(x) for x in output.split(',')]
             arg_max = [i for i, x in enumerate(m) if x == max(m)][0]
             result['correct_cnt'] += arg_max == testcase.ground_truth
-            print(result)
+        print(result)
 
     acc = result['correct_cnt'] / len(testcases)
     lat = sum(result['latency'])/len(testcases)
@@ -1,7 +1,11 @@
 `include "systolic_array.v"
 `include "controller.v"
 
-module gemm(
+module gemm #(
+    parameter ArraySize = 4,
+    parameter DimBits = 8,
+    parameter FoldOffset = 0
+) (
     clk,
     rst_n,
 
@@ -31,38 +35,41 @@ module gemm(
 input clk;
 input rst_n;
 input            in_valid;
-input [7:0]      K;
-input [7:0]      M;
-input [7:0]      N;
+input [DimBits-1:0] K;
+input [DimBits-1:0] M;
+input [DimBits-1:0] N;
 input [8:0]      offset;
 output           busy;
 output           complete;
 
 output           A_wr_en;
 output [15:0]    A_index;
-output [31:0]    A_data_in;
-input  [31:0]    A_data_out;
+output [ArraySize*8-1:0] A_data_in;
+input  [ArraySize*8-1:0] A_data_out;
 
 output           B_wr_en;
 output [15:0]    B_index;
-output [31:0]    B_data_in;
-input  [31:0]    B_data_out;
+output [ArraySize*8-1:0] B_data_in;
+input  [ArraySize*8-1:0] B_data_out;
 
 output           C_wr_en;
 output [15:0]    C_index;
-output [127:0]   C_data_in;
-input  [127:0]   C_data_out;
+output [ArraySize*32-1:0] C_data_in;
+input  [ArraySize*32-1:0] C_data_out;
 
 //* Implement your design here
 
 // Interconnect
-wire [2:0] w_sa_row_en;
-wire [31:0] w_sa_input, w_sa_weight;
+wire [ArraySize-2:0] w_sa_row_en;
+wire [ArraySize*8-1:0] w_sa_input, w_sa_weight;
 wire w_sa_busy, w_sa_start;
 wire w_sa_i_last, w_sa_i_valid;
 wire w_sa_o_last, w_sa_o_valid;
 
-controller u_ctrl (
+controller #(
+    .ArraySize(ArraySize),
+    .DimBits  (DimBits)
+) u_ctrl (
     .clk        (clk),
     .rst_n      (rst_n),
     .in_valid   (in_valid),
@@ -93,10 +100,11 @@ controller u_ctrl (
 );
 
 systolic_array #(
-    .ArraySize(4),
+    .ArraySize(ArraySize),
     .DataWidth(8),
     .AccWidth (32),
-    .UseSigned(1)
+    .UseSigned(1),
+    .FoldOffset(FoldOffset)
 ) u_sa (
     .clk       (clk),
     .rst_n     (rst_n),
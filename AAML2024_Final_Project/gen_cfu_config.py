@@ -0,0 +1,44 @@
+import re
+import argparse
+
+# Generate src/cfu_config.h from cfu_config.vh, so the kernels and the
+# gateware always agree on the GEMM unit configuration.
+
+HEADER = '''/*
+ * Generated by gen_cfu_config.py from cfu_config.vh. Do not edit.
+ */
+#ifndef _CFU_CONFIG_H
+#define _CFU_CONFIG_H
+
+{defines}
+
+// Derived
+#define CFU_GEMM_LANE_WORDS  (CFU_SA_SIZE / 4)
+#define CFU_GEMM_BANK_WORDS  (1 << CFU_BUFF_ADDR_BITS)
+#define CFU_GEMM_MAX_DIM     ((1 << CFU_DIM_BITS) - 1)
+#define CFU_GEMM_MAX_N_TILE  (1 << CFU_QPARAM_CH_BITS)
+
+#endif  // _CFU_CONFIG_H
+'''
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('config_path', nargs='?', default='./cfu_config.vh')
+    parser.add_argument('output_path', nargs='?', default='src/cfu_config.h')
+    args = parser.parse_args()
+
+    with open(args.config_path) as f:
+        config = re.findall(r'^`define\s+(CFU_\w+)\s+(\d+)\s*$', f.read(), re.MULTILINE)
+    values = {name: int(value) for name, value in config}
+
+    if values['CFU_SA_SIZE'] not in (4, 8, 16):
+        raise SystemExit('CFU_SA_SIZE must be 4, 8 or 16')
+    lane_bits = (values['CFU_SA_SIZE'] // 4).bit_length() - 1
+    if values['CFU_BUFF_ADDR_BITS'] + lane_bits >= values['CFU_BANK_BIT']:
+        raise SystemExit('CFU_BANK_BIT overlaps the buffer address')
+    if values['CFU_QPARAM_CH_BITS'] > 8:
+        raise SystemExit('CFU_QPARAM_CH_BITS must fit below the table select bits [9:8]')
+
+    defines = '\n'.join(f'#define {name:<20} {value}' for name, value in config)
+    with open(args.output_path, 'w') as f:
+        f.write(HEADER.format(defines=defines))
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host replacement of the common cfu.h for the native build: every CFU op
+ * goes to the software model in software_cfu.cc.
+ */
+#ifndef _CFU_H
+#define _CFU_H
+
+#include <stdint.h>
+
+#include "software_cfu.h"
+
+#define cfu_op(funct3, funct7, rs1, rs2) \
+  software_cfu((funct3), (funct7), (uint32_t)(rs1), (uint32_t)(rs2))
+
+#define cfu_op0(funct7, rs1, rs2) cfu_op(0, funct7, rs1, rs2)
+#define cfu_op1(funct7, rs1, rs2) cfu_op(1, funct7, rs1, rs2)
+#define cfu_op2(funct7, rs1, rs2) cfu_op(2, funct7, rs1, rs2)
+#define cfu_op3(funct7, rs1, rs2) cfu_op(3, funct7, rs1, rs2)
+#define cfu_op4(funct7, rs1, rs2) cfu_op(4, funct7, rs1, rs2)
+#define cfu_op5(funct7, rs1, rs2) cfu_op(5, funct7, rs1, rs2)
+#define cfu_op6(funct7, rs1, rs2) cfu_op(6, funct7, rs1, rs2)
+#define cfu_op7(funct7, rs1, rs2) cfu_op(7, funct7, rs1, rs2)
+
+#endif  // _CFU_H
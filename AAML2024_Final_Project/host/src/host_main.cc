@@ -0,0 +1,187 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * AAML: native Linux driver of the final project. Runs pretrainedResnet_quant
+ * with the software CFU on the samples listed in y_labels.csv, the same way
+ * eval_script.py does over UART, and reports accuracy and CFU cycles.
+ *
+ *   aaml_host [--profile] [--trace FILE [--trace-ops TAG,...]]
+ *             [samples_dir [labels_csv [max_samples]]]
+ *
+ * --trace writes the CFU op stream for TESTBENCH/tb_cfu.cpp (see
+ * Makefile_verilator), optionally only for the listed ops.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfu_profile.h"
+#include "perf.h"
+#include "software_cfu.h"
+#include "tflite.h"
+#include "tiny/v0.1/training/image_classification/trained_models/pretrainedResnet_quant.h"
+
+namespace {
+
+constexpr int kIcInputSize = 32 * 32 * 3;
+constexpr int kCategoryCount = 10;
+constexpr int kMaxBatch = 64;
+
+// Same conversion as th_buffer_write(), into image `index` of the input
+bool load_sample(const char* path, int index) {
+  uint8_t data[kIcInputSize];
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  size_t bytes = fread(data, 1, kIcInputSize, f);
+  fclose(f);
+  if (bytes != kIcInputSize) {
+    return false;
+  }
+  tflite_write_input_unsigned(index * kIcInputSize, data, kIcInputSize);
+  return true;
+}
+
+int arg_max(const int8_t* output) {
+  int best = 0;
+  for (int i = 1; i < kCategoryCount; ++i) {
+    if (output[i] > output[best]) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  bool profile = false;
+  const char* trace_path = nullptr;
+  const char* trace_ops = nullptr;
+  while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+    if (strcmp(argv[1], "--profile") == 0) {
+      profile = true;
+    } else if (strcmp(argv[1], "--trace") == 0 && argc > 2) {
+      trace_path = argv[2];
+      --argc;
+      ++argv;
+    } else if (strcmp(argv[1], "--trace-ops") == 0 && argc > 2) {
+      trace_ops = argv[2];
+      --argc;
+      ++argv;
+    } else {
+      printf("Unknown option %s\n", argv[1]);
+      return 1;
+    }
+    --argc;
+    ++argv;
+  }
+  const char* samples_dir = argc > 1 ? argv[1] : "perf_samples";
+  const char* labels_csv = argc > 2 ? argv[2] : "y_labels.csv";
+  const int max_samples = argc > 3 ? atoi(argv[3]) : 0;
+
+  FILE* labels = fopen(labels_csv, "r");
+  if (!labels) {
+    printf("Cannot open %s\n", labels_csv);
+    return 1;
+  }
+
+  tflite_load_model(pretrainedResnet_quant, pretrainedResnet_quant_len);
+  TfLiteTensor* input = tflite_get_input_tensor(0);
+  if (input->bytes % kIcInputSize != 0) {
+    printf("Input has %d bytes, expected a multiple of %d\n", static_cast<int>(input->bytes),
+           kIcInputSize);
+    return 1;
+  }
+  // Images per invoke (model_converter.py --batch)
+  const int batch = input->bytes / kIcInputSize;
+  if (batch > kMaxBatch) {
+    printf("Batch %d is larger than %d\n", batch, kMaxBatch);
+    return 1;
+  }
+  cfu_profile_reset();
+  if (trace_path && !software_cfu_trace_open(trace_path, trace_ops)) {
+    printf("Cannot open %s\n", trace_path);
+    return 1;
+  }
+
+  int samples = 0, correct = 0, invokes = 0;
+  uint64_t total_cycles = 0, total_ops = 0, total_ns = 0;
+  char line[256], names[kMaxBatch][200];
+  int output_len, ground_truth[kMaxBatch];
+  bool more = true;
+  while (more) {
+    // Fill the batch
+    int images = 0;
+    while (images < batch && (max_samples == 0 || samples + images < max_samples)) {
+      if (!fgets(line, sizeof(line), labels)) {
+        break;
+      }
+      if (sscanf(line, "%199[^,],%d,%d", names[images], &output_len, &ground_truth[images]) != 3) {
+        continue;
+      }
+      char path[512];
+      snprintf(path, sizeof(path), "%s/%s", samples_dir, names[images]);
+      if (!load_sample(path, images)) {
+        printf("Cannot read %s\n", path);
+        return 1;
+      }
+      ++images;
+    }
+    more = images == batch;
+    if (images == 0) {
+      break;
+    }
+
+    software_cfu_reset_stats();
+    uint64_t start = perf_get_mcycle64();
+    tflite_invoke();
+    uint64_t ns = perf_get_mcycle64() - start;
+
+    const int8_t* output = tflite_get_output();
+    for (int i = 0; i < images; ++i) {
+      int prediction = arg_max(output + i * kCategoryCount);
+      correct += prediction == ground_truth[i];
+      printf("%s,%d,%d,%llu\n", names[i], ground_truth[i], prediction,
+             static_cast<unsigned long long>(software_cfu_cycles() / images));
+    }
+    samples += images;
+    ++invokes;
+    total_cycles += software_cfu_cycles();
+    total_ops += software_cfu_ops();
+    total_ns += ns;
+  }
+  fclose(labels);
+  software_cfu_trace_close();
+
+  if (samples == 0) {
+    printf("No samples\n");
+    return 1;
+  }
+  printf("Samples: %d (batch %d, %d invokes)\n", samples, batch, invokes);
+  printf("Accuracy: %.3f\n", static_cast<double>(correct) / samples);
+  // Per image
+  printf("CFU cycles/inference: %llu\n", static_cast<unsigned long long>(total_cycles / samples));
+  printf("CFU ops/inference: %llu\n", static_cast<unsigned long long>(total_ops / samples));
+  printf("Host time/inference: %.3f ms\n", total_ns / 1e6 / samples);
+  if (profile) {
+    // Phases are in host nanoseconds (see host/src/perf.h)
+    cfu_profile_dump(false);
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host replacement of the common perf.h for the native build (see the "host"
+ * target in the project Makefile). mcycle counts nanoseconds of the host
+ * monotonic clock; the performance counters do nothing.
+ */
+#ifndef _PERF_H
+#define _PERF_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline uint64_t perf_get_mcycle64(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline unsigned perf_get_mcycle(void) {
+  return (unsigned)perf_get_mcycle64();
+}
+
+static inline void perf_set_mcycle(unsigned cycle) { (void)cycle; }
+
+static inline void perf_enable_counter(int counter_num) { (void)counter_num; }
+static inline void perf_disable_counter(int counter_num) { (void)counter_num; }
+static inline void perf_reset_all_counters(void) {}
+static inline void perf_print_all_counters(void) {}
+
+static inline void perf_print_value(uint64_t value) {
+  printf("%llu", (unsigned long long)value);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _PERF_H
@@ -3,18 +3,183 @@ import os
 import subprocess
 import re
 import argparse
+import tempfile
+
+def set_batch(tflite_path, batch, output_path):
+    """Rewrite the batch dimension of every activation tensor to `batch`.
+
+    Constant tensors keep their shape; RESHAPE ops get their new shape patched
+    too, so the flattening before the classifier keeps the batch.
+    """
+    import numpy as np
+    from tensorflow.lite.python import schema_py_generated as schema_fb
+    from tensorflow.lite.tools import flatbuffer_utils
+
+    model = flatbuffer_utils.read_model(tflite_path)
+    for subgraph in model.subgraphs:
+        for tensor in subgraph.tensors:
+            buffer = model.buffers[tensor.buffer]
+            is_constant = buffer.data is not None and len(buffer.data) > 0
+            if is_constant or tensor.shape is None or len(tensor.shape) == 0:
+                continue
+            if tensor.shape[0] == 1:
+                tensor.shape[0] = batch
+            if tensor.shapeSignature is not None and len(tensor.shapeSignature) > 0 \
+                    and tensor.shapeSignature[0] == 1:
+                tensor.shapeSignature[0] = batch
+        for op in subgraph.operators:
+            opcode = model.operatorCodes[op.opcodeIndex]
+            builtin = max(opcode.builtinCode, opcode.deprecatedBuiltinCode)
+            if builtin != schema_fb.BuiltinOperator.RESHAPE:
+                continue
+            options = op.builtinOptions
+            if options is not None and options.newShape is not None \
+                    and len(options.newShape) > 0 and options.newShape[0] == 1:
+                options.newShape[0] = batch
+            if len(op.inputs) > 1:
+                buffer = model.buffers[subgraph.tensors[op.inputs[1]].buffer]
+                if buffer.data is not None and len(buffer.data) >= 4:
+                    shape = np.frombuffer(bytes(buffer.data), dtype='<i4').copy()
+                    if shape[0] == 1:
+                        shape[0] = batch
+                        buffer.data = np.frombuffer(shape.tobytes(), dtype=np.uint8)
+    flatbuffer_utils.write_model(model, output_path)
+
+def fuse_graph(tflite_path, output_path):
+    """Fold op chains the kernels can do in one op, with builtin ops only.
+
+    - CONV_2D -> RELU / RELU6 / RELU_N1_TO_1: the clamp becomes the conv's
+      fused activation (same output quantization only).
+    - RESHAPE -> FULLY_CONNECTED: FC flattens its input itself, so the
+      reshape copy is dropped and FC reads the reshape input.
+
+    CONV_2D -> ADD is fused at model load (src/residual_fusion.cc). Removed
+    ops leave dead tensors, which are removed too so TFLM does not plan them.
+    """
+    import numpy as np
+    from tensorflow.lite.python import schema_py_generated as schema_fb
+    from tensorflow.lite.tools import flatbuffer_utils
+
+    op_type = schema_fb.BuiltinOperator
+    relu_act = {
+        op_type.RELU: schema_fb.ActivationFunctionType.RELU,
+        op_type.RELU6: schema_fb.ActivationFunctionType.RELU6,
+        op_type.RELU_N1_TO_1: schema_fb.ActivationFunctionType.RELU_N1_TO_1,
+    }
+
+    model = flatbuffer_utils.read_model(tflite_path)
+
+    def builtin(op):
+        opcode = model.operatorCodes[op.opcodeIndex]
+        return max(opcode.builtinCode, opcode.deprecatedBuiltinCode)
+
+    def same_quantization(a, b):
+        qa, qb = a.quantization, b.quantization
+        if qa is None or qb is None or qa.scale is None or qb.scale is None:
+            return False
+        return list(qa.scale) == list(qb.scale) and list(qa.zeroPoint) == list(qb.zeroPoint)
+
+    for subgraph in model.subgraphs:
+        def readers(tensor):
+            ops = [op for op in subgraph.operators if tensor in list(op.inputs)]
+            return ops, tensor in list(subgraph.outputs)
+
+        fused = {'relu': 0, 'reshape': 0}
+        for op in list(subgraph.operators):
+            code = builtin(op)
+            if code in relu_act:
+                # conv -> relu: the conv writes the relu output
+                src = op.inputs[0]
+                producers = [p for p in subgraph.operators if src in list(p.outputs)]
+                ops, is_output = readers(src)
+                if len(producers) != 1 or builtin(producers[0]) != op_type.CONV_2D or \
+                        len(ops) != 1 or is_output:
+                    continue
+                conv = producers[0]
+                options = conv.builtinOptions
+                if options.fusedActivationFunction != schema_fb.ActivationFunctionType.NONE or \
+                        not same_quantization(subgraph.tensors[src], subgraph.tensors[op.outputs[0]]):
+                    continue
+                options.fusedActivationFunction = relu_act[code]
+                conv.outputs[0] = op.outputs[0]
+                subgraph.operators.remove(op)
+                fused['relu'] += 1
+            elif code == op_type.RESHAPE:
+                # reshape -> fully connected: FC reads the reshape input
+                dst = op.outputs[0]
+                ops, is_output = readers(dst)
+                if is_output or not ops or any(
+                        builtin(r) != op_type.FULLY_CONNECTED or list(r.inputs).index(dst) != 0 or
+                        (r.builtinOptions is not None and r.builtinOptions.keepNumDims)
+                        for r in ops):
+                    continue
+                for r in ops:
+                    r.inputs[0] = op.inputs[0]
+                subgraph.operators.remove(op)
+                fused['reshape'] += 1
+
+        # drop the tensors no op or subgraph input/output uses any more
+        used = set(int(t) for t in subgraph.inputs) | set(int(t) for t in subgraph.outputs)
+        for op in subgraph.operators:
+            used |= set(int(t) for t in op.inputs if t >= 0)
+            used |= set(int(t) for t in op.outputs)
+        remap = {}
+        tensors = []
+        for old, tensor in enumerate(subgraph.tensors):
+            if old in used:
+                remap[old] = len(tensors)
+                tensors.append(tensor)
+        subgraph.tensors = tensors
+        renumber = lambda ids: np.array([remap[int(t)] if t >= 0 else -1 for t in ids], dtype=np.int32)
+        subgraph.inputs = renumber(subgraph.inputs)
+        subgraph.outputs = renumber(subgraph.outputs)
+        for op in subgraph.operators:
+            op.inputs = renumber(op.inputs)
+            op.outputs = renumber(op.outputs)
+        print(f"fuse_graph: {fused['relu']} conv+relu, {fused['reshape']} reshape removed, "
+              f"{len(subgraph.operators)} ops left")
+    flatbuffer_utils.write_model(model, output_path)
+
+# MLPerf Tiny workloads: (model directory, model name). The name is the
+# .tflite file, the C symbol and the .h/.cc under src/tiny/v0.1/training;
+# build with the matching INCLUDE_MODEL_MLCOMMONS_TINY_V01_* define.
+WORKLOADS = {
+    'ic': ('image_classification', 'pretrainedResnet_quant'),
+    'kws': ('keyword_spotting', 'kws_ref_model'),
+    'vww': ('visual_wake_words', 'vww_96_int8'),
+    'ad': ('anomaly_detection', 'ad01_int8'),
+}
 
 if __name__ == '__main__':
     parser = argparse.ArgumentParser()
-    parser.add_argument('model_path', nargs='?', default='./pretrainedResnet_quant.tflite')
+    parser.add_argument('model_path', nargs='?', default=None,
+                        help='Defaults to ./<model name>.tflite of the workload')
+    parser.add_argument('--workload', choices=sorted(WORKLOADS), default='ic',
+                        help='MLPerf Tiny workload the model is for')
+    parser.add_argument('--batch', type=int, default=1,
+                        help='Images per invoke; build with MLPERF_TINY_BATCH set to the same value')
+    parser.add_argument('--no-fuse', action='store_true',
+                        help='Keep the graph as is (no fuse_graph pass)')
     args = parser.parse_args()
-    tflite_path = str(args.model_path)
+    model_dir, model_name = WORKLOADS[args.workload]
+    tflite_path = str(args.model_path or f'./{model_name}.tflite')
+
+    if not args.no_fuse:
+        fused_path = os.path.join(tempfile.mkdtemp(), f'{model_name}_fused.tflite')
+        fuse_graph(tflite_path, fused_path)
+        tflite_path = fused_path
+
+    if args.batch > 1:
+        batch_path = os.path.join(tempfile.mkdtemp(), f'{model_name}_b{args.batch}.tflite')
+        set_batch(tflite_path, args.batch, batch_path)
+        tflite_path = batch_path
 
-    output_path = 'src/tiny/v0.1/training/image_classification/trained_models/pretrainedResnet_quant.cc'
+    model_header = f'tiny/v0.1/training/{model_dir}/trained_models/{model_name}.h'
+    output_path = f'src/{model_header[:-2]}.cc'
+    os.makedirs(os.path.dirname(output_path), exist_ok=True)
     xxd_ret = subprocess.check_output(f"xxd -i {tflite_path}".split(' ')).decode('UTF-8')
-    tflm_format = re.sub('unsigned char .*_tflite\\[\\] = {', 'const unsigned char pretrainedResnet_quant[] = {', xxd_ret)
-    tflm_format = re.sub('unsigned int .*_len', 'unsigned int pretrainedResnet_quant_len', tflm_format)
-    tflm_format = ( '#include "tiny/v0.1/training/image_classification/trained_models/pretrainedResnet_quant.h"\n'
-                   ) + tflm_format
+    tflm_format = re.sub('unsigned char .*_tflite\\[\\] = {', f'const unsigned char {model_name}[] = {{', xxd_ret)
+    tflm_format = re.sub('unsigned int .*_len', f'unsigned int {model_name}_len', tflm_format)
+    tflm_format = f'#include "{model_header}"\n' + tflm_format
     with open(output_path, 'w') as f:
         f.write(tflm_format)
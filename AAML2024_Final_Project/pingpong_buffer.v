@@ -0,0 +1,82 @@
+`include "global_buffer_bram.v"
+
+/*
+ * pingpong_buffer
+ *
+ * Two global_buffer_bram banks, one port each. The gemm unit owns bank
+ * gemm_bank while gemm_en is high, the host owns the other one (host_bank
+ * selects it), so the host can stage the next tile while the current one is
+ * computed.
+ *
+ * With HOST_LANE_BITS > 0 a word is split into 2**HOST_LANE_BITS host lanes,
+ * lane 0 in the MSB, and the host addresses {word, lane}.
+ *
+ */
+module pingpong_buffer #(
+    parameter ADDR_BITS = 10,
+    parameter DATA_BITS = 32,
+    parameter HOST_LANE_BITS = 0
+) (
+    input                                clk,
+    // Host port
+    input                                host_we,
+    input                                host_bank,
+    input  [ADDR_BITS+HOST_LANE_BITS-1:0] host_addr,
+    input  [(DATA_BITS>>HOST_LANE_BITS)-1:0] host_din,
+    output [(DATA_BITS>>HOST_LANE_BITS)-1:0] host_dout,
+    // Gemm port
+    input                                gemm_en,
+    input                                gemm_bank,
+    input                                gemm_we,
+    input  [ADDR_BITS-1:0]               gemm_addr,
+    input  [DATA_BITS-1:0]               gemm_din,
+    output [DATA_BITS-1:0]               gemm_dout
+);
+localparam HOST_LANES = 2**HOST_LANE_BITS;
+localparam HOST_BITS = DATA_BITS / HOST_LANES;
+
+wire [DATA_BITS-1:0] bank_dout[0:1];
+wire [ADDR_BITS-1:0] host_word;
+wire [DATA_BITS-1:0] host_word_din, host_word_dout;
+
+generate
+    genvar b;
+    for (b = 0; b < 2; b = b + 1) begin : bank
+        wire gemm_own = gemm_en & (gemm_bank == b);
+        global_buffer_bram #(
+            .ADDR_BITS(ADDR_BITS),
+            .DATA_BITS(DATA_BITS)
+        ) u_bram (
+            .clk     (clk),
+            .rst_n   (1'b1),
+            .ram_en  (1'b1),
+            .wr_en   (gemm_own ? gemm_we : host_we & (host_bank == b)),
+            .index   (gemm_own ? gemm_addr : host_word),
+            .data_in (gemm_own ? gemm_din : host_word_din),
+            .data_out(bank_dout[b])
+        );
+    end
+endgenerate
+
+assign host_word_dout = bank_dout[host_bank];
+assign gemm_dout = bank_dout[gemm_bank];
+
+// Host lanes (read-modify-write of the addressed lane)
+generate
+    if (HOST_LANE_BITS == 0) begin : whole_word
+        assign host_word = host_addr;
+        assign host_word_din = host_din;
+        assign host_dout = host_word_dout;
+    end else begin : lanes
+        wire [HOST_LANE_BITS-1:0] host_lane = host_addr[HOST_LANE_BITS-1:0];
+        genvar l;
+        assign host_word = host_addr[ADDR_BITS+HOST_LANE_BITS-1:HOST_LANE_BITS];
+        for (l = 0; l < HOST_LANES; l = l + 1) begin : lane
+            assign host_word_din[(HOST_LANES-l)*HOST_BITS-1 -: HOST_BITS] =
+                (host_lane == l) ? host_din : host_word_dout[(HOST_LANES-l)*HOST_BITS-1 -: HOST_BITS];
+        end
+        assign host_dout = host_word_dout >> ((HOST_LANES-1-host_lane)*HOST_BITS);
+    end
+endgenerate
+
+endmodule
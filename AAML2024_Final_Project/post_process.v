@@ -0,0 +1,136 @@
+/*
+ * post_process
+ *
+ * Requantization epilogue of the GEMM unit. Holds the per-channel bias,
+ * multiplier and shift of the current n_tile and turns one BUFF_C entry
+ * (4 int32 lanes) into 4 int8 outputs packed in one word, lane 0 in the LSB.
+ * The arithmetic is the same as the ADD_BIAS .. RAW_OUTPUT steps of
+ * cfuop_simd.
+ *
+ */
+`define QPARAM_BIAS   2'd0
+`define QPARAM_MULT   2'd1
+`define QPARAM_SHIFT  2'd2
+`define QPARAM_SCALAR 2'd3
+
+`define QSCALAR_OFFSET 0
+`define QSCALAR_MIN    1
+`define QSCALAR_MAX    2
+
+module post_process #(
+    parameter LANES = 4,
+    parameter CH_BITS = 6
+) (
+    input clk,
+    input rst_n,
+    // Parameter table
+    input                param_we,
+    input  [1:0]         param_sel,
+    input  [CH_BITS-1:0] param_idx,
+    input  [31:0]        param_data,
+    // Requantize
+    input                  start,
+    input                  ack,
+    input  [CH_BITS-1:0]   channel,
+    input  [LANES*32-1:0]  acc,
+    output                 busy,
+    output                 done,
+    output [LANES*8-1:0]   result
+);
+// clk      | _/-\_/-\_/-\_/-\_/-\_/-\_
+// start    | _/---\___________________
+// stage    |  | 0 | 1 | 2 | 3 | 4 | 0
+// done     | _________________/---\___
+
+// ==========
+//  WIRE & REG
+// ==========
+reg signed [31:0] bias_tab[0:2**CH_BITS-1];
+reg signed [31:0] mult_tab[0:2**CH_BITS-1];
+reg signed [7:0]  shift_tab[0:2**CH_BITS-1];
+reg signed [31:0] output_offset, output_min, output_max;
+reg [2:0] stage;
+
+// ==========
+//  DESIGN
+// ==========
+// Parameter table
+always @(posedge clk) begin
+    if (param_we) begin
+        case (param_sel)
+            `QPARAM_BIAS:  bias_tab[param_idx] <= param_data;
+            `QPARAM_MULT:  mult_tab[param_idx] <= param_data;
+            `QPARAM_SHIFT: shift_tab[param_idx] <= param_data[7:0];
+        endcase
+    end
+end
+always @(posedge clk or negedge rst_n) begin
+    if (~rst_n) begin
+        output_offset <= 'd0;
+        output_min <= -32'sd128;
+        output_max <= 32'sd127;
+    end else if (param_we & (param_sel == `QPARAM_SCALAR)) begin
+        case (param_idx[1:0])
+            `QSCALAR_OFFSET: output_offset <= param_data;
+            `QSCALAR_MIN:    output_min <= param_data;
+            `QSCALAR_MAX:    output_max <= param_data;
+        endcase
+    end
+end
+
+// Stage counter
+always @(posedge clk or negedge rst_n) begin
+    if (~rst_n) begin
+        stage <= 'd0;
+    end else begin
+        case (stage)
+            'd0: stage <= start ? 'd1 : 'd0;
+            'd4: stage <= ack ? 'd0 : 'd4;
+            default: stage <= stage + 1'b1;
+        endcase
+    end
+end
+assign busy = stage != 'd0;
+assign done = stage == 'd4;
+
+// Lanes
+generate
+    genvar l;
+    for (l = 0; l < LANES; l = l + 1) begin : lane
+        wire [CH_BITS-1:0] ch;
+        reg signed [31:0] total_sum, multiplier;
+        reg signed [7:0]  shift;
+        reg signed [63:0] raw_output_without_shift;
+        reg signed [31:0] raw_output_without_offset;
+        wire signed [31:0] raw_output, clamped_output_min, clamped_output_max;
+
+        assign ch = channel + l;
+        always @(posedge clk) begin
+            case (stage)
+                // ADD_BIAS
+                'd0: begin
+                    total_sum <= $signed(acc[(LANES-l)*32-1 -: 32]) + bias_tab[ch];
+                    multiplier <= mult_tab[ch];
+                    shift <= shift_tab[ch];
+                end
+                // WITHOUT_SHIFT
+                'd1: raw_output_without_shift <= total_sum * multiplier +
+                                                 ($signed(64'd1) << ($signed(32'd30) - shift));
+                // WITHOUT_OFFSET
+                'd2: raw_output_without_offset <= raw_output_without_shift >>> ($signed(32'd31) - shift);
+            endcase
+        end
+        // RAW_OUTPUT
+        assign raw_output = raw_output_without_offset + output_offset;
+        assign clamped_output_min = (raw_output > output_min) ? raw_output : output_min;
+        assign clamped_output_max = (clamped_output_min < output_max) ? clamped_output_min : output_max;
+
+        reg [7:0] q;
+        always @(posedge clk) begin
+            if (stage == 'd3) q <= clamped_output_max[7:0];
+        end
+        assign result[l*8 +: 8] = q;
+    end
+endgenerate
+
+endmodule
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host driver of the cfuop_act activation unit, shared by the elementwise
+ * kernels that run on it (logistic.h, tanh.h, hard_swish.h).
+ *
+ * 8-bit inputs have 256 values, so an 8-bit activation is a 256-byte table,
+ * built by running the reference kernel once on every input value. The
+ * tables of the last few parameter sets are cached, and the CFU holds one
+ * of them at a time. int16 logistic and tanh interpolate the sigmoid table
+ * of the reference kernels in the CFU instead.
+ */
+#ifndef _ACT_CFU_H
+#define _ACT_CFU_H
+
+#include <algorithm>
+#include <cstring>
+
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "cfu.h"
+
+#ifndef __cplusplus
+#error "act_cfu.h is for C++ only"
+#endif
+
+#define FUNC7_ACT_WRITE_TABLE  0
+#define FUNC7_ACT_LOOKUP4      1
+#define FUNC7_ACT_SET_INT16    2
+#define FUNC7_ACT_EVAL2        3
+
+// Words of the CFU table: 256 bytes or 256 halfwords
+#define ACT_TABLE_WORDS        128
+// Set rs2 bit of FUNC7_ACT_SET_INT16 for tanh
+#define ACT_INT16_TANH         (1 << 8)
+// Cached 8-bit tables
+#define ACT_LUT_SLOTS          4
+// Table id of the int16 sigmoid table
+#define ACT_TABLE_SIGMOID16    ACT_LUT_SLOTS
+
+namespace tflite {
+
+// An 8-bit activation and its quantization parameters
+struct ActLutKey {
+  int32_t kind;
+  int32_t params[6];
+};
+
+enum ActLutKind {
+  kActLutLogistic = 1,
+  kActLutTanh,
+  kActLutHardSwishInt8,
+  kActLutHardSwishUint8,
+};
+
+struct ActLutSlot {
+  ActLutKey key;
+  bool valid;
+  alignas(4) uint8_t table[256];
+};
+
+// Table now in the CFU: a slot, ACT_TABLE_SIGMOID16 or -1
+inline int& ActLoadedTable() {
+  static int table = -1;
+  return table;
+}
+
+// Slot of key; a miss takes the least recently built slot and clears it
+inline int ActLutFind(const ActLutKey& key, ActLutSlot** slot) {
+  static ActLutSlot slots[ACT_LUT_SLOTS];
+  static int victim = 0;
+  for (int i = 0; i < ACT_LUT_SLOTS; ++i) {
+    if (slots[i].valid && memcmp(&slots[i].key, &key, sizeof(key)) == 0) {
+      *slot = &slots[i];
+      return i;
+    }
+  }
+  const int i = victim;
+  victim = (victim + 1) % ACT_LUT_SLOTS;
+  if (ActLoadedTable() == i) {
+    ActLoadedTable() = -1;
+  }
+  slots[i].key = key;
+  slots[i].valid = false;
+  *slot = &slots[i];
+  return i;
+}
+
+inline void ActLoadTable(const uint8_t* table, int id) {
+  if (ActLoadedTable() == id) {
+    return;
+  }
+  for (int i = 0; i < ACT_TABLE_WORDS; ++i) {
+    uint32_t word;
+    memcpy(&word, table + 4 * i, 4);
+    cfu_op4(FUNC7_ACT_WRITE_TABLE, i, word);
+  }
+  ActLoadedTable() = id;
+}
+
+// 8-bit activation on the CFU. reference(in, n, out) is the scalar kernel
+// of T; the table entry of byte b is at b ^ 0x80, as the CFU looks it up.
+template <typename T, typename Reference>
+inline void ActLutRun(const ActLutKey& key, Reference reference, int size,
+                      const T* input_data, T* output_data) {
+  static_assert(sizeof(T) == 1, "8-bit activations only");
+  ActLutSlot* slot;
+  const int id = ActLutFind(key, &slot);
+  if (!slot->valid) {
+    alignas(4) uint8_t inputs[256];
+    for (int i = 0; i < 256; ++i) {
+      inputs[i] = static_cast<uint8_t>(i ^ 0x80);
+    }
+    reference(reinterpret_cast<const T*>(inputs), 256,
+              reinterpret_cast<T*>(slot->table));
+    slot->valid = true;
+  }
+  ActLoadTable(slot->table, id);
+
+  for (int i = 0; i < size; i += 4) {
+    const int lanes = std::min(4, size - i);
+    uint32_t word = 0;
+    memcpy(&word, input_data + i, lanes);
+    word = cfu_op4(FUNC7_ACT_LOOKUP4, word, 0);
+    memcpy(output_data + i, &word, lanes);
+  }
+}
+
+// int16 logistic or tanh of reference_integer_ops on the CFU, 2 lanes per op.
+// input_multiplier and input_left_shift as the reference kernel uses them.
+inline void ActInt16Run(bool tanh, int32_t input_multiplier,
+                        int32_t input_left_shift, int size,
+                        const int16_t* input_data, int16_t* output_data) {
+  ActLoadTable(reinterpret_cast<const uint8_t*>(sigmoid_table_uint16),
+               ACT_TABLE_SIGMOID16);
+  cfu_op4(FUNC7_ACT_SET_INT16, input_multiplier,
+          input_left_shift | (tanh ? ACT_INT16_TANH : 0));
+  for (int i = 0; i < size; i += 2) {
+    const int lanes = std::min(2, size - i);
+    uint32_t word = 0;
+    memcpy(&word, input_data + i, lanes * sizeof(int16_t));
+    word = cfu_op4(FUNC7_ACT_EVAL2, word, 0);
+    memcpy(output_data + i, &word, lanes * sizeof(int16_t));
+  }
+}
+
+}  // namespace tflite
+
+#endif  // _ACT_CFU_H
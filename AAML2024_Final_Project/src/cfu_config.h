@@ -0,0 +1,20 @@
+/*
+ * Generated by gen_cfu_config.py from cfu_config.vh. Do not edit.
+ */
+#ifndef _CFU_CONFIG_H
+#define _CFU_CONFIG_H
+
+#define CFU_SA_SIZE          4
+#define CFU_BUFF_ADDR_BITS   10
+#define CFU_DIM_BITS         8
+#define CFU_QPARAM_CH_BITS   6
+#define CFU_BANK_BIT         16
+#define CFU_FOLD_INPUT_OFFSET 0
+
+// Derived
+#define CFU_GEMM_LANE_WORDS  (CFU_SA_SIZE / 4)
+#define CFU_GEMM_BANK_WORDS  (1 << CFU_BUFF_ADDR_BITS)
+#define CFU_GEMM_MAX_DIM     ((1 << CFU_DIM_BITS) - 1)
+#define CFU_GEMM_MAX_N_TILE  (1 << CFU_QPARAM_CH_BITS)
+
+#endif  // _CFU_CONFIG_H
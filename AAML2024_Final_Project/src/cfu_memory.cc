@@ -0,0 +1,203 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef  SKIP_TFLM
+
+#include "cfu_memory.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "cfu_config.h"
+#include "cfu_profile.h"
+#include "cfu_scratch.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+namespace {
+
+#define STACK_PAINT_WORDS (CFU_MEMORY_STACK_PAINT_BYTES / 4)
+// Room for the frame of cfu_memory_begin_op() itself
+#define STACK_PAINT_SKIP_WORDS 32
+const uint32_t kStackPaint = 0x5A5A5A5Au;
+
+struct OpMemory {
+  size_t arena_live;
+  size_t scratch;
+  size_t stack;
+  int buff_a;
+  int buff_b;
+  int buff_c;
+};
+
+OpMemory ops[CFU_PROFILE_MAX_OPS];
+int num_planned_ops = 0;
+bool enabled = false;
+uint32_t* stack_top = nullptr;
+
+OpMemory* current(void) {
+  const int op = cfu_profile_current_op();
+  return enabled && op >= 0 ? &ops[op] : nullptr;
+}
+
+size_t type_bytes(tflite::TensorType type) {
+  switch (type) {
+    case tflite::TensorType_INT8:
+    case tflite::TensorType_UINT8:
+    case tflite::TensorType_BOOL:
+      return 1;
+    case tflite::TensorType_INT16:
+      return 2;
+    case tflite::TensorType_INT64:
+    case tflite::TensorType_FLOAT64:
+      return 8;
+    default:
+      return 4;
+  }
+}
+
+void note_max(int* dst, int value) {
+  if (value > *dst) {
+    *dst = value;
+  }
+}
+
+}  // anonymous namespace
+
+void cfu_memory_plan_model(const tflite::Model* model) {
+  memset(ops, 0, sizeof(ops));
+
+  // Only the main subgraph is invoked
+  const tflite::SubGraph* subgraph = model->subgraphs()->Get(0);
+  const auto* tensors = subgraph->tensors();
+  const auto* operators = subgraph->operators();
+  num_planned_ops = std::min<int>(operators->size(), CFU_PROFILE_MAX_OPS);
+  const int last_op = static_cast<int>(operators->size()) - 1;
+
+  for (size_t t = 0; t < tensors->size(); ++t) {
+    const tflite::Tensor* tensor = tensors->Get(t);
+    const tflite::Buffer* buffer = model->buffers()->Get(tensor->buffer());
+    if ((buffer->data() && buffer->data()->size()) || tensor->is_variable() ||
+        tensor->shape() == nullptr) {
+      continue;  // not in the planned part of the arena
+    }
+    // First op writing it to last op reading it; inputs and outputs of the
+    // subgraph are live for the whole invoke
+    int first = -1, last = -1;
+    for (const int32_t input : *subgraph->inputs()) {
+      if (input == static_cast<int32_t>(t)) first = 0;
+    }
+    for (const int32_t output : *subgraph->outputs()) {
+      if (output == static_cast<int32_t>(t)) last = last_op;
+    }
+    for (int i = 0; i <= last_op; ++i) {
+      const tflite::Operator* op = operators->Get(i);
+      for (const int32_t output : *op->outputs()) {
+        if (output == static_cast<int32_t>(t) && first < 0) first = i;
+      }
+      for (const int32_t input : *op->inputs()) {
+        if (input == static_cast<int32_t>(t)) last = std::max(last, i);
+      }
+    }
+    if (first < 0 || last < 0) {
+      continue;
+    }
+    size_t bytes = type_bytes(tensor->type());
+    for (const int32_t dim : *tensor->shape()) {
+      bytes *= dim;
+    }
+    for (int i = first; i <= last && i < num_planned_ops; ++i) {
+      ops[i].arena_live += bytes;
+    }
+  }
+}
+
+void cfu_memory_enable(bool enable) { enabled = enable; }
+
+void cfu_memory_reset(void) {
+  for (int i = 0; i < CFU_PROFILE_MAX_OPS; ++i) {
+    ops[i].scratch = 0;
+    ops[i].stack = 0;
+    ops[i].buff_a = ops[i].buff_b = ops[i].buff_c = 0;
+  }
+}
+
+void cfu_memory_begin_op(void) {
+  if (!current()) {
+    stack_top = nullptr;
+    return;
+  }
+  volatile uint32_t marker = 0;
+  stack_top = const_cast<uint32_t*>(&marker) - STACK_PAINT_SKIP_WORDS;
+  for (int i = 1; i <= STACK_PAINT_WORDS; ++i) {
+    stack_top[-i] = kStackPaint;
+  }
+}
+
+void cfu_memory_end_op(void) {
+  OpMemory* op = current();
+  if (!op || !stack_top) {
+    return;
+  }
+  // Deepest word that lost its paint
+  int depth = STACK_PAINT_WORDS;
+  while (depth > 0 && stack_top[-depth] == kStackPaint) {
+    --depth;
+  }
+  op->stack = std::max(op->stack, static_cast<size_t>(depth) * 4);
+  stack_top = nullptr;
+}
+
+void cfu_memory_note_scratch(size_t bytes) {
+  if (OpMemory* op = current()) {
+    op->scratch = std::max(op->scratch, bytes);
+  }
+}
+
+void cfu_memory_note_buffers(int a_words, int b_words, int c_words) {
+  if (OpMemory* op = current()) {
+    note_max(&op->buff_a, a_words);
+    note_max(&op->buff_b, b_words);
+    note_max(&op->buff_c, c_words);
+  }
+}
+
+void cfu_memory_dump(size_t arena_used_bytes) {
+  printf("Arena used %lu bytes, kernel scratch pool %lu bytes, "
+         "cfuop_sa bank %d words\n",
+         static_cast<unsigned long>(arena_used_bytes),
+         static_cast<unsigned long>(cfu_scratch_pool_bytes()),
+         CFU_GEMM_BANK_WORDS);
+  printf("%3s %-20s %10s %8s %8s %6s %6s %6s\n", "op", "tag", "arena_live",
+         "scratch", "stack", "buff_a", "buff_b", "buff_c");
+  size_t peak = 0;
+  for (int i = 0; i < num_planned_ops; ++i) {
+    const OpMemory& op = ops[i];
+    const char* tag = i < CFU_PROFILE_MAX_OPS ? cfu_profile_tag(i) : nullptr;
+    printf("%3d %-20s %10lu %8lu %8lu %6d %6d %6d\n", i, tag ? tag : "",
+           static_cast<unsigned long>(op.arena_live),
+           static_cast<unsigned long>(op.scratch),
+           static_cast<unsigned long>(op.stack), op.buff_a, op.buff_b,
+           op.buff_c);
+    peak = std::max(peak, op.arena_live + op.scratch);
+  }
+  printf("Peak live arena + scratch: %lu bytes\n",
+         static_cast<unsigned long>(peak));
+}
+
+#endif // SKIP_TFLM
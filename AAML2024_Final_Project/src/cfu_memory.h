@@ -0,0 +1,64 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per-op memory report of the TfLM flow: arena bytes live during the op,
+ * kernel scratch (cfu_scratch.h), stack high-water mark and the cfuop_sa
+ * buffer words used per bank.
+ *
+ * Live arena bytes come from the tensor lifetimes of the graph, computed at
+ * model load. The rest is recorded while enabled, on the op indices of
+ * cfu_profile.h: the interpreter profiler (tflite.cc) paints the stack
+ * below its hook before each op and scans it after, and the kernels note
+ * their scratch and GEMM tiles. Painting costs time, so it is off unless a
+ * report is being taken.
+ */
+#ifndef _CFU_MEMORY_H
+#define _CFU_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef __cplusplus
+#error "cfu_memory.h is for C++ only"
+#endif
+
+// Stack painted below the profiler hook per op; deeper use reads as full
+#define CFU_MEMORY_STACK_PAINT_BYTES (8 * 1024)
+
+namespace tflite {
+struct Model;
+}
+
+// Model preparation: live arena bytes per op from the tensor lifetimes.
+// Called once from tflite_load_model().
+void cfu_memory_plan_model(const tflite::Model* model);
+
+void cfu_memory_enable(bool enable);
+void cfu_memory_reset(void);
+
+// Profiler hooks, after cfu_profile_begin_op() / before cfu_profile_end_op()
+void cfu_memory_begin_op(void);
+void cfu_memory_end_op(void);
+
+// Kernel notes for the running op
+void cfu_memory_note_scratch(size_t bytes);
+void cfu_memory_note_buffers(int a_words, int b_words, int c_words);
+
+// Print the per-op table; arena_used_bytes is the interpreter's total
+void cfu_memory_dump(size_t arena_used_bytes);
+
+#endif  // _CFU_MEMORY_H
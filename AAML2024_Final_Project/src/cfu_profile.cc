@@ -0,0 +1,137 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cfu_profile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const char* const kPhaseNames[CFU_PROFILE_NUM_PHASES] = {
+    "im2col", "weight_pack", "load_a", "load_b", "compute", "readback", "post",
+};
+
+struct OpRecord {
+  const char* tag;
+  uint32_t count;
+  uint64_t cycles;
+  uint64_t phase_cycles[CFU_PROFILE_NUM_PHASES];
+};
+
+OpRecord records[CFU_PROFILE_MAX_OPS];
+int num_records = 0;  // ops seen in any invoke
+int next_op = 0;      // index of the next op of this invoke
+int current_op = -1;  // running op, or -1
+uint64_t op_start = 0;
+uint32_t num_invokes = 0;
+
+// Average per invoke of the op
+unsigned long per_invoke(const OpRecord& r, uint64_t cycles) {
+  return r.count ? static_cast<unsigned long>(cycles / r.count) : 0;
+}
+
+}  // anonymous namespace
+
+void cfu_profile_reset(void) {
+  memset(records, 0, sizeof(records));
+  num_records = 0;
+  next_op = 0;
+  current_op = -1;
+  num_invokes = 0;
+}
+
+void cfu_profile_begin_invoke(void) {
+  next_op = 0;
+  current_op = -1;
+  ++num_invokes;
+}
+
+void cfu_profile_begin_op(const char* tag) {
+  if (next_op == CFU_PROFILE_MAX_OPS) {
+    current_op = -1;
+    return;
+  }
+  current_op = next_op++;
+  records[current_op].tag = tag;
+  if (current_op >= num_records) {
+    num_records = current_op + 1;
+  }
+  op_start = perf_get_mcycle64();
+}
+
+void cfu_profile_end_op(void) {
+  if (current_op < 0) {
+    return;
+  }
+  OpRecord& r = records[current_op];
+  r.cycles += perf_get_mcycle64() - op_start;
+  ++r.count;
+  current_op = -1;
+}
+
+void cfu_profile_add(int phase, uint32_t cycles) {
+  if (current_op >= 0) {
+    records[current_op].phase_cycles[phase] += cycles;
+  }
+}
+
+int cfu_profile_current_op(void) { return current_op; }
+
+const char* cfu_profile_current_tag(void) {
+  return current_op >= 0 ? records[current_op].tag : nullptr;
+}
+
+const char* cfu_profile_tag(int op) {
+  return op >= 0 && op < num_records ? records[op].tag : nullptr;
+}
+
+void cfu_profile_dump(bool json) {
+  if (json) {
+    printf("{\"invokes\": %lu, \"ops\": [\n", static_cast<unsigned long>(num_invokes));
+  } else {
+    printf("op,tag,cycles");
+    for (int p = 0; p < CFU_PROFILE_NUM_PHASES; ++p) {
+      printf(",%s", kPhaseNames[p]);
+    }
+    printf(",other\n");
+  }
+  for (int i = 0; i < num_records; ++i) {
+    const OpRecord& r = records[i];
+    const char* tag = r.tag ? r.tag : "";
+    uint64_t phases = 0;
+    for (int p = 0; p < CFU_PROFILE_NUM_PHASES; ++p) {
+      phases += r.phase_cycles[p];
+    }
+    const uint64_t other = r.cycles > phases ? r.cycles - phases : 0;
+    if (json) {
+      printf("  {\"op\": %d, \"tag\": \"%s\", \"cycles\": %lu", i, tag, per_invoke(r, r.cycles));
+      for (int p = 0; p < CFU_PROFILE_NUM_PHASES; ++p) {
+        printf(", \"%s\": %lu", kPhaseNames[p], per_invoke(r, r.phase_cycles[p]));
+      }
+      printf(", \"other\": %lu}%s\n", per_invoke(r, other), i + 1 < num_records ? "," : "");
+    } else {
+      printf("%d,%s,%lu", i, tag, per_invoke(r, r.cycles));
+      for (int p = 0; p < CFU_PROFILE_NUM_PHASES; ++p) {
+        printf(",%lu", per_invoke(r, r.phase_cycles[p]));
+      }
+      printf(",%lu\n", per_invoke(r, other));
+    }
+  }
+  if (json) {
+    printf("]}\n");
+  }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per-op cycle profile of the TfLM flow, with a per-phase breakdown of the
+ * CFU kernels.
+ *
+ * Ops are recorded by the interpreter profiler (tflite.cc) in invoke order
+ * and accumulated over invokes until cfu_profile_reset(). Kernels time their
+ * phases with CFU_PROFILE_BEGIN / CFU_PROFILE_END, charged to the running op.
+ * NPROFILE compiles the phase timing out.
+ */
+#ifndef _CFU_PROFILE_H
+#define _CFU_PROFILE_H
+
+#include <stdint.h>
+
+#include "perf.h"
+
+enum CfuProfilePhase {
+  CFU_PROFILE_IM2COL,       // explicit im2col of the input
+  CFU_PROFILE_WEIGHT_PACK,  // runtime packing of filters
+  CFU_PROFILE_LOAD_A,       // BUFF_A writes (implicit im2col included)
+  CFU_PROFILE_LOAD_B,       // BUFF_B writes
+  CFU_PROFILE_COMPUTE,      // waiting for the GEMM unit
+  CFU_PROFILE_READBACK,     // BUFF_C reads (fused requantization included)
+  CFU_PROFILE_POST,         // requantization on the CPU / cfuop_simd
+  CFU_PROFILE_NUM_PHASES,
+};
+
+#define CFU_PROFILE_MAX_OPS 64
+
+void cfu_profile_reset(void);
+void cfu_profile_begin_invoke(void);
+void cfu_profile_begin_op(const char* tag);
+void cfu_profile_end_op(void);
+void cfu_profile_add(int phase, uint32_t cycles);
+
+// Index (in the invoke) and tag of the running op, or -1 / nullptr
+int cfu_profile_current_op(void);
+const char* cfu_profile_current_tag(void);
+// Tag of op i of the invoke, or nullptr if it has not run
+const char* cfu_profile_tag(int op);
+
+// Print cycles per invoke of every op, as CSV or JSON
+void cfu_profile_dump(bool json);
+
+#ifdef NPROFILE
+#define CFU_PROFILE_BEGIN(var)
+#define CFU_PROFILE_END(phase, var)
+#else
+#define CFU_PROFILE_BEGIN(var) const uint32_t var = perf_get_mcycle()
+#define CFU_PROFILE_END(phase, var) cfu_profile_add((phase), perf_get_mcycle() - (var))
+#endif
+
+#endif  // _CFU_PROFILE_H
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef  SKIP_TFLM
+
+#include "cfu_scratch.h"
+
+#include <stdio.h>
+
+#include "cfu_config.h"
+#include "cfu_memory.h"
+#include "gemm_weight_pack.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+namespace {
+
+uint8_t* pool = nullptr;
+size_t pool_bytes = 0;
+
+bool is_4d(const tflite::Tensor* tensor) {
+  return tensor->shape() != nullptr && tensor->shape()->size() == 4;
+}
+
+}  // anonymous namespace
+
+size_t cfu_scratch_plan_model(const tflite::Model* model, uint8_t* arena,
+                              size_t arena_bytes) {
+  pool = nullptr;
+  pool_bytes = 0;
+
+  size_t need = 0;
+  for (const tflite::SubGraph* subgraph : *model->subgraphs()) {
+    const auto* tensors = subgraph->tensors();
+    for (const tflite::Operator* op : *subgraph->operators()) {
+      const tflite::BuiltinOperator code =
+          tflite::GetBuiltinCode(model->operator_codes()->Get(op->opcode_index()));
+      if (CFU_FOLD_INPUT_OFFSET && op->inputs()->size() >= 2 &&
+          (code == tflite::BuiltinOperator_FULLY_CONNECTED ||
+           code == tflite::BuiltinOperator_DEPTHWISE_CONV_2D) &&
+          !gemm_weight_pack_find_op_bias(model, subgraph, op)) {
+        // The bias is folded by the kernel, one int32 per output channel
+        const tflite::Tensor* filter = tensors->Get(op->inputs()->Get(1));
+        if (filter->shape() != nullptr && filter->shape()->size() > 0) {
+          const int channels = code == tflite::BuiltinOperator_FULLY_CONNECTED
+                                   ? filter->shape()->Get(0)
+                                   : filter->shape()->Get(filter->shape()->size() - 1);
+          const size_t bytes = cfu_scratch_round_up(channels * sizeof(int32_t));
+          if (bytes > need) {
+            need = bytes;
+          }
+        }
+        continue;
+      }
+      if (code != tflite::BuiltinOperator_CONV_2D ||
+          op->inputs()->size() < 2 || op->outputs()->size() != 1) {
+        continue;
+      }
+      const tflite::Tensor* input = tensors->Get(op->inputs()->Get(0));
+      const tflite::Tensor* filter = tensors->Get(op->inputs()->Get(1));
+      const tflite::Tensor* output = tensors->Get(op->outputs()->Get(0));
+      if (filter->type() != tflite::TensorType_INT8 || !is_4d(input) ||
+          !is_4d(filter) || !is_4d(output)) {
+        continue;
+      }
+      const tflite::Buffer* buffer = model->buffers()->Get(filter->buffer());
+      const bool packed = buffer->data() != nullptr &&
+          gemm_weight_pack_find(reinterpret_cast<const int8_t*>(buffer->data()->data()));
+
+      // GEMM view of the conv, as in ConvPerChannel
+      const int m = output->shape()->Get(0) * output->shape()->Get(1) * output->shape()->Get(2);
+      const int n = filter->shape()->Get(0);
+      const int k = filter->shape()->Get(1) * filter->shape()->Get(2) * filter->shape()->Get(3);
+      const bool folded = gemm_weight_pack_find_op_bias(model, subgraph, op) != nullptr;
+      const size_t bytes =
+          tflite::reference_integer_ops::ConvScratchBytes(m, n, k, packed, folded);
+      if (bytes > need) {
+        need = bytes;
+      }
+    }
+  }
+
+  need = cfu_scratch_round_up(need);
+  if (need >= arena_bytes) {
+    printf("cfu_scratch: kernels need %d bytes, the arena has %d\n",
+           static_cast<int>(need), static_cast<int>(arena_bytes));
+    return 0;
+  }
+  pool_bytes = need;
+  pool = need ? arena + (arena_bytes - need) : nullptr;
+  printf("Kernel scratch: %d bytes at the end of the arena\n",
+         static_cast<int>(need));
+  return arena_bytes - need;
+}
+
+void* cfu_scratch_get(size_t bytes) {
+  cfu_memory_note_scratch(bytes);
+  if (bytes > pool_bytes) {
+    printf("cfu_scratch: %d bytes requested, the pool has %d\n",
+           static_cast<int>(bytes), static_cast<int>(pool_bytes));
+    return nullptr;
+  }
+  return pool;
+}
+
+size_t cfu_scratch_pool_bytes(void) { return pool_bytes; }
+
+#endif // SKIP_TFLM
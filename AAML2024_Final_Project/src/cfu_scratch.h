@@ -0,0 +1,62 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scratch memory of the accelerated kernels.
+ *
+ * The kernels do not keep worst-case buffers on the stack. At model load
+ * every op's scratch need is computed from the graph, and one pool sized
+ * for the largest is taken off the end of the tensor arena. The arena left
+ * over goes to the interpreter. Kernels run one at a time, so they all
+ * share the pool, and the total RAM stays within kTensorArenaSize.
+ */
+#ifndef _CFU_SCRATCH_H
+#define _CFU_SCRATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef __cplusplus
+#error "cfu_scratch.h is for C++ only"
+#endif
+
+// Pool alignment, and the granule of every kernel's scratch
+#define CFU_SCRATCH_ALIGN 16
+
+namespace tflite {
+struct Model;
+}
+
+inline size_t cfu_scratch_round_up(size_t bytes) {
+  return (bytes + CFU_SCRATCH_ALIGN - 1) & ~static_cast<size_t>(CFU_SCRATCH_ALIGN - 1);
+}
+
+// Model preparation: size the pool for the ops of the model and place it at
+// the end of arena. Returns the arena bytes left for the interpreter, or 0
+// if the pool does not fit.
+// Called once from tflite_load_model(), after gemm_weight_pack_model().
+size_t cfu_scratch_plan_model(const tflite::Model* model, uint8_t* arena,
+                              size_t arena_bytes);
+
+// Scratch of at least bytes for the running kernel, or nullptr if the
+// pool planned at load is smaller. The kernel must then still produce its
+// output, on its scalar reference path.
+void* cfu_scratch_get(size_t bytes);
+
+// Size of the pool planned at load
+size_t cfu_scratch_pool_bytes(void);
+
+#endif  // _CFU_SCRATCH_H
@@ -0,0 +1,565 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host driver of the cfuop_sa GEMM unit, shared by the kernels that run on
+ * it (conv.h, fully_connected.h): op encodings, tile planner and the tiled,
+ * double-buffered int8 GEMM with requantization (and optionally a residual
+ * add) on readback.
+ */
+#ifndef _GEMM_CFU_H
+#define _GEMM_CFU_H
+
+#include <algorithm>
+#include <cstring>
+
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+#include "cfu.h"
+#include "cfu_config.h"
+#include "cfu_memory.h"
+#include "cfu_profile.h"
+
+#ifndef __cplusplus
+#error "gemm_cfu.h is for C++ only"
+#endif
+
+// Tile planner cost model
+#define GEMM_PLAN_SPLITS        4    // candidate splits per dimension
+#define GEMM_PLAN_WORD_CYCLES   8    // host cycles per CFU word
+#define GEMM_PLAN_TILE_CYCLES   100  // host cycles per tile (config, loops)
+
+#define FUNC7_GEMM_WRITE_CONFIG 0x40
+#define FUNC7_GEMM_READ_CONFIG  0x00
+#define FUNC7_GEMM_WRITE_BUFF_A 0x50
+#define FUNC7_GEMM_READ_BUFF_A  0x10
+#define FUNC7_GEMM_WRITE_BUFF_B 0x60
+#define FUNC7_GEMM_READ_BUFF_B  0x20
+#define FUNC7_GEMM_WRITE_BUFF_C 0x70
+#define FUNC7_GEMM_READ_BUFF_C  0x30
+#define FUNC7_GEMM_COMPUTE      0x01
+#define FUNC7_GEMM_COMPUTE_ASYNC 0x03
+#define FUNC7_GEMM_WRITE_QPARAM 0x42
+#define FUNC7_GEMM_READ_BUFF_C_Q 0x32
+
+// Config flags (offset 4)
+#define GEMM_FLAG_ACCUMULATE    0x1
+#define GEMM_FLAG_BANK_A        0x2
+#define GEMM_FLAG_BANK_B        0x4
+#define GEMM_FLAG_BANK_C        0x8
+
+// Status (config offset 5, read only)
+#define GEMM_STATUS_BUSY        0x1
+
+// Host address of a buffer bank
+#define GEMM_BANK_ADDR(bank)    ((bank) << CFU_BANK_BIT)
+
+// Requantization tables (WRITE_QPARAM address = table << 8 | channel)
+#define GEMM_QPARAM_BIAS        (0 << 8)
+#define GEMM_QPARAM_MULT        (1 << 8)
+#define GEMM_QPARAM_SHIFT       (2 << 8)
+#define GEMM_QPARAM_SCALAR      (3 << 8)
+#define GEMM_QSCALAR_OFFSET     0
+#define GEMM_QSCALAR_MIN        1
+#define GEMM_QSCALAR_MAX        2
+
+// cfuop_add ADD4 (FUNC7_ADD_ADD4 in add.h), for the residual epilogue
+#define GEMM_FUNC7_ADD_ADD4     2
+
+namespace tflite {
+namespace reference_integer_ops {
+
+// Geometry of the im2col matrix A[m][k] of a convolution, with
+// m = (batch, out_y, out_x) and k = (in_channel, filter_y, filter_x).
+// Used by the implicit GEMM to gather A tiles straight from the NHWC input.
+struct Im2colGeometry {
+  const int8_t* input_data;
+  int input_height, input_width, input_depth;
+  int output_height, output_width;
+  int filter_height, filter_width;
+  int stride_height, stride_width;
+  int dilation_height, dilation_width;
+  int pad_height, pad_width;
+  int32_t input_offset;
+};
+
+// Write the k_tile bytes at each of the m_tile row pointers into BUFF_A from
+// addr_base, CFU_SA_SIZE rows per word (4 rows per host word). rows must
+// have room for m_tile rounded up to CFU_SA_SIZE; the padding rows are 0.
+inline void GemmWriteBuffARows(const int8_t** rows, int m_tile, int k_tile,
+                               int addr_base) {
+  static const int8_t zero_row[CFU_GEMM_MAX_DIM] = {};
+  const int row_tile = (m_tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  for (int row = m_tile; row < row_tile * CFU_SA_SIZE; ++row) {
+    rows[row] = zero_row;
+  }
+  int cnt = addr_base;
+  for (int cnt_tile = 0; cnt_tile < row_tile; ++cnt_tile) {
+    const int8_t* const* group = rows + CFU_SA_SIZE * cnt_tile;
+    for (int col = 0; col < k_tile; ++col) {
+      for (int lane = 0; lane < CFU_GEMM_LANE_WORDS; ++lane) {
+        const int8_t* const* quad = group + 4 * lane;
+        const uint32_t wdata = static_cast<uint32_t>(static_cast<uint8_t>(quad[0][col])) << 24 |
+                               static_cast<uint32_t>(static_cast<uint8_t>(quad[1][col])) << 16 |
+                               static_cast<uint32_t>(static_cast<uint8_t>(quad[2][col])) << 8 |
+                               static_cast<uint32_t>(static_cast<uint8_t>(quad[3][col]));
+        cfu_op0(FUNC7_GEMM_WRITE_BUFF_A, wdata, cnt++);
+      }
+    }
+  }
+}
+
+// A 1x1 filter without padding: row (batch, out_y, out_x) of A is the
+// input_depth channels of one input pixel, so A tiles are strided row
+// gathers, with no bounds checks and no per-element index math.
+inline bool Im2colIsPointwise(const Im2colGeometry& geo) {
+  return geo.filter_height == 1 && geo.filter_width == 1 &&
+         geo.pad_height == 0 && geo.pad_width == 0;
+}
+
+inline void Im2colWriteBuffAPointwise(
+    const Im2colGeometry& geo, int m_start, int m_tile, int k_start, int k_tile,
+    int addr_base) {
+  const int8_t* rows[CFU_GEMM_MAX_DIM + CFU_SA_SIZE];
+  const int row_stride = geo.stride_width * geo.input_depth;
+  int out_x = m_start % geo.output_width;
+  int out_y = (m_start / geo.output_width) % geo.output_height;
+  int batch = m_start / (geo.output_width * geo.output_height);
+  const int8_t* row = geo.input_data + k_start +
+      ((batch * geo.input_height + out_y * geo.stride_height) * geo.input_width +
+       out_x * geo.stride_width) * geo.input_depth;
+  for (int i = 0; i < m_tile; ++i) {
+    rows[i] = row;
+    row += row_stride;
+    if (++out_x == geo.output_width) {
+      out_x = 0;
+      if (++out_y == geo.output_height) {
+        out_y = 0;
+        ++batch;
+      }
+      row = geo.input_data + k_start +
+          (batch * geo.input_height + out_y * geo.stride_height) * geo.input_width *
+              geo.input_depth;
+    }
+  }
+  GemmWriteBuffARows(rows, m_tile, k_tile, addr_base);
+}
+
+// Gather A[m_start:m_start+m_tile][k_start:k_start+k_tile] from the input
+// tensor and write it into BUFF_A from addr_base, CFU_SA_SIZE rows per word
+// (4 rows per host word).
+inline void Im2colWriteBuffA(
+    const Im2colGeometry& geo, int m_start, int m_tile, int k_start, int k_tile,
+    int addr_base) {
+  if (Im2colIsPointwise(geo)) {
+    Im2colWriteBuffAPointwise(geo, m_start, m_tile, k_start, k_tile, addr_base);
+    return;
+  }
+  const int8_t* row_base[CFU_GEMM_MAX_DIM];
+  int row_y[CFU_GEMM_MAX_DIM], row_x[CFU_GEMM_MAX_DIM];
+  int col_ch[CFU_GEMM_MAX_DIM], col_dy[CFU_GEMM_MAX_DIM], col_dx[CFU_GEMM_MAX_DIM];
+  const int8_t pad_value = static_cast<int8_t>(-geo.input_offset);
+  const int batch_stride = geo.input_height * geo.input_width * geo.input_depth;
+  // Receptive field origin of every row of the tile
+  int out_x = m_start % geo.output_width;
+  int out_y = (m_start / geo.output_width) % geo.output_height;
+  int batch = m_start / (geo.output_width * geo.output_height);
+  for (int row = 0; row < m_tile; ++row) {
+    row_base[row] = geo.input_data + batch * batch_stride;
+    row_y[row] = out_y * geo.stride_height - geo.pad_height;
+    row_x[row] = out_x * geo.stride_width - geo.pad_width;
+    if (++out_x == geo.output_width) {
+      out_x = 0;
+      if (++out_y == geo.output_height) {
+        out_y = 0;
+        ++batch;
+      }
+    }
+  }
+  // Filter tap of every column of the tile
+  int filter_x = k_start % geo.filter_width;
+  int filter_y = (k_start / geo.filter_width) % geo.filter_height;
+  int in_channel = k_start / (geo.filter_width * geo.filter_height);
+  for (int col = 0; col < k_tile; ++col) {
+    col_ch[col] = in_channel;
+    col_dy[col] = geo.dilation_height * filter_y;
+    col_dx[col] = geo.dilation_width * filter_x;
+    if (++filter_x == geo.filter_width) {
+      filter_x = 0;
+      if (++filter_y == geo.filter_height) {
+        filter_y = 0;
+        ++in_channel;
+      }
+    }
+  }
+  // Pack
+  int cnt = addr_base;
+  int row_tile = (m_tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  for (int cnt_tile = 0; cnt_tile < row_tile; ++cnt_tile) {
+    for (int col = 0; col < k_tile; ++col) {
+      for (int lane = 0; lane < CFU_GEMM_LANE_WORDS; ++lane) {
+        uint32_t wdata = 0;
+        for (int byte_offset = 0; byte_offset < 4; ++byte_offset) {
+          int row = CFU_SA_SIZE * cnt_tile + 4 * lane + byte_offset;
+          int8_t val = 0;
+          if (row < m_tile) {
+            const int in_y = row_y[row] + col_dy[col];
+            const int in_x = row_x[row] + col_dx[col];
+            const bool is_point_inside_image =
+                (in_x >= 0) && (in_x < geo.input_width) && (in_y >= 0) &&
+                (in_y < geo.input_height);
+            val = is_point_inside_image
+                      ? row_base[row][(in_y * geo.input_width + in_x) * geo.input_depth + col_ch[col]]
+                      : pad_value;
+          }
+          wdata = (wdata << 8) | static_cast<uint8_t>(val);
+        }
+        cfu_op0(FUNC7_GEMM_WRITE_BUFF_A, wdata, cnt++);
+      }
+    }
+  }
+}
+
+// Per-channel requantization of C, done by the GEMM unit on readback.
+// output is the int8 [m][n] result; bias may be nullptr. If per_tensor is
+// set, output_multiplier and output_shift hold one value for every channel.
+// If residual is given, output is the ADD of the requantized C and the int8
+// [m][n] residual instead, done by cfuop_add with the parameters already
+// written to it (see residual_fusion.h).
+struct GemmEpilogue {
+  const int32_t* bias;
+  const int32_t* output_multiplier;
+  const int32_t* output_shift;
+  int32_t output_offset;
+  int32_t output_activation_min;
+  int32_t output_activation_max;
+  int8_t* output;
+  bool per_tensor;
+  const int8_t* residual;
+  bool residual_is_input1;
+};
+
+// Read back C[m_start:m_start+m_tile][n_start:n_start+n_tile] from bank
+// c_bank of BUFF_C, either requantized (epilogue) or as int32 into mat_c.
+// qparam_n_start is the n_tile whose tables are in the CFU.
+inline void GemmReadTileC(
+    const int& n, int m_start, int m_tile, int n_start, int n_tile, int c_bank,
+    int32_t* mat_c, const GemmEpilogue* epilogue, int* qparam_n_start) {
+  int col_tile = (n_tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  int cnt = GEMM_BANK_ADDR(c_bank);
+  if (epilogue) {
+    // write requantization tables of this n_tile
+    if (*qparam_n_start != n_start) {
+      for (int col = 0; col < n_tile; ++col) {
+        const int channel = n_start + col;
+        const int qchannel = epilogue->per_tensor ? 0 : channel;
+        cfu_op0(FUNC7_GEMM_WRITE_QPARAM, epilogue->bias ? epilogue->bias[channel] : 0, GEMM_QPARAM_BIAS | col);
+        cfu_op0(FUNC7_GEMM_WRITE_QPARAM, epilogue->output_multiplier[qchannel], GEMM_QPARAM_MULT | col);
+        cfu_op0(FUNC7_GEMM_WRITE_QPARAM, epilogue->output_shift[qchannel], GEMM_QPARAM_SHIFT | col);
+      }
+      *qparam_n_start = n_start;
+    }
+    // read requantized result, 4 channels per word (first channel in the LSB)
+    int8_t* out_head = epilogue->output+(m_start*n+n_start);
+    const int8_t* residual_head = epilogue->residual ? epilogue->residual+(m_start*n+n_start) : nullptr;
+    for (int cnt_tile = 0; cnt_tile < col_tile; ++cnt_tile) {
+      for (int row = 0; row < m_tile; ++row) {
+        for (int col = CFU_SA_SIZE * cnt_tile; col < std::min(n_tile, CFU_SA_SIZE * (cnt_tile + 1)); col += 4) {
+          const int valid = std::min(4, n_tile - col);
+          uint32_t rdata = cfu_op0(FUNC7_GEMM_READ_BUFF_C_Q, col, cnt);
+          if (residual_head) {
+            const int8_t* res = residual_head + row * n + col;
+            uint32_t sdata = 0;
+            if (valid == 4) {
+              memcpy(&sdata, res, 4);
+            } else {
+              for (int byte_offset = 0; byte_offset < valid; ++byte_offset) {
+                sdata |= static_cast<uint32_t>(static_cast<uint8_t>(res[byte_offset])) << (8 * byte_offset);
+              }
+            }
+            rdata = epilogue->residual_is_input1 ? cfu_op1(GEMM_FUNC7_ADD_ADD4, sdata, rdata)
+                                                 : cfu_op1(GEMM_FUNC7_ADD_ADD4, rdata, sdata);
+          }
+          int8_t* dst = out_head + row * n + col;
+          if (valid == 4) {
+            memcpy(dst, &rdata, 4);
+          } else {
+            for (int byte_offset = 0; byte_offset < valid; ++byte_offset) {
+              dst[byte_offset] = static_cast<int8_t>(rdata >> (8 * byte_offset));
+            }
+          }
+        }
+        ++cnt;
+      }
+    }
+    return;
+  }
+  // read result
+  int32_t* mat_c_head = mat_c+(m_start*n+n_start);
+  for (int cnt_tile = 0; cnt_tile < col_tile; ++cnt_tile) {
+    for (int row = 0; row < m_tile; ++row) {
+      for (int lane = 0; lane < CFU_SA_SIZE; ++lane) {
+        int col = CFU_SA_SIZE * cnt_tile + lane;
+        if (col < n_tile) {
+          mat_c_head[row * n + col] = cfu_op0(FUNC7_GEMM_READ_BUFF_C, lane, cnt);
+        }
+      }
+      ++cnt;
+    }
+  }
+}
+
+// Tile sizes of one GEMM. m_tile and n_tile are multiples of CFU_SA_SIZE
+// unless they cover the whole dimension.
+struct GemmTilePlan {
+  int m_tile;
+  int n_tile;
+  int k_tile;
+};
+
+// Tile size when dim is split evenly into count tiles
+inline int GemmEvenTile(int dim, int count, int align) {
+  if (count == 1) return dim;
+  const int tile = (dim + count - 1) / count;
+  return (tile + align - 1) / align * align;
+}
+
+// Number of CFU_SA_SIZE row/column groups of dim in tiles of tile
+inline int GemmTileGroups(int dim, int tile) {
+  const int full = dim / tile;
+  const int rest = dim - full * tile;
+  return full * ((tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE) +
+         (rest + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+}
+
+// Pick the tiles of an m x n x k GEMM for the configured array and buffers.
+// M and N are split evenly, so the last tile does not pay for a mostly padded
+// pass, and K in the fewest tiles that fit the banks. Loading overlaps
+// compute, so a candidate costs the larger of host traffic and array cycles.
+inline GemmTilePlan GemmPlanTiles(int m, int n, int k) {
+  const int max_mn = CFU_GEMM_MAX_DIM / CFU_SA_SIZE * CFU_SA_SIZE;
+  const int max_n = std::min(max_mn, CFU_GEMM_MAX_N_TILE);
+  const int m_count_min = (m + max_mn - 1) / max_mn;
+  const int n_count_min = (n + max_n - 1) / max_n;
+  const int m_count_max = (m + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  const int n_count_max = (n + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  GemmTilePlan best = {CFU_SA_SIZE, CFU_SA_SIZE, 1};
+  int64_t best_cost = -1;
+  for (int m_count = m_count_min; m_count < m_count_min + GEMM_PLAN_SPLITS && m_count <= m_count_max; ++m_count) {
+    const int m_tile = GemmEvenTile(m, m_count, CFU_SA_SIZE);
+    const int m_tile_groups = (m_tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+    for (int n_count = n_count_min; n_count < n_count_min + GEMM_PLAN_SPLITS && n_count <= n_count_max; ++n_count) {
+      const int n_tile = GemmEvenTile(n, n_count, CFU_SA_SIZE);
+      const int n_tile_groups = (n_tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+      // Fit the registers, the qparam tables and the banks
+      if (m_tile > CFU_GEMM_MAX_DIM || n_tile > max_n ||
+          n_tile_groups * m_tile > CFU_GEMM_BANK_WORDS) {
+        continue;
+      }
+      const int k_max = std::min(CFU_GEMM_MAX_DIM,
+          CFU_GEMM_BANK_WORDS / std::max(m_tile_groups, n_tile_groups));
+      const int k_count = (k + k_max - 1) / k_max;
+      const int k_tile = (k + k_count - 1) / k_count;
+      // Cost
+      const int m_tiles = (m + m_tile - 1) / m_tile;
+      const int n_tiles = (n + n_tile - 1) / n_tile;
+      const int k_tiles = (k + k_tile - 1) / k_tile;
+      const int m_groups = GemmTileGroups(m, m_tile);
+      const int n_groups = GemmTileGroups(n, n_tile);
+      const int64_t a_words = (int64_t)m_groups * k * CFU_GEMM_LANE_WORDS * (m_tiles * k_tiles <= 2 ? 1 : n_tiles);
+      const int64_t b_words = (int64_t)n_groups * k * CFU_GEMM_LANE_WORDS * (k_tiles <= 2 ? 1 : m_tiles);
+      const int64_t c_words = (int64_t)m * n_groups * CFU_GEMM_LANE_WORDS;
+      const int64_t load = (a_words + b_words + c_words) * GEMM_PLAN_WORD_CYCLES +
+                           (int64_t)m_tiles * n_tiles * k_tiles * GEMM_PLAN_TILE_CYCLES;
+      const int64_t compute = (int64_t)m_groups * n_groups * (k + 2 * CFU_SA_SIZE * k_tiles);
+      const int64_t cost = std::max(load, compute);
+      if (best_cost < 0 || cost < best_cost) {
+        best = {m_tile, n_tile, k_tile};
+        best_cost = cost;
+      }
+    }
+  }
+  return best;
+}
+
+// Write B[k_start:k_start+k_tile][n_start:n_start+n_tile] into BUFF_B from
+// addr_base, gathered from B^T stored row-major as [n][k] (the OI filter of a
+// fully connected layer), in the word order of gemm_pack_filter().
+inline void GemmWriteBuffBRows(
+    const int8_t* mat_b_rows, int k, int n_start, int n_tile, int k_start,
+    int k_tile, int addr_base) {
+  int cnt = addr_base;
+  const int col_tile = (n_tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  for (int cnt_tile = 0; cnt_tile < col_tile; ++cnt_tile) {
+    const int8_t* rows[CFU_SA_SIZE];
+    for (int lane = 0; lane < CFU_SA_SIZE; ++lane) {
+      const int col = n_start + CFU_SA_SIZE * cnt_tile + lane;
+      rows[lane] = (col < n_start + n_tile) ? mat_b_rows + col * k + k_start : nullptr;
+    }
+    for (int row = 0; row < k_tile; ++row) {
+      for (int lane = 0; lane < CFU_GEMM_LANE_WORDS; ++lane) {
+        uint32_t wdata = 0;
+        for (int byte_offset = 0; byte_offset < 4; ++byte_offset) {
+          const int8_t* col_head = rows[4 * lane + byte_offset];
+          wdata = (wdata << 8) | static_cast<uint8_t>(col_head ? col_head[row] : 0);
+        }
+        cfu_op0(FUNC7_GEMM_WRITE_BUFF_B, wdata, cnt++);
+      }
+    }
+  }
+}
+
+// Matrix multiplication with tiling
+// mat_b is packed in BUFF_B word order (see gemm_weight_pack.h). If it is
+// nullptr, B is gathered from mat_b_rows instead (see GemmWriteBuffBRows).
+// If geo is given, A is gathered from the input tensor tile by tile
+// (implicit GEMM) and mat_a is not used.
+// If epilogue is given, C is requantized to int8 by the CFU and mat_c is not
+// used.
+inline void Int8GemmWithTilingCfu(
+    const int& k, const int& m, const int& n, const int32_t& input_offset,
+    const int8_t* mat_a, const uint32_t* mat_b, int32_t* mat_c, const GemmTilePlan& plan,
+    const Im2colGeometry* geo = nullptr, const GemmEpilogue* epilogue = nullptr,
+    const int8_t* mat_b_rows = nullptr) {
+  TFLITE_DCHECK(plan.n_tile >= n || plan.n_tile % CFU_SA_SIZE == 0);
+  TFLITE_DCHECK(plan.m_tile >= m || plan.m_tile % CFU_SA_SIZE == 0);
+  // Bank words of the largest tiles, as fitted by GemmPlanTiles
+  const int m_tile_groups = (std::min(plan.m_tile, m) + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  const int n_tile_groups = (std::min(plan.n_tile, n) + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  cfu_memory_note_buffers(m_tile_groups * std::min(plan.k_tile, k),
+                          n_tile_groups * std::min(plan.k_tile, k),
+                          n_tile_groups * std::min(plan.m_tile, m));
+  // Tiling
+  // C stays in BUFF_C across K tiles (accumulate mode), so it is read back
+  // once per (m_tile, n_tile).
+  // Every buffer is double-buffered: tiles are computed asynchronously from
+  // the banks of the last issued tile while the host fills the other banks
+  // and reads back the previous C. COMPUTE_ASYNC waits for the running tile,
+  // so only the last issued tile can still be using its banks.
+  // A tile of A or B still in a bank is not written again; with a single
+  // (m_tile, k_tile), e.g. the input vector of a fully connected layer, A is
+  // written once for all the n tiles.
+  int cnt = 0;
+  int flags = -1;
+  int a_bank = 1, b_bank = 1, c_bank = 1;
+  int loaded_k_start[2] = {-1, -1}, loaded_n_start[2] = {-1, -1};
+  int loaded_a_k_start[2] = {-1, -1}, loaded_a_m_start[2] = {-1, -1};
+  int qparam_n_start = -1;
+  bool pending = false;
+  int pending_m_start = 0, pending_m_tile = 0, pending_n_start = 0, pending_n_tile = 0, pending_bank = 0;
+  cfu_op0(FUNC7_GEMM_WRITE_CONFIG, input_offset, 3); // write config - offset
+  if (epilogue) {
+    cfu_op0(FUNC7_GEMM_WRITE_QPARAM, epilogue->output_offset, GEMM_QPARAM_SCALAR | GEMM_QSCALAR_OFFSET);
+    cfu_op0(FUNC7_GEMM_WRITE_QPARAM, epilogue->output_activation_min, GEMM_QPARAM_SCALAR | GEMM_QSCALAR_MIN);
+    cfu_op0(FUNC7_GEMM_WRITE_QPARAM, epilogue->output_activation_max, GEMM_QPARAM_SCALAR | GEMM_QSCALAR_MAX);
+  }
+  for (int n_start = 0; n_start < n; n_start += plan.n_tile) {
+    int n_tile = std::min(plan.n_tile, n - n_start);
+    int col_tile = (n_tile + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+    cfu_op0(FUNC7_GEMM_WRITE_CONFIG, n_tile, 2); // write config - n
+    for (int m_start = 0; m_start < m; m_start += plan.m_tile) {
+      int m_tile = std::min(plan.m_tile, m - m_start);
+      cfu_op0(FUNC7_GEMM_WRITE_CONFIG, m_tile, 1); // write config - m
+      c_bank ^= 1;
+      for (int k_start = 0; k_start < k; k_start += plan.k_tile) {
+        int k_tile = std::min(plan.k_tile, k - k_start);
+        cfu_op0(FUNC7_GEMM_WRITE_CONFIG, k_tile, 0); // write config - k
+        // Tile GEMM
+        // A[m_start:m_end][k_start:k_end] * B[k_start:k_end][n_start:n_end]
+        // write weight, unless this tile of B is still in one of the banks
+        if (k_start == loaded_k_start[b_bank ^ 1] && n_start == loaded_n_start[b_bank ^ 1]) {
+          b_bank ^= 1;
+        } else if (k_start != loaded_k_start[b_bank] || n_start != loaded_n_start[b_bank]) {
+          CFU_PROFILE_BEGIN(load_b_start);
+          b_bank ^= 1;
+          if (mat_b) {
+            const uint32_t* mat_b_head = mat_b+((n_start/CFU_SA_SIZE)*k+k_start)*CFU_GEMM_LANE_WORDS;
+            cnt = GEMM_BANK_ADDR(b_bank);
+            for (int cnt_tile = 0; cnt_tile < col_tile; ++cnt_tile) {
+              const uint32_t* col_head = mat_b_head + cnt_tile * k * CFU_GEMM_LANE_WORDS;
+              for (int row = 0; row < k_tile * CFU_GEMM_LANE_WORDS; ++row) {
+                cfu_op0(FUNC7_GEMM_WRITE_BUFF_B, col_head[row], cnt++);
+              }
+            }
+          } else {
+            GemmWriteBuffBRows(mat_b_rows, k, n_start, n_tile, k_start, k_tile, GEMM_BANK_ADDR(b_bank));
+          }
+          loaded_k_start[b_bank] = k_start;
+          loaded_n_start[b_bank] = n_start;
+          CFU_PROFILE_END(CFU_PROFILE_LOAD_B, load_b_start);
+        }
+        // write input, unless this tile of A is still in one of the banks
+        CFU_PROFILE_BEGIN(load_a_start);
+        if (k_start == loaded_a_k_start[a_bank ^ 1] && m_start == loaded_a_m_start[a_bank ^ 1]) {
+          a_bank ^= 1;
+        } else if (k_start != loaded_a_k_start[a_bank] || m_start != loaded_a_m_start[a_bank]) {
+          a_bank ^= 1;
+          if (geo) {
+            Im2colWriteBuffA(*geo, m_start, m_tile, k_start, k_tile, GEMM_BANK_ADDR(a_bank));
+          } else {
+            const int8_t* rows[CFU_GEMM_MAX_DIM + CFU_SA_SIZE];
+            for (int row = 0; row < m_tile; ++row) {
+              rows[row] = mat_a + (m_start + row) * k + k_start;
+            }
+            GemmWriteBuffARows(rows, m_tile, k_tile, GEMM_BANK_ADDR(a_bank));
+          }
+          loaded_a_k_start[a_bank] = k_start;
+          loaded_a_m_start[a_bank] = m_start;
+        }
+        CFU_PROFILE_END(CFU_PROFILE_LOAD_A, load_a_start);
+        int tile_flags = (k_start == 0) ? 0 : GEMM_FLAG_ACCUMULATE;
+        tile_flags |= (a_bank ? GEMM_FLAG_BANK_A : 0) | (b_bank ? GEMM_FLAG_BANK_B : 0) |
+                      (c_bank ? GEMM_FLAG_BANK_C : 0);
+        if (tile_flags != flags) {
+          cfu_op0(FUNC7_GEMM_WRITE_CONFIG, tile_flags, 4); // write config - flags
+          flags = tile_flags;
+        }
+        // compute
+        CFU_PROFILE_BEGIN(compute_start);
+        cfu_op0(FUNC7_GEMM_COMPUTE_ASYNC, 0, 0);
+        CFU_PROFILE_END(CFU_PROFILE_COMPUTE, compute_start);
+        // the previous tile is done now, read it back while this one runs
+        if (pending) {
+          CFU_PROFILE_BEGIN(readback_start);
+          GemmReadTileC(n, pending_m_start, pending_m_tile, pending_n_start, pending_n_tile,
+                        pending_bank, mat_c, epilogue, &qparam_n_start);
+          CFU_PROFILE_END(CFU_PROFILE_READBACK, readback_start);
+          pending = false;
+        }
+      }
+      pending = true;
+      pending_m_start = m_start;
+      pending_m_tile = m_tile;
+      pending_n_start = n_start;
+      pending_n_tile = n_tile;
+      pending_bank = c_bank;
+    }
+  }
+  // wait for the last tile
+  CFU_PROFILE_BEGIN(compute_start);
+  while (cfu_op0(FUNC7_GEMM_READ_CONFIG, 0, 5) & GEMM_STATUS_BUSY) {
+  }
+  CFU_PROFILE_END(CFU_PROFILE_COMPUTE, compute_start);
+  if (pending) {
+    CFU_PROFILE_BEGIN(readback_start);
+    GemmReadTileC(n, pending_m_start, pending_m_tile, pending_n_start, pending_n_tile,
+                  pending_bank, mat_c, epilogue, &qparam_n_start);
+    CFU_PROFILE_END(CFU_PROFILE_READBACK, readback_start);
+  }
+}
+}  // namespace reference_integer_ops
+}  // namespace tflite
+
+#endif  // _GEMM_CFU_H
@@ -0,0 +1,271 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef  SKIP_TFLM
+
+#include "gemm_weight_pack.h"
+
+#include <stdio.h>
+
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+namespace {
+
+struct PackedFilter {
+  const int8_t* filter_data;
+  const uint32_t* packed;
+};
+
+uint32_t weight_pool[GEMM_WEIGHT_POOL_WORDS];
+PackedFilter packed_filters[GEMM_WEIGHT_MAX_FILTERS];
+int num_packed_filters = 0;
+int weight_pool_used = 0;
+
+#if CFU_FOLD_INPUT_OFFSET
+// An op whose bias can be folded: the pointers the kernel gets, its input
+// offset, and the layout of its filter taps (see gemm_fold_bias())
+struct FoldedBias {
+  const int8_t* filter_data;
+  const int32_t* bias_data;
+  int32_t input_offset;
+  int channels;
+  int taps;
+  int channel_stride;
+  int tap_stride;
+  const int32_t* folded;
+};
+
+int32_t bias_pool[GEMM_BIAS_POOL_WORDS];
+FoldedBias folded_biases[GEMM_BIAS_MAX_OPS];
+int num_folded_biases = 0;
+int bias_pool_used = 0;
+
+const uint8_t* constant_data(const tflite::Model* model,
+                             const tflite::Tensor* tensor) {
+  const tflite::Buffer* buffer = model->buffers()->Get(tensor->buffer());
+  if (buffer->data() == nullptr || buffer->data()->size() == 0) {
+    return nullptr;
+  }
+  return buffer->data()->data();
+}
+
+// The FoldedBias of an int8 CONV_2D, FULLY_CONNECTED or DEPTHWISE_CONV_2D
+// (depth multiplier 1) with a constant filter and bias, as the kernel will
+// see it. False for any other op.
+bool fold_key(const tflite::Model* model, const tflite::SubGraph* subgraph,
+              const tflite::Operator* op, FoldedBias* key) {
+  const tflite::BuiltinOperator code = tflite::GetBuiltinCode(
+      model->operator_codes()->Get(op->opcode_index()));
+  const bool depthwise = code == tflite::BuiltinOperator_DEPTHWISE_CONV_2D;
+  if ((code != tflite::BuiltinOperator_CONV_2D &&
+       code != tflite::BuiltinOperator_FULLY_CONNECTED && !depthwise) ||
+      op->inputs()->size() < 2) {
+    return false;
+  }
+  const auto* tensors = subgraph->tensors();
+  const tflite::Tensor* input = tensors->Get(op->inputs()->Get(0));
+  const tflite::Tensor* filter = tensors->Get(op->inputs()->Get(1));
+  const int rank = code == tflite::BuiltinOperator_FULLY_CONNECTED ? 2 : 4;
+  if (input->type() != tflite::TensorType_INT8 ||
+      filter->type() != tflite::TensorType_INT8 ||
+      filter->shape() == nullptr || static_cast<int>(filter->shape()->size()) != rank) {
+    return false;
+  }
+  const uint8_t* filter_data = constant_data(model, filter);
+  if (filter_data == nullptr) {
+    return false;
+  }
+  key->bias_data = nullptr;
+  if (op->inputs()->size() > 2 && op->inputs()->Get(2) >= 0) {
+    const tflite::Tensor* bias = tensors->Get(op->inputs()->Get(2));
+    const uint8_t* bias_data = constant_data(model, bias);
+    if (bias->type() != tflite::TensorType_INT32 || bias_data == nullptr) {
+      return false;
+    }
+    key->bias_data = reinterpret_cast<const int32_t*>(bias_data);
+  }
+  key->filter_data = reinterpret_cast<const int8_t*>(filter_data);
+  // input_offset = -zero point, as in the kernel params
+  key->input_offset = 0;
+  if (input->quantization() && input->quantization()->zero_point() &&
+      input->quantization()->zero_point()->size() > 0) {
+    key->input_offset =
+        -static_cast<int32_t>(input->quantization()->zero_point()->Get(0));
+  }
+
+  const auto* shape = filter->shape();
+  if (depthwise) {
+    // 1HWC, channels innermost
+    key->channels = shape->Get(3);
+    key->taps = shape->Get(1) * shape->Get(2);
+    key->channel_stride = 1;
+    key->tap_stride = key->channels;
+    return input->shape() != nullptr && input->shape()->size() == 4 &&
+           input->shape()->Get(3) == key->channels;
+  }
+  // OHWI or OI, one row of taps per output channel
+  key->channels = shape->Get(0);
+  key->taps = 1;
+  for (int dim = 1; dim < rank; ++dim) {
+    key->taps *= shape->Get(dim);
+  }
+  key->channel_stride = key->taps;
+  key->tap_stride = 1;
+  return true;
+}
+
+void fold_op_bias(const tflite::Model* model, const tflite::SubGraph* subgraph,
+                  const tflite::Operator* op, int op_index) {
+  FoldedBias key;
+  if (!fold_key(model, subgraph, op, &key) ||
+      gemm_weight_pack_find_bias(key.filter_data, key.bias_data, key.input_offset)) {
+    return;
+  }
+  if (num_folded_biases == GEMM_BIAS_MAX_OPS ||
+      bias_pool_used + key.channels > GEMM_BIAS_POOL_WORDS) {
+    printf("gemm_weight_pack: bias pool full, op %d folds at runtime\n",
+           op_index);
+    return;
+  }
+  int32_t* folded = &bias_pool[bias_pool_used];
+  gemm_fold_bias(key.bias_data, key.filter_data, key.channels, key.taps,
+                 key.channel_stride, key.tap_stride, key.input_offset, folded);
+  key.folded = folded;
+  folded_biases[num_folded_biases++] = key;
+  bias_pool_used += key.channels;
+}
+#endif  // CFU_FOLD_INPUT_OFFSET
+
+}  // anonymous namespace
+
+void gemm_weight_pack_model(const tflite::Model* model) {
+  num_packed_filters = 0;
+  weight_pool_used = 0;
+#if CFU_FOLD_INPUT_OFFSET
+  num_folded_biases = 0;
+  bias_pool_used = 0;
+#endif
+
+  for (const tflite::SubGraph* subgraph : *model->subgraphs()) {
+    const auto* tensors = subgraph->tensors();
+    const auto* operators = subgraph->operators();
+    for (size_t i = 0; i < operators->size(); ++i) {
+      const tflite::Operator* op = operators->Get(i);
+      const tflite::OperatorCode* opcode =
+          model->operator_codes()->Get(op->opcode_index());
+      const tflite::BuiltinOperator code = tflite::GetBuiltinCode(opcode);
+#if CFU_FOLD_INPUT_OFFSET
+      fold_op_bias(model, subgraph, op, static_cast<int>(i));
+#endif
+      if (code != tflite::BuiltinOperator_CONV_2D &&
+          code != tflite::BuiltinOperator_FULLY_CONNECTED) {
+        continue;
+      }
+
+      // Only constant int8 OHWI (conv) or OI (fully connected) filters
+      const int rank = code == tflite::BuiltinOperator_CONV_2D ? 4 : 2;
+      const tflite::Tensor* filter = tensors->Get(op->inputs()->Get(1));
+      if (filter->type() != tflite::TensorType_INT8 ||
+          filter->shape() == nullptr || static_cast<int>(filter->shape()->size()) != rank) {
+        continue;
+      }
+      const tflite::Buffer* buffer = model->buffers()->Get(filter->buffer());
+      if (buffer->data() == nullptr || buffer->data()->size() == 0) {
+        continue;
+      }
+      const int8_t* filter_data =
+          reinterpret_cast<const int8_t*>(buffer->data()->data());
+      if (gemm_weight_pack_find(filter_data)) {
+        continue;  // shared by several ops
+      }
+
+      // A fully connected filter is a 1x1 conv filter
+      const int filter_num = filter->shape()->Get(0);
+      const int filter_height = rank == 4 ? filter->shape()->Get(1) : 1;
+      const int filter_width = rank == 4 ? filter->shape()->Get(2) : 1;
+      const int filter_depth = filter->shape()->Get(rank - 1);
+      const int words = gemm_packed_filter_words(
+          filter_num, filter_height * filter_width * filter_depth);
+      if (num_packed_filters == GEMM_WEIGHT_MAX_FILTERS ||
+          weight_pool_used + words > GEMM_WEIGHT_POOL_WORDS) {
+        printf("gemm_weight_pack: pool full, op %d packs at runtime\n",
+               static_cast<int>(i));
+        continue;
+      }
+
+      uint32_t* packed = &weight_pool[weight_pool_used];
+      gemm_pack_filter(filter_data, filter_num, filter_height, filter_width,
+                       filter_depth, packed);
+      packed_filters[num_packed_filters++] = {filter_data, packed};
+      weight_pool_used += words;
+    }
+  }
+  printf("Packed %d filters into %d words\n", num_packed_filters,
+         weight_pool_used);
+#if CFU_FOLD_INPUT_OFFSET
+  printf("Folded the input offset into %d biases, %d words\n",
+         num_folded_biases, bias_pool_used);
+#endif
+}
+
+const uint32_t* gemm_weight_pack_find(const int8_t* filter_data) {
+  for (int i = 0; i < num_packed_filters; ++i) {
+    if (packed_filters[i].filter_data == filter_data) {
+      return packed_filters[i].packed;
+    }
+  }
+  return nullptr;
+}
+
+#if CFU_FOLD_INPUT_OFFSET
+const int32_t* gemm_weight_pack_find_bias(const int8_t* filter_data,
+                                          const int32_t* bias_data,
+                                          int32_t input_offset) {
+  for (int i = 0; i < num_folded_biases; ++i) {
+    const FoldedBias& entry = folded_biases[i];
+    if (entry.filter_data == filter_data && entry.bias_data == bias_data &&
+        entry.input_offset == input_offset) {
+      return entry.folded;
+    }
+  }
+  return nullptr;
+}
+
+const int32_t* gemm_weight_pack_find_op_bias(const tflite::Model* model,
+                                             const tflite::SubGraph* subgraph,
+                                             const tflite::Operator* op) {
+  FoldedBias key;
+  if (!fold_key(model, subgraph, op, &key)) {
+    return nullptr;
+  }
+  return gemm_weight_pack_find_bias(key.filter_data, key.bias_data,
+                                    key.input_offset);
+}
+#else
+const int32_t* gemm_weight_pack_find_bias(const int8_t*, const int32_t*,
+                                          int32_t) {
+  return nullptr;
+}
+
+const int32_t* gemm_weight_pack_find_op_bias(const tflite::Model*,
+                                             const tflite::SubGraph*,
+                                             const tflite::Operator*) {
+  return nullptr;
+}
+#endif  // CFU_FOLD_INPUT_OFFSET
+
+#endif // SKIP_TFLM
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Conv and fully connected filters pre-packed in BUFF_B word order for the
+ * systolic-array GEMM. A fully connected filter [O][I] is packed as a 1x1
+ * conv filter.
+ *
+ * A column group is CFU_SA_SIZE output channels. Word
+ * [(col_group * K + k) * CFU_GEMM_LANE_WORDS + lane] holds tap k of output
+ * channels CFU_SA_SIZE * col_group + 4 * lane to ... + 3, first channel in
+ * the MSB. K is ordered (in_channel, filter_y, filter_x) like the im2col
+ * matrix, so every (k_tile, n_tile) of B is one contiguous run per column
+ * group.
+ *
+ * With CFU_FOLD_INPUT_OFFSET the MACs of the CFU take the raw int8 input,
+ * and the input offset goes into the bias instead:
+ * bias'[o] = bias[o] + input_offset * (sum of the filter taps of channel o).
+ * The folded biases of the conv, fully connected and depthwise conv ops are
+ * computed here too. Padding stays exact as long as the kernels feed the
+ * zero point (-input_offset) for the taps outside the image.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cfu_config.h"
+
+#ifndef _GEMM_WEIGHT_PACK_H
+#define _GEMM_WEIGHT_PACK_H
+
+#ifndef __cplusplus
+#error "gemm_weight_pack.h is for C++ only"
+#endif
+
+// Persistent storage for the packed filters of one model
+#define GEMM_WEIGHT_POOL_WORDS  (24 * 1024)
+#define GEMM_WEIGHT_MAX_FILTERS 64
+// and for their folded biases (CFU_FOLD_INPUT_OFFSET)
+#define GEMM_BIAS_POOL_WORDS    4096
+#define GEMM_BIAS_MAX_OPS       64
+
+namespace tflite {
+struct Model;
+struct Operator;
+struct SubGraph;
+}
+
+// Number of BUFF_B words of a packed filter
+inline int gemm_packed_filter_words(int filter_num, int k) {
+  return ((filter_num + CFU_SA_SIZE - 1) / CFU_SA_SIZE) * k * CFU_GEMM_LANE_WORDS;
+}
+
+// Pack an OHWI int8 filter into BUFF_B word order
+inline void gemm_pack_filter(const int8_t* filter_data, int filter_num,
+                             int filter_height, int filter_width,
+                             int filter_depth, uint32_t* packed) {
+  int cnt = 0;
+  const int col_groups = (filter_num + CFU_SA_SIZE - 1) / CFU_SA_SIZE;
+  for (int cnt_tile = 0; cnt_tile < col_groups; ++cnt_tile) {
+    for (int filter_channel = 0; filter_channel < filter_depth; ++filter_channel) {
+      for (int filter_row = 0; filter_row < filter_height; ++filter_row) {
+        for (int filter_col = 0; filter_col < filter_width; ++filter_col) {
+          for (int lane = 0; lane < CFU_GEMM_LANE_WORDS; ++lane) {
+            uint32_t wdata = 0;
+            for (int byte_offset = 0; byte_offset < 4; ++byte_offset) {
+              const int output_channel = CFU_SA_SIZE * cnt_tile + 4 * lane + byte_offset;
+              int8_t val = 0;
+              if (output_channel < filter_num) {
+                val = filter_data[((output_channel * filter_height + filter_row) *
+                                       filter_width + filter_col) * filter_depth +
+                                  filter_channel];
+              }
+              wdata = (wdata << 8) | static_cast<uint8_t>(val);
+            }
+            packed[cnt++] = wdata;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Bias with the input offset folded in. The taps of output channel o are
+// filter_data[o * channel_stride + t * tap_stride] for t < taps; bias_data
+// may be nullptr.
+inline void gemm_fold_bias(const int32_t* bias_data, const int8_t* filter_data,
+                           int channels, int taps, int channel_stride,
+                           int tap_stride, int32_t input_offset,
+                           int32_t* folded) {
+  for (int channel = 0; channel < channels; ++channel) {
+    const int8_t* taps_head = filter_data + channel * channel_stride;
+    int32_t sum = 0;
+    for (int tap = 0; tap < taps; ++tap) {
+      sum += taps_head[tap * tap_stride];
+    }
+    folded[channel] = (bias_data ? bias_data[channel] : 0) + input_offset * sum;
+  }
+}
+
+// Model preparation: pack the filters of every int8 CONV_2D and
+// FULLY_CONNECTED of the model, and with CFU_FOLD_INPUT_OFFSET fold the
+// biases of those and of the DEPTHWISE_CONV_2D.
+// Called once from tflite_load_model().
+void gemm_weight_pack_model(const tflite::Model* model);
+
+// Packed words of a filter prepared by gemm_weight_pack_model(), or nullptr
+// if the filter was not packed (e.g. the pool is full).
+const uint32_t* gemm_weight_pack_find(const int8_t* filter_data);
+
+// Folded bias of the op with this filter, bias and input offset, prepared by
+// gemm_weight_pack_model(), or nullptr if it was not folded (the pool is
+// full, or the bias is not constant). The kernel then folds it into scratch.
+const int32_t* gemm_weight_pack_find_bias(const int8_t* filter_data,
+                                          const int32_t* bias_data,
+                                          int32_t input_offset);
+
+// The same, looked up from an op of the model, for the scratch planner
+const int32_t* gemm_weight_pack_find_op_bias(const tflite::Model* model,
+                                             const tflite::SubGraph* subgraph,
+                                             const tflite::Operator* op);
+
+#endif  // _GEMM_WEIGHT_PACK_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The MLPerf Tiny workload run by the benchmark harness.
+ *
+ * Exactly one INCLUDE_MODEL_MLCOMMONS_TINY_V01_* define (see the Makefile)
+ * picks the model, its EE_MODEL_VERSION and how the db bytes become the
+ * input tensor. Sizes are taken from the model's tensors at run time; only
+ * the host-side formats below are fixed per workload.
+ *
+ *   IC   uint8 RGB 32x32x3 images, shifted to int8
+ *   KWS  int8 MFCC features, copied as they are
+ *   VWW  uint8 RGB 96x96x3 images, shifted to int8
+ *   AD   float32 log-mel frames, quantized with the input tensor's params;
+ *        the result is the reconstruction error, not the output tensor
+ */
+#ifndef _MLPERF_WORKLOAD_H
+#define _MLPERF_WORKLOAD_H
+
+#ifndef __cplusplus
+#error "mlperf_workload.h is for C++ only"
+#endif
+
+// How the db bytes map onto the input tensor
+#define MLPERF_INPUT_UINT8 0
+#define MLPERF_INPUT_INT8 1
+#define MLPERF_INPUT_FLOAT32 2
+
+#if defined(INCLUDE_MODEL_MLCOMMONS_TINY_V01_IMGC) +   \
+        defined(INCLUDE_MODEL_MLCOMMONS_TINY_V01_KWS) + \
+        defined(INCLUDE_MODEL_MLCOMMONS_TINY_V01_VWW) + \
+        defined(INCLUDE_MODEL_MLCOMMONS_TINY_V01_ANOMD) > 1
+#error "Define only one INCLUDE_MODEL_MLCOMMONS_TINY_V01_* for the harness"
+#endif
+
+#if defined(INCLUDE_MODEL_MLCOMMONS_TINY_V01_KWS)
+#include "tiny/v0.1/training/keyword_spotting/trained_models/kws_ref_model.h"
+#define MLPERF_WORKLOAD_MODEL kws_ref_model
+#define MLPERF_WORKLOAD_MODEL_LEN kws_ref_model_len
+#define MLPERF_WORKLOAD_VERSION EE_MODEL_VERSION_KWS01
+#define MLPERF_WORKLOAD_INPUT MLPERF_INPUT_INT8
+#define MLPERF_WORKLOAD_SAMPLE_BYTES (49 * 10)
+
+#elif defined(INCLUDE_MODEL_MLCOMMONS_TINY_V01_VWW)
+#include "tiny/v0.1/training/visual_wake_words/trained_models/vww_96_int8.h"
+#define MLPERF_WORKLOAD_MODEL vww_96_int8
+#define MLPERF_WORKLOAD_MODEL_LEN vww_96_int8_len
+#define MLPERF_WORKLOAD_VERSION EE_MODEL_VERSION_VWW01
+#define MLPERF_WORKLOAD_INPUT MLPERF_INPUT_UINT8
+#define MLPERF_WORKLOAD_SAMPLE_BYTES (96 * 96 * 3)
+
+#elif defined(INCLUDE_MODEL_MLCOMMONS_TINY_V01_ANOMD)
+#include "tiny/v0.1/training/anomaly_detection/trained_models/ad01_int8.h"
+#define MLPERF_WORKLOAD_MODEL ad01_int8
+#define MLPERF_WORKLOAD_MODEL_LEN ad01_int8_len
+#define MLPERF_WORKLOAD_VERSION EE_MODEL_VERSION_AD01
+#define MLPERF_WORKLOAD_INPUT MLPERF_INPUT_FLOAT32
+#define MLPERF_WORKLOAD_SAMPLE_BYTES (640 * 4)
+
+#else
+#include "tiny/v0.1/training/image_classification/trained_models/pretrainedResnet_quant.h"
+#define MLPERF_WORKLOAD_MODEL pretrainedResnet_quant
+#define MLPERF_WORKLOAD_MODEL_LEN pretrainedResnet_quant_len
+#define MLPERF_WORKLOAD_VERSION EE_MODEL_VERSION_IC01
+#define MLPERF_WORKLOAD_INPUT MLPERF_INPUT_UINT8
+#define MLPERF_WORKLOAD_SAMPLE_BYTES (32 * 32 * 3)
+#endif
+
+#endif  // _MLPERF_WORKLOAD_H
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef  SKIP_TFLM
+
+#include "pool_fusion.h"
+
+#include <stdio.h>
+
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+namespace {
+
+PoolFusion fusions[POOL_FUSION_MAX];
+int num_fusions = 0;
+
+// The last pool that ran unfused, for the FC after it
+const int8_t* last_pool_input = nullptr;
+int8_t* last_pool_output = nullptr;
+int last_pool_size = 0;
+
+int element_count(const tflite::Tensor* tensor) {
+  if (tensor->shape() == nullptr) {
+    return 0;
+  }
+  int count = 1;
+  for (const int32_t dim : *tensor->shape()) {
+    count *= dim;
+  }
+  return count;
+}
+
+// Number of operator inputs and subgraph outputs that read tensor
+int count_readers(const tflite::SubGraph* subgraph, int tensor) {
+  int readers = 0;
+  for (const tflite::Operator* op : *subgraph->operators()) {
+    for (const int32_t input : *op->inputs()) {
+      readers += input == tensor;
+    }
+  }
+  for (const int32_t output : *subgraph->outputs()) {
+    readers += output == tensor;
+  }
+  return readers;
+}
+
+tflite::BuiltinOperator builtin_code(const tflite::Model* model,
+                                     const tflite::Operator* op) {
+  return tflite::GetBuiltinCode(
+      model->operator_codes()->Get(op->opcode_index()));
+}
+
+PoolFusion* find_fusion(const int8_t* filter_data) {
+  for (int i = 0; i < num_fusions; ++i) {
+    if (fusions[i].filter_data == filter_data) {
+      return &fusions[i];
+    }
+  }
+  return nullptr;
+}
+
+}  // anonymous namespace
+
+void pool_fusion_plan_model(const tflite::Model* model) {
+  num_fusions = 0;
+  last_pool_output = nullptr;
+
+  // Only the main subgraph is invoked
+  const tflite::SubGraph* subgraph = model->subgraphs()->Get(0);
+  const auto* tensors = subgraph->tensors();
+  const auto* operators = subgraph->operators();
+  for (size_t j = 1; j < operators->size(); ++j) {
+    const tflite::Operator* fc = operators->Get(j);
+    if (builtin_code(model, fc) != tflite::BuiltinOperator_FULLY_CONNECTED ||
+        fc->inputs()->size() < 2) {
+      continue;
+    }
+    // The FC reads the pool output, or a RESHAPE of it that flattens
+    // [N, 1, 1, C] to [N, C] (the byte order does not change)
+    const tflite::Operator* pool = operators->Get(j - 1);
+    const tflite::Operator* reshape = nullptr;
+    if (j >= 2 &&
+        builtin_code(model, pool) == tflite::BuiltinOperator_RESHAPE) {
+      reshape = pool;
+      pool = operators->Get(j - 2);
+    }
+    if (builtin_code(model, pool) != tflite::BuiltinOperator_AVERAGE_POOL_2D ||
+        pool->outputs()->size() != 1) {
+      continue;
+    }
+
+    const int pool_output = pool->outputs()->Get(0);
+    int fc_input = pool_output;
+    if (reshape) {
+      if (reshape->inputs()->size() < 1 || reshape->outputs()->size() != 1 ||
+          reshape->inputs()->Get(0) != pool_output) {
+        continue;
+      }
+      fc_input = reshape->outputs()->Get(0);
+      if (count_readers(subgraph, fc_input) != 1 ||
+          tensors->Get(fc_input)->type() != tflite::TensorType_INT8 ||
+          element_count(tensors->Get(fc_input)) !=
+              element_count(tensors->Get(pool_output))) {
+        continue;
+      }
+    }
+    if (fc->inputs()->Get(0) != fc_input ||
+        count_readers(subgraph, pool_output) != 1) {
+      continue;
+    }
+    // int8, per-tensor FC, and a pooled vector that fits the buffer
+    const tflite::Tensor* input = tensors->Get(pool->inputs()->Get(0));
+    const tflite::Tensor* output = tensors->Get(fc->outputs()->Get(0));
+    const tflite::Tensor* filter = tensors->Get(fc->inputs()->Get(1));
+    if (input->type() != tflite::TensorType_INT8 ||
+        tensors->Get(pool_output)->type() != tflite::TensorType_INT8 ||
+        output->type() != tflite::TensorType_INT8 ||
+        filter->type() != tflite::TensorType_INT8 ||
+        element_count(tensors->Get(pool_output)) > POOL_FUSION_MAX_SIZE) {
+      continue;
+    }
+    if (filter->quantization() && filter->quantization()->scale() &&
+        filter->quantization()->scale()->size() > 1) {
+      continue;
+    }
+    const tflite::Buffer* buffer = model->buffers()->Get(filter->buffer());
+    if (buffer->data() == nullptr || buffer->data()->size() == 0) {
+      continue;
+    }
+    const int8_t* filter_data =
+        reinterpret_cast<const int8_t*>(buffer->data()->data());
+    if (find_fusion(filter_data)) {
+      // shared by several FCs, the kernel could not tell them apart
+      find_fusion(filter_data)->filter_data = nullptr;
+      continue;
+    }
+    if (num_fusions == POOL_FUSION_MAX) {
+      printf("pool_fusion: table full, op %d is not fused\n",
+             static_cast<int>(j));
+      continue;
+    }
+
+    PoolFusion& fusion = fusions[num_fusions++];
+    fusion = PoolFusion();
+    fusion.filter_data = filter_data;
+    fusion.reshaped = reshape != nullptr;
+  }
+  printf("Fusing %d average pool + fully connected pairs\n", num_fusions);
+}
+
+PoolFusion* pool_fusion_begin_pool(const int8_t* input_data,
+                                   size_t input_bytes, int8_t* output_data,
+                                   int output_size) {
+  for (int i = 0; i < num_fusions; ++i) {
+    PoolFusion& fusion = fusions[i];
+    if (fusion.filter_data == nullptr || !fusion.armed ||
+        fusion.pool_input != input_data || fusion.pool_output != output_data ||
+        fusion.pool_size != output_size) {
+      continue;
+    }
+    const int8_t* input_end = input_data + input_bytes;
+    const int8_t* fc_end = fusion.fc_output + fusion.batches * fusion.output_depth;
+    if (fusion.fc_output < input_end && input_data < fc_end) {
+      break;
+    }
+    fusion.done = true;
+    return &fusion;
+  }
+  last_pool_input = input_data;
+  last_pool_output = output_data;
+  last_pool_size = output_size;
+  return nullptr;
+}
+
+bool pool_fusion_fc(const tflite::FullyConnectedParams& params,
+                    const int8_t* input_data, const int8_t* filter_data,
+                    const int32_t* bias_data, int8_t* output_data,
+                    int batches, int output_depth, int accum_depth) {
+  PoolFusion* fusion = find_fusion(filter_data);
+  if (fusion == nullptr) {
+    return false;
+  }
+  if (fusion->done) {
+    fusion->done = false;
+    if (fusion->armed && fusion->fc_input == input_data &&
+        fusion->fc_output == output_data) {
+      return true;
+    }
+  }
+  // Through a RESHAPE the FC reads a copy of the pool output
+  if (last_pool_output == nullptr ||
+      (!fusion->reshaped && last_pool_output != input_data) ||
+      last_pool_size != batches * accum_depth ||
+      last_pool_size > POOL_FUSION_MAX_SIZE) {
+    fusion->armed = false;
+    return false;
+  }
+  fusion->pool_input = last_pool_input;
+  fusion->pool_output = last_pool_output;
+  fusion->pool_size = last_pool_size;
+  fusion->fc_input = input_data;
+  fusion->params = params;
+  fusion->bias_data = bias_data;
+  fusion->fc_output = output_data;
+  fusion->batches = batches;
+  fusion->output_depth = output_depth;
+  fusion->accum_depth = accum_depth;
+  fusion->armed = true;
+  last_pool_output = nullptr;
+  return false;
+}
+
+#endif // SKIP_TFLM
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * AveragePool + FullyConnected fusion.
+ *
+ * An AVERAGE_POOL_2D whose output is read only by the FULLY_CONNECTED right
+ * after it, or by a flattening RESHAPE read only by that FC (the global pool
+ * at the end of the ResNet, with or without model_converter.py dropping the
+ * RESHAPE), keeps the pooled vector in a small buffer of its own and runs
+ * the FC on it, into the FC output. The pool output is never written and
+ * the FC op does nothing; a RESHAPE in between copies a stale vector that
+ * nothing reads.
+ *
+ * As for residual_fusion.h, the pairs are found in the graph at model load
+ * and the FC parameters and arena addresses are recorded when the pair
+ * first runs unfused. The pool has no weights to be found by, so it is
+ * matched by its input and output addresses, which the FC takes from the
+ * last unfused pool. Writing the FC output one op early is safe as long as
+ * it does not overlap the pool input; the pool checks that before fusing.
+ */
+#ifndef _POOL_FUSION_H
+#define _POOL_FUSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tensorflow/lite/kernels/internal/types.h"
+
+#ifndef __cplusplus
+#error "pool_fusion.h is for C++ only"
+#endif
+
+#define POOL_FUSION_MAX 4
+// Largest pooled vector kept off the arena, in bytes
+#define POOL_FUSION_MAX_SIZE 1024
+
+namespace tflite {
+struct Model;
+}
+
+struct PoolFusion {
+  const int8_t* filter_data;  // of the FC, the key
+  bool reshaped;              // a RESHAPE sits between the pool and the FC
+  // Recorded by the first unfused run
+  const int8_t* pool_input;
+  int8_t* pool_output;
+  const int8_t* fc_input;     // pool_output, or the RESHAPE output
+  int pool_size;
+  tflite::FullyConnectedParams params;
+  const int32_t* bias_data;
+  int8_t* fc_output;
+  int batches;
+  int output_depth;
+  int accum_depth;
+  bool armed;
+  // The pool wrote the FC output in this invoke
+  bool done;
+};
+
+// Model preparation: find the AVERAGE_POOL_2D -> [RESHAPE ->]
+// FULLY_CONNECTED chains of the model. Called once from tflite_load_model().
+void pool_fusion_plan_model(const tflite::Model* model);
+
+// Pool side: the armed fusion of the pool reading input_bytes at input_data
+// into output_size bytes at output_data, if it is safe to do the FC now.
+// Otherwise nullptr, and the pool is recorded for the FC to arm the fusion.
+PoolFusion* pool_fusion_begin_pool(const int8_t* input_data,
+                                   size_t input_bytes, int8_t* output_data,
+                                   int output_size);
+
+// FC side: true if a fused pool already wrote output_data in this invoke,
+// so the FC has nothing to do. Otherwise arms the fusion of this FC if its
+// input is the output of the last pool.
+bool pool_fusion_fc(const tflite::FullyConnectedParams& params,
+                    const int8_t* input_data, const int8_t* filter_data,
+                    const int32_t* bias_data, int8_t* output_data,
+                    int batches, int output_depth, int accum_depth);
+
+#endif  // _POOL_FUSION_H
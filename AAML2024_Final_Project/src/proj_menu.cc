@@ -20,8 +20,13 @@
 
 // #include<ctime>
 #include "cfu.h"
+#include "cfu_memory.h"
+#include "cfu_profile.h"
 #include "menu.h"
 #include "perf.h"
+#include "playground_util/random.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/depthwise_conv.h"
+#include "tflite.h"
 #include "third_party/mlperf_tiny/api/internally_implemented.h"
 #include "third_party/mlperf_tiny/api/submitter_implemented.h"
 
@@ -41,11 +46,116 @@ void do_enter_mlperf_tiny(void){
   }
 }
 
+void load_model_once(void) {
+  static bool loaded = false;
+  if (!loaded) {
+    tflite_load_model(MLPERF_WORKLOAD_MODEL, MLPERF_WORKLOAD_MODEL_LEN);
+    loaded = true;
+  }
+}
+
+// Run one inference on a zero input and print its per-op cycles
+void do_profile_inference(bool json) {
+  load_model_once();
+  tflite_set_input_zeros();
+  cfu_profile_reset();
+  tflite_invoke();
+  printf("\n");
+  cfu_profile_dump(json);
+}
+
+void do_profile_csv(void) { do_profile_inference(false); }
+void do_profile_json(void) { do_profile_inference(true); }
+
+// Run one inference on a zero input and print its per-op memory use
+void do_memory_report(void) {
+  load_model_once();
+  tflite_set_input_zeros();
+  cfu_profile_reset();
+  cfu_memory_reset();
+  cfu_memory_enable(true);
+  tflite_invoke();
+  cfu_memory_enable(false);
+  printf("\n");
+  cfu_memory_dump(tflite_arena_used_bytes());
+}
+
+// A MobileNet-style 3x3 depthwise layer, stride 1, SAME padding, on random
+// data: cfuop_simd against the reference kernel, outputs and cycles
+#define DW_SIZE  16
+#define DW_DEPTH 32
+int8_t dw_input[DW_SIZE * DW_SIZE * DW_DEPTH];
+int8_t dw_filter[3 * 3 * DW_DEPTH];
+int32_t dw_bias[DW_DEPTH];
+int32_t dw_multiplier[DW_DEPTH];
+int32_t dw_shift[DW_DEPTH];
+int8_t dw_output_cfu[DW_SIZE * DW_SIZE * DW_DEPTH];
+int8_t dw_output_ref[DW_SIZE * DW_SIZE * DW_DEPTH];
+
+void do_depthwise_test(void) {
+  int64_t r = 1;
+  for (auto& v : dw_input) v = static_cast<int8_t>(next_pseudo_random(&r));
+  for (auto& v : dw_filter) v = static_cast<int8_t>(next_pseudo_random(&r));
+  for (int c = 0; c < DW_DEPTH; ++c) {
+    dw_bias[c] = static_cast<int32_t>(next_pseudo_random(&r) % 4096);
+    dw_multiplier[c] = (1 << 30) + static_cast<int32_t>(next_pseudo_random(&r) % (1 << 29));
+    dw_shift[c] = -8 - static_cast<int32_t>(next_pseudo_random(&r) % 3);
+  }
+
+  tflite::DepthwiseParams params = {};
+  params.padding_type = tflite::PaddingType::kSame;
+  params.padding_values.width = 1;
+  params.padding_values.height = 1;
+  params.stride_width = 1;
+  params.stride_height = 1;
+  params.dilation_width_factor = 1;
+  params.dilation_height_factor = 1;
+  params.depth_multiplier = 1;
+  params.input_offset = 128;
+  params.output_offset = -128;
+  params.quantized_activation_min = -128;
+  params.quantized_activation_max = 127;
+  const tflite::RuntimeShape io_shape({1, DW_SIZE, DW_SIZE, DW_DEPTH});
+  const tflite::RuntimeShape filter_shape({1, 3, 3, DW_DEPTH});
+  const tflite::RuntimeShape bias_shape({DW_DEPTH});
+
+  uint32_t start = perf_get_mcycle();
+  tflite::reference_integer_ops::DepthwiseConvPerChannelReference(
+      params, dw_multiplier, dw_shift, io_shape, dw_input, filter_shape,
+      dw_filter, bias_shape, dw_bias, io_shape, dw_output_ref);
+  const uint32_t ref_cycles = perf_get_mcycle() - start;
+  start = perf_get_mcycle();
+  tflite::reference_integer_ops::DepthwiseConvPerChannel(
+      params, dw_multiplier, dw_shift, io_shape, dw_input, filter_shape,
+      dw_filter, bias_shape, dw_bias, io_shape, dw_output_cfu);
+  const uint32_t cfu_cycles = std::max<uint32_t>(perf_get_mcycle() - start, 1);
+
+  int mismatches = 0, max_diff = 0;
+  for (size_t i = 0; i < sizeof(dw_output_ref); ++i) {
+    const int diff = dw_output_cfu[i] - dw_output_ref[i];
+    if (diff) {
+      ++mismatches;
+      max_diff = std::max(max_diff, diff < 0 ? -diff : diff);
+    }
+  }
+  printf("Depthwise 3x3, 1x%dx%dx%d\n", DW_SIZE, DW_SIZE, DW_DEPTH);
+  printf("  reference: %lu cycles\n", static_cast<unsigned long>(ref_cycles));
+  printf("  cfu:       %lu cycles (%lu.%02lux)\n", static_cast<unsigned long>(cfu_cycles),
+         static_cast<unsigned long>(ref_cycles / cfu_cycles),
+         static_cast<unsigned long>(ref_cycles % cfu_cycles * 100 / cfu_cycles));
+  printf("  %d of %d outputs differ, by at most %d\n", mismatches,
+         static_cast<int>(sizeof(dw_output_ref)), max_diff);
+}
+
 struct Menu MENU = {
     "Project Menu",
     "project",
     {
         MENU_ITEM('0', "Enter MLPerf Tiny Benchmark Interface", do_enter_mlperf_tiny),
+        MENU_ITEM('1', "Profile one inference, per-op cycles as CSV", do_profile_csv),
+        MENU_ITEM('2', "Profile one inference, per-op cycles as JSON", do_profile_json),
+        MENU_ITEM('3', "Profile one inference, per-op memory use", do_memory_report),
+        MENU_ITEM('4', "Depthwise conv: cfuop_simd vs reference cycles", do_depthwise_test),
         MENU_END,
     },
 };
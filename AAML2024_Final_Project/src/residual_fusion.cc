@@ -0,0 +1,177 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef  SKIP_TFLM
+
+#include "residual_fusion.h"
+
+#include <stdio.h>
+
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+namespace {
+
+ResidualFusion fusions[RESIDUAL_FUSION_MAX];
+int num_fusions = 0;
+
+bool same_shape(const tflite::Tensor* a, const tflite::Tensor* b) {
+  if (a->shape() == nullptr || b->shape() == nullptr ||
+      a->shape()->size() != b->shape()->size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a->shape()->size(); ++i) {
+    if (a->shape()->Get(i) != b->shape()->Get(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Number of operator inputs and subgraph outputs that read tensor
+int count_readers(const tflite::SubGraph* subgraph, int tensor) {
+  int readers = 0;
+  for (const tflite::Operator* op : *subgraph->operators()) {
+    for (const int32_t input : *op->inputs()) {
+      readers += input == tensor;
+    }
+  }
+  for (const int32_t output : *subgraph->outputs()) {
+    readers += output == tensor;
+  }
+  return readers;
+}
+
+}  // anonymous namespace
+
+void residual_fusion_plan_model(const tflite::Model* model) {
+  num_fusions = 0;
+
+  // Only the main subgraph is invoked
+  const tflite::SubGraph* subgraph = model->subgraphs()->Get(0);
+  const auto* tensors = subgraph->tensors();
+  const auto* operators = subgraph->operators();
+  for (size_t j = 1; j < operators->size(); ++j) {
+    const tflite::Operator* add = operators->Get(j);
+    const tflite::Operator* conv = operators->Get(j - 1);
+    if (tflite::GetBuiltinCode(model->operator_codes()->Get(add->opcode_index())) !=
+            tflite::BuiltinOperator_ADD ||
+        tflite::GetBuiltinCode(model->operator_codes()->Get(conv->opcode_index())) !=
+            tflite::BuiltinOperator_CONV_2D ||
+        add->inputs()->size() != 2 || conv->outputs()->size() != 1) {
+      continue;
+    }
+
+    const int conv_output = conv->outputs()->Get(0);
+    const int input1 = add->inputs()->Get(0);
+    const int input2 = add->inputs()->Get(1);
+    if ((input1 == conv_output) == (input2 == conv_output) ||
+        count_readers(subgraph, conv_output) != 1) {
+      continue;
+    }
+    // int8, and no broadcast
+    const tflite::Tensor* output = tensors->Get(add->outputs()->Get(0));
+    const tflite::Tensor* shortcut = tensors->Get(input1 == conv_output ? input2 : input1);
+    const tflite::Tensor* filter = tensors->Get(conv->inputs()->Get(1));
+    if (tensors->Get(conv_output)->type() != tflite::TensorType_INT8 ||
+        shortcut->type() != tflite::TensorType_INT8 ||
+        output->type() != tflite::TensorType_INT8 ||
+        !same_shape(tensors->Get(conv_output), output) || !same_shape(shortcut, output)) {
+      continue;
+    }
+    const tflite::Buffer* buffer = model->buffers()->Get(filter->buffer());
+    if (buffer->data() == nullptr || buffer->data()->size() == 0) {
+      continue;
+    }
+    const int8_t* filter_data =
+        reinterpret_cast<const int8_t*>(buffer->data()->data());
+    if (residual_fusion_find(filter_data)) {
+      // shared by several convs, the kernel could not tell them apart
+      residual_fusion_find(filter_data)->filter_data = nullptr;
+      continue;
+    }
+    if (num_fusions == RESIDUAL_FUSION_MAX) {
+      printf("residual_fusion: table full, op %d is not fused\n",
+             static_cast<int>(j));
+      continue;
+    }
+
+    ResidualFusion& fusion = fusions[num_fusions++];
+    fusion = ResidualFusion();
+    fusion.filter_data = filter_data;
+    fusion.conv_is_input1 = input1 == conv_output;
+  }
+  printf("Fusing %d conv + add pairs\n", num_fusions);
+}
+
+ResidualFusion* residual_fusion_find(const int8_t* filter_data) {
+  for (int i = 0; i < num_fusions; ++i) {
+    if (fusions[i].filter_data == filter_data) {
+      return &fusions[i];
+    }
+  }
+  return nullptr;
+}
+
+bool residual_fusion_begin_conv(ResidualFusion* fusion, int8_t* output_data,
+                                const int8_t* input_data, size_t input_bytes,
+                                int output_size) {
+  if (!fusion->armed || fusion->conv_output != output_data ||
+      fusion->size != output_size) {
+    fusion->conv_output = output_data;
+    fusion->armed = false;
+    return false;
+  }
+  const int8_t* input_end = input_data + input_bytes;
+  const int8_t* add_end = fusion->add_output + fusion->size;
+  if (fusion->add_output < input_end && input_data < add_end) {
+    return false;
+  }
+  fusion->done = true;
+  return true;
+}
+
+bool residual_fusion_add(const tflite::ArithmeticParams& params,
+                         const int8_t* input1_data, const int8_t* input2_data,
+                         int8_t* output_data, int size) {
+  for (int i = 0; i < num_fusions; ++i) {
+    ResidualFusion& fusion = fusions[i];
+    if (fusion.filter_data == nullptr || fusion.conv_output == nullptr) {
+      continue;
+    }
+    const int8_t* conv_input = fusion.conv_is_input1 ? input1_data : input2_data;
+    const int8_t* other_input = fusion.conv_is_input1 ? input2_data : input1_data;
+    if (conv_input != fusion.conv_output) {
+      continue;
+    }
+    if (fusion.done) {
+      fusion.done = false;
+      if (fusion.armed && fusion.add_output == output_data &&
+          fusion.shortcut == other_input && fusion.size == size) {
+        return true;
+      }
+    }
+    fusion.shortcut = other_input;
+    fusion.add_output = output_data;
+    fusion.size = size;
+    fusion.params = params;
+    fusion.armed = true;
+    return false;
+  }
+  return false;
+}
+
+#endif // SKIP_TFLM
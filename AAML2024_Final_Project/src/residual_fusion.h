@@ -0,0 +1,86 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Conv + residual Add fusion.
+ *
+ * A CONV_2D whose output is read only by the ADD right after it (the last
+ * conv of a ResNet block, or its shortcut conv) does the add in its
+ * epilogue: each requantized output word goes through cfuop_add with the
+ * other ADD input and is stored straight into the ADD output. The conv
+ * output is never written and the ADD op does nothing.
+ *
+ * The pairs are found in the graph at model load. The ADD parameters and the
+ * arena addresses are recorded when the pair first runs unfused, so the
+ * first invoke is a plain one and the later ones are fused. Writing the ADD
+ * output one op early is safe as long as it does not overlap the conv input,
+ * the only tensor that is live during the conv but not during the ADD; the
+ * conv checks that before fusing.
+ */
+#ifndef _RESIDUAL_FUSION_H
+#define _RESIDUAL_FUSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tensorflow/lite/kernels/internal/types.h"
+
+#ifndef __cplusplus
+#error "residual_fusion.h is for C++ only"
+#endif
+
+#define RESIDUAL_FUSION_MAX 32
+
+namespace tflite {
+struct Model;
+}
+
+struct ResidualFusion {
+  const int8_t* filter_data;  // of the conv, the key
+  bool conv_is_input1;        // the conv output is input 1 of the ADD
+  // Recorded by the first unfused run
+  int8_t* conv_output;
+  const int8_t* shortcut;     // the other ADD input
+  int8_t* add_output;
+  int size;
+  tflite::ArithmeticParams params;
+  bool armed;
+  // The conv wrote the ADD output in this invoke
+  bool done;
+};
+
+// Model preparation: find the CONV_2D -> ADD pairs of the model.
+// Called once from tflite_load_model().
+void residual_fusion_plan_model(const tflite::Model* model);
+
+// Fusion of the conv with this filter, or nullptr
+ResidualFusion* residual_fusion_find(const int8_t* filter_data);
+
+// Conv side: true if the conv writing output_data from the input_bytes at
+// input_data can do the ADD (the fusion is armed and safe). Otherwise the
+// output is recorded for the ADD to arm the fusion.
+bool residual_fusion_begin_conv(ResidualFusion* fusion, int8_t* output_data,
+                                const int8_t* input_data, size_t input_bytes,
+                                int output_size);
+
+// ADD side: true if a fused conv already wrote output_data in this invoke,
+// so the ADD has nothing to do. Otherwise arms the fusion of the conv that
+// produced one of the inputs, if any.
+bool residual_fusion_add(const tflite::ArithmeticParams& params,
+                         const int8_t* input1_data, const int8_t* input2_data,
+                         int8_t* output_data, int size);
+
+#endif  // _RESIDUAL_FUSION_H
@@ -0,0 +1,806 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "cfu_config.h"
+#include "cfu_profile.h"
+#include "software_cfu.h"
+
+//
+// In this function, place C code to emulate your CFU. You can switch between
+// hardware and emulated CFU by setting the CFU_SOFTWARE_DEFINED DEFINE in
+// the Makefile.
+//
+// AAML: bit-exact model of cfu.v (cfuop_sa, cfuop_add, cfuop_simd,
+// cfuop_softmax, cfuop_act, cfuop_pool) with a
+// cycle-approximate clock. The clock only advances on CFU ops: every op takes
+// its response latency, and ops that wait for the GEMM unit stall until the
+// running tile is done. A tile is computed when it starts; touching its banks
+// before it is done is reported as a hazard, as it would corrupt the hardware
+// result.
+//
+// The trace has one line per op, "funct3 funct7 rs1 rs2 rsp" in hex, and a
+// "# op <index> <tag>" line when the running op changes.
+namespace {
+
+#define CFUOP_SA   0
+#define CFUOP_ADD  1
+#define CFUOP_SIMD 2
+#define CFUOP_SOFTMAX 3
+#define CFUOP_ACT  4
+#define CFUOP_POOL 5
+
+// cfuop_sa function7 (see cfuop_sa.v)
+#define SA_READ_CONFIG   0x00
+#define SA_WRITE_CONFIG  0x40
+#define SA_WRITE_QPARAM  0x42
+#define SA_READ_BUFF_A   0x10
+#define SA_WRITE_BUFF_A  0x50
+#define SA_READ_BUFF_B   0x20
+#define SA_WRITE_BUFF_B  0x60
+#define SA_READ_BUFF_C   0x30
+#define SA_WRITE_BUFF_C  0x70
+#define SA_READ_BUFF_C_Q 0x32
+#define SA_COMPUTE       0x01
+#define SA_COMPUTE_ASYNC 0x03
+
+#define SA_FLAG_ACCUMULATE 0x1
+#define SA_FLAG_BANK_A     0x2
+#define SA_FLAG_BANK_B     0x4
+#define SA_FLAG_BANK_C     0x8
+
+constexpr int kSize = CFU_SA_SIZE;
+constexpr int kLaneWords = CFU_GEMM_LANE_WORDS;
+constexpr int kBankWords = CFU_GEMM_BANK_WORDS;
+constexpr int kQparamChannels = 1 << CFU_QPARAM_CH_BITS;
+constexpr uint32_t kDimMask = (1u << CFU_DIM_BITS) - 1;
+
+// CFU clock, never reset (the GEMM unit may be busy across a stats reset)
+uint64_t cycles = 0;
+uint64_t stats_cycles_base = 0;
+uint64_t ops = 0;
+
+inline int8_t byte_of(uint32_t word, int i) {
+  return static_cast<int8_t>(word >> (8 * i));
+}
+
+// Requantization shared by cfuop_simd and the post_process unit of cfuop_sa
+inline int32_t requant(int32_t total_sum, int32_t multiplier, int32_t shift,
+                       int32_t offset, int32_t act_min, int32_t act_max) {
+  int64_t raw = static_cast<int64_t>(total_sum) * multiplier +
+                (static_cast<int64_t>(1) << (30 - shift));
+  int32_t out = static_cast<int32_t>(raw >> (31 - shift)) + offset;
+  out = out > act_min ? out : act_min;
+  return out < act_max ? out : act_max;
+}
+
+//
+// cfuop_sa: double-buffered GEMM unit with requantization on readback
+class SystolicArray {
+ public:
+  uint32_t op(int funct7, uint32_t rs1, uint32_t rs2) {
+    const int bank = (rs2 >> CFU_BANK_BIT) & 1;
+    switch (funct7) {
+      case SA_WRITE_CONFIG:
+        write_config(rs2 & 7, rs1);
+        return done(1, 0);
+      case SA_READ_CONFIG:
+        return done(1, read_config(rs2 & 7));
+      case SA_WRITE_QPARAM:
+        write_qparam((rs2 >> 8) & 3, rs2 & (kQparamChannels - 1), rs1);
+        return done(1, 0);
+      case SA_WRITE_BUFF_A:
+        check(bank, SA_FLAG_BANK_A, "BUFF_A write");
+        a_[bank][rs2 & (kBankWords * kLaneWords - 1)] = rs1;
+        return done(1, 0);
+      case SA_READ_BUFF_A:
+        return done(1, a_[bank][rs2 & (kBankWords * kLaneWords - 1)]);
+      case SA_WRITE_BUFF_B:
+        check(bank, SA_FLAG_BANK_B, "BUFF_B write");
+        b_[bank][rs2 & (kBankWords * kLaneWords - 1)] = rs1;
+        return done(1, 0);
+      case SA_READ_BUFF_B:
+        return done(1, b_[bank][rs2 & (kBankWords * kLaneWords - 1)]);
+      case SA_WRITE_BUFF_C: {
+        check(bank, SA_FLAG_BANK_C, "BUFF_C write");
+        int32_t* word = c_[bank][rs2 & (kBankWords - 1)];
+        for (int lane = 0; lane < kSize; ++lane) {
+          word[lane] = lane == kSize - 1 ? static_cast<int32_t>(rs1) : 0;
+        }
+        return done(1, 0);
+      }
+      case SA_READ_BUFF_C:
+        check(bank, SA_FLAG_BANK_C, "BUFF_C read");
+        return done(1, c_[bank][rs2 & (kBankWords - 1)][rs1 & (kSize - 1)]);
+      case SA_READ_BUFF_C_Q:
+        check(bank, SA_FLAG_BANK_C, "BUFF_C read");
+        return done(5, read_quant(c_[bank][rs2 & (kBankWords - 1)], rs1));
+      case SA_COMPUTE:
+      case SA_COMPUTE_ASYNC: {
+        // wait for the running tile
+        if (cycles < busy_until_) {
+          cycles = busy_until_;
+        }
+        busy_until_ = cycles + 1 + compute();
+        return funct7 == SA_COMPUTE ? done(busy_until_ - cycles, 0) : done(1, 0);
+      }
+      default:
+        return done(1, 0);
+    }
+  }
+
+ private:
+  // Response latency and output
+  uint32_t done(uint64_t latency, uint32_t output) {
+    cycles += latency;
+    return output;
+  }
+
+  bool busy() const { return cycles < busy_until_; }
+
+  // The host may only use the banks the running tile does not own
+  void check(int bank, int flag, const char* what) {
+    if (busy() && bank == ((comp_flag_ & flag) ? 1 : 0)) {
+      printf("software_cfu: %s of bank %d while the GEMM unit uses it\n", what, bank);
+    }
+  }
+
+  void write_config(int offset, uint32_t value) {
+    switch (offset) {
+      case 0: k_ = value & kDimMask; break;
+      case 1: m_ = value & kDimMask; break;
+      case 2: n_ = value & kDimMask; break;
+      // 9-bit signed input offset
+      case 3: offset_ = static_cast<int32_t>(value << 23) >> 23; break;
+      case 4: flag_ = value & 0xf; break;
+    }
+  }
+
+  uint32_t read_config(int offset) const {
+    switch (offset) {
+      case 0: return k_;
+      case 1: return m_;
+      case 2: return n_;
+      case 3: return static_cast<uint32_t>(offset_) & 0x1ff;
+      case 4: return flag_;
+      case 5: return busy() ? 1 : 0;
+      default: return 0;
+    }
+  }
+
+  void write_qparam(int table, int channel, uint32_t value) {
+    switch (table) {
+      case 0: bias_[channel] = value; break;
+      case 1: mult_[channel] = value; break;
+      case 2: shift_[channel] = static_cast<int8_t>(value); break;
+      case 3:
+        switch (channel & 3) {
+          case 0: output_offset_ = value; break;
+          case 1: output_min_ = value; break;
+          case 2: output_max_ = value; break;
+        }
+        break;
+    }
+  }
+
+  // 4 lanes of the C word starting at lane (channel % kSize), lane 0 in the LSB
+  uint32_t read_quant(const int32_t* word, uint32_t channel) const {
+    const int group = (channel & (kSize - 1)) / 4;
+    uint32_t result = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+      const int ch = (channel + lane) & (kQparamChannels - 1);
+      const int32_t total_sum = word[group * 4 + lane] + bias_[ch];
+      const int32_t q = requant(total_sum, mult_[ch], shift_[ch], output_offset_,
+                                output_min_, output_max_);
+      result |= static_cast<uint32_t>(q & 0xff) << (8 * lane);
+    }
+    return result;
+  }
+
+  // Run the tile configured now; returns its latency in cycles
+  uint64_t compute() {
+    comp_flag_ = flag_;
+    const int a_bank = (flag_ & SA_FLAG_BANK_A) ? 1 : 0;
+    const int b_bank = (flag_ & SA_FLAG_BANK_B) ? 1 : 0;
+    const int c_bank = (flag_ & SA_FLAG_BANK_C) ? 1 : 0;
+    const bool accumulate = flag_ & SA_FLAG_ACCUMULATE;
+    const int k = k_, m = m_, n = n_;
+    const int row_groups = (m + kSize - 1) / kSize;
+    const int col_groups = (n + kSize - 1) / kSize;
+    // The PEs multiply the raw A when the offset is folded into the bias
+    const int32_t offset = CFU_FOLD_INPUT_OFFSET ? 0 : offset_;
+    int addr = 0;
+    for (int j = 0; j < col_groups; ++j) {
+      for (int g = 0; g < row_groups; ++g) {
+        for (int r = 0; r < kSize && kSize * g + r < m; ++r, ++addr) {
+          int32_t* word = c_[c_bank][addr & (kBankWords - 1)];
+          for (int lane = 0; lane < kSize; ++lane) {
+            int32_t acc = 0;
+            for (int kk = 0; kk < k; ++kk) {
+              const uint32_t a = a_[a_bank][((g * k + kk) * kLaneWords + r / 4) & (kBankWords * kLaneWords - 1)];
+              const uint32_t b = b_[b_bank][((j * k + kk) * kLaneWords + lane / 4) & (kBankWords * kLaneWords - 1)];
+              acc += (byte_of(a, 3 - r % 4) + offset) * byte_of(b, 3 - lane % 4);
+            }
+            word[lane] = accumulate ? word[lane] + acc : acc;
+          }
+        }
+      }
+    }
+    // K cycles to feed a pass, 2 * kSize to drain the array
+    return 2 + static_cast<uint64_t>(row_groups) * col_groups * (k + 2 * kSize + 1);
+  }
+
+  uint32_t a_[2][kBankWords * kLaneWords] = {};
+  uint32_t b_[2][kBankWords * kLaneWords] = {};
+  int32_t c_[2][kBankWords][kSize] = {};
+  uint32_t k_ = 0, m_ = 0, n_ = 0, flag_ = 0, comp_flag_ = 0;
+  int32_t offset_ = 0;
+  uint64_t busy_until_ = 0;
+  int32_t bias_[kQparamChannels] = {};
+  int32_t mult_[kQparamChannels] = {};
+  int32_t shift_[kQparamChannels] = {};
+  int32_t output_offset_ = 0, output_min_ = -128, output_max_ = 127;
+};
+
+//
+// cfuop_add: 4-lane int8 add with the requantization of the ADD ops, and a
+// broadcast operand that wraps at its period
+class Add {
+ public:
+  uint32_t op(int funct7, uint32_t rs1, uint32_t rs2) {
+    switch (funct7) {
+      case 0:
+        input1_offset_ = static_cast<int16_t>(rs1 >> 16);
+        input2_offset_ = static_cast<int16_t>(rs1);
+        output_shift_ = static_cast<int32_t>(rs2);
+        cycles += 1;
+        break;
+      case 1:
+        input1_multiplier_ = static_cast<int32_t>(rs1);
+        output_multiplier_ = static_cast<int32_t>(rs2);
+        cycles += 1;
+        break;
+      case 2:
+        add4(rs1, rs2);
+        break;
+      case 3:
+        bcast_[rs2 & (kBcastWords - 1)] = rs1;
+        cycles += 1;
+        break;
+      case 4:
+        bcast_last_ = (rs1 - 1) & (kBcastWords - 1);
+        bcast_input1_ = rs2 & 1;
+        bcast_ptr_ = 0;
+        cycles += 1;
+        break;
+      case 5: {
+        const uint32_t bcast = bcast_[bcast_ptr_];
+        bcast_ptr_ = bcast_ptr_ == bcast_last_ ? 0 : (bcast_ptr_ + 1) & (kBcastWords - 1);
+        if (bcast_input1_) {
+          add4(bcast, rs1);
+        } else {
+          add4(rs1, bcast);
+        }
+        break;
+      }
+      case 6:
+        input2_multiplier_ = static_cast<int32_t>(rs1);
+        input1_shift_ = static_cast<int8_t>(rs2);
+        input2_shift_ = static_cast<int8_t>(rs2 >> 8);
+        left_shift_ = (rs2 >> 16) & 31;
+        cycles += 1;
+        break;
+      case 7:
+        output_offset_ = static_cast<int32_t>(rs1);
+        act_min_ = static_cast<int16_t>(rs2);
+        act_max_ = static_cast<int16_t>(rs2 >> 16);
+        cycles += 1;
+        break;
+      default:
+        // unknown ops never respond in hardware
+        break;
+    }
+    return rsp_;
+  }
+
+ private:
+  static constexpr int kBcastWords = 64;
+
+  // Input rescaling, same rounding as the output requantization
+  static int32_t scale(int32_t x, int32_t multiplier, int32_t shift) {
+    return static_cast<int32_t>((static_cast<int64_t>(x) * multiplier +
+                                 (static_cast<int64_t>(1) << (30 - shift))) >> (31 - shift));
+  }
+
+  void add4(uint32_t x_val, uint32_t y_val) {
+    rsp_ = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+      const int32_t x = (byte_of(x_val, lane) + input1_offset_) * (1 << left_shift_);
+      const int32_t y = (byte_of(y_val, lane) + input2_offset_) * (1 << left_shift_);
+      const int32_t raw_sum = scale(x, input1_multiplier_, input1_shift_) +
+                              scale(y, input2_multiplier_, input2_shift_);
+      const int32_t q = requant(raw_sum, output_multiplier_, output_shift_, output_offset_,
+                                act_min_, act_max_);
+      rsp_ |= static_cast<uint32_t>(q & 0xff) << (8 * lane);
+    }
+    cycles += 7;
+  }
+
+  int32_t input1_offset_ = 0, input2_offset_ = 0, output_shift_ = 0;
+  int32_t input1_multiplier_ = 0, output_multiplier_ = 0;
+  // Reset values of cfuop_add.v
+  int32_t input2_multiplier_ = 1 << 30, input1_shift_ = -2, input2_shift_ = 0;
+  int left_shift_ = 20;
+  int32_t output_offset_ = -128, act_min_ = -128, act_max_ = 127;
+  uint32_t bcast_[kBcastWords] = {};
+  uint32_t bcast_ptr_ = 0, bcast_last_ = 0, bcast_input1_ = 0;
+  uint32_t rsp_ = 0;
+};
+
+//
+// cfuop_simd: 4-way MAC with a settable input offset (128 after reset) and
+// the conv requantization,
+// and a lane-wise MAC with one accumulator per lane (depthwise conv)
+class Simd {
+ public:
+  uint32_t op(int funct7, uint32_t rs1, uint32_t rs2) {
+    switch (funct7) {
+      case 0:
+        total_sum_ = 0;
+        cycles += 1;
+        break;
+      case 1:
+        for (int i = 0; i < 4; ++i) {
+          total_sum_ += (byte_of(rs1, i) + mac_offset()) * byte_of(rs2, i);
+        }
+        rsp_ = total_sum_;
+        cycles += 1;
+        break;
+      case 2:
+        bias_ = static_cast<int32_t>(rs1);
+        output_offset_ = static_cast<int32_t>(rs2);
+        cycles += 1;
+        break;
+      case 3:
+        // total_sum keeps the bias, as in the ADD_BIAS state
+        total_sum_ += bias_;
+        rsp_ = requant(total_sum_, static_cast<int32_t>(rs1), static_cast<int32_t>(rs2),
+                       output_offset_, -128, 127);
+        cycles += 6;
+        break;
+      case 4:
+        total_sum_ = static_cast<int32_t>(rs1);
+        cycles += 1;
+        break;
+      case 5:
+        for (int i = 0; i < 4; ++i) {
+          lane_sum_[i] = 0;
+        }
+        cycles += 1;
+        break;
+      case 6:
+        for (int i = 0; i < 4; ++i) {
+          lane_sum_[i] += (byte_of(rs1, i) + mac_offset()) * byte_of(rs2, i);
+        }
+        cycles += 1;
+        break;
+      case 7:
+        total_sum_ = lane_sum_[rs1 & 3];
+        rsp_ = total_sum_;
+        cycles += 1;
+        break;
+      case 8:
+        // 9-bit signed register
+        input_offset_ = static_cast<int32_t>(rs1 << 23) >> 23;
+        cycles += 1;
+        break;
+      default:
+        break;
+    }
+    return rsp_;
+  }
+
+ private:
+  // The MACs take the raw input when the offset is folded into the bias
+  int32_t mac_offset() const { return CFU_FOLD_INPUT_OFFSET ? 0 : input_offset_; }
+
+  int32_t total_sum_ = 0, bias_ = 0, output_offset_ = 0;
+  int32_t lane_sum_[4] = {};
+  int32_t input_offset_ = 128;
+  uint32_t rsp_ = 0;
+};
+
+//
+// cfuop_softmax: exp() LUT, row sum and reciprocal of reference_ops::Softmax
+constexpr int kSoftmaxLutSize = 68;
+constexpr int kSoftmaxRecipBits = 50;
+
+// The exp() LUT of cfuop_softmax.v: points in Q5.26, values in Q0.31, slopes
+// with 24 fractional bits
+const int32_t kSoftmaxLutX[kSoftmaxLutSize] = {
+    -0x24000000, -0x20000000, -0x1c000000, -0x18000000, -0x14000000, -0x12000000,
+    -0x10000000, -0x0e000000, -0x0c000000, -0x0b000000, -0x0a000000, -0x09000000,
+    -0x08000000, -0x067ae148, -0x05ae147b, -0x04e147ae, -0x043d70a2, -0x04147ae2,
+    -0x04000000, -0x03ae147b, -0x0399999a, -0x03851eb9, -0x03666667, -0x0347ae15,
+    -0x03333333, -0x031eb852, -0x03000000, -0x02e147ae, -0x02cccccd, -0x02b851ec,
+    -0x0299999a, -0x027ae148, -0x02666667, -0x0251eb85, -0x02333333, -0x02147ae2,
+    -0x02000000, -0x01e147ae, -0x01cccccd, -0x01ae147b, -0x0199999a, -0x017ae148,
+    -0x01666667, -0x0147ae15, -0x01333333, -0x01147ae2, -0x01000000, -0x00e147ae,
+    -0x00cccccd, -0x00bd70a4, -0x00a8f5c3, -0x0099999a, -0x00666667, -0x00570a3e,
+    -0x0047ae15, -0x00333333, -0x0028f5c3, -0x001eb852, -0x00147ae2, -0x00116873,
+    -0x000f5c29, -0x000d4fdf, -0x000a3d71, -0x0009374c, -0x00072b02, -0x00051eb9,
+    -0x0003126f, 0x00000000,
+};
+const uint32_t kSoftmaxLutY[kSoftmaxLutSize] = {
+    0x00040b3d, 0x000afe11, 0x001de16c, 0x00513948, 0x00dcc9ff, 0x016c0504,
+    0x02582ab7, 0x03dd8203, 0x065f6c33, 0x082ec9c5, 0x0a81c2e0, 0x0d7db8c7,
+    0x1152aaa4, 0x1954be9a, 0x1ef07c22, 0x25ca1a25, 0x2c58aa10, 0x2e27f991,
+    0x2f16ac6c, 0x3302ac03, 0x340a797b, 0x35179b37, 0x36b58849, 0x38601079,
+    0x39839c8e, 0x3aad0c54, 0x3c7681d8, 0x3e4de5e0, 0x3f901b71, 0x40d8d353,
+    0x42d2655a, 0x44db5cfe, 0x463f75a4, 0x47aabfed, 0x49d97dcf, 0x4c193fc5,
+    0x4da2cbf2, 0x50001309, 0x519dcc99, 0x541a1c33, 0x55cd0c11, 0x5869fb81,
+    0x5a333818, 0x5cf27393, 0x5ed321ac, 0x61b66b44, 0x63afbe7b, 0x66b8ef9e,
+    0x68cc2b53, 0x6a61a007, 0x6c87c7dd, 0x6e2badc6, 0x73d1b656, 0x7591cf6f,
+    0x7758ae32, 0x79c1e2c9, 0x7afb25ec, 0x7c378f28, 0x7d772658, 0x7dd7a6f1,
+    0x7e1825e4, 0x7e58c5e6, 0x7eb9f3e9, 0x7eda6939, 0x7f1b6ccb, 0x7f5c918f,
+    0x7f9dd7d6, 0x7fffffff,
+};
+const uint32_t kSoftmaxLutSlope[kSoftmaxLutSize] = {
+    0x0001bcb5, 0x0004b8d7, 0x000cd5f7, 0x0022e42e, 0x00479d82, 0x007612da,
+    0x00c2aba6, 0x0140f518, 0x01cf5d92, 0x0252f91b, 0x02fbf5e7, 0x03d4f1dd,
+    0x0544bc4b, 0x0702ace8, 0x08900582, 0x0a3ec0c3, 0x0b4fb19b, 0x0ba7bb49,
+    0x0c417ebc, 0x0ce18889, 0x0d2425dc, 0x0d796238, 0x0de26edc, 0x0e3c5686,
+    0x0e85f55e, 0x0ee42897, 0x0f58418e, 0x0fbb9dcc, 0x100cfac1, 0x1075162f,
+    0x10f564f6, 0x11633458, 0x11bd1ff1, 0x12302e4f, 0x12bdfb92, 0x13375786,
+    0x13b3fb08, 0x14338fcf, 0x14b6974b, 0x153cb6a1, 0x15c675ec, 0x165375ae,
+    0x16e444f2, 0x17787f65, 0x1810bb56, 0x18ac8f51, 0x194c9968, 0x19f06ab1,
+    0x1a6598fc, 0x1adcf251, 0x1b564d19, 0x1c3e2aec, 0x1d2c4ce3, 0x1d9d2b49,
+    0x1e231050, 0x1e979054, 0x1ee645c6, 0x1f35c5a3, 0x1f69d84d, 0x1f7df878,
+    0x1f8e1cc9, 0x1fa255bd, 0x1fb28bea, 0x1fbeba13, 0x1fceff03, 0x1fdf4c6f,
+    0x1ff3b91a, 0x00000000,
+};
+
+class Softmax {
+ public:
+  uint32_t op(int funct7, uint32_t rs1, uint32_t rs2) {
+    switch (funct7) {
+      case 0:
+        beta_multiplier_ = static_cast<int32_t>(rs1);
+        beta_left_shift_ = rs2 & 31;
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 1:
+        max_in_row_ = byte_of(rs1, 0);
+        diff_min_ = static_cast<int32_t>(rs2);
+        sum_ = 0;
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 2:
+        for (int lane = 0; lane < 4; ++lane) {
+          if (lane == 0 || rs2 > static_cast<uint32_t>(lane)) {
+            sum_ += (exp_of(byte_of(rs1, lane)) + 2048) >> 12;
+          }
+        }
+        rsp_ = sum_;
+        cycles += 7;
+        break;
+      case 3: {
+        const uint64_t quot = sum_ ? (static_cast<uint64_t>(1) << kSoftmaxRecipBits) / sum_
+                                   : (static_cast<uint64_t>(1) << (kSoftmaxRecipBits + 1)) - 1;
+        reciprocal_ = quot > 0xffffffffu ? 0xffffffffu : static_cast<uint32_t>(quot);
+        rsp_ = reciprocal_;
+        cycles += kSoftmaxRecipBits + 3;
+        break;
+      }
+      case 4:
+        rsp_ = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+          const uint64_t prob =
+              (static_cast<uint64_t>(exp_of(byte_of(rs1, lane))) * reciprocal_ +
+               (static_cast<uint64_t>(1) << 53)) >> 54;
+          const uint32_t q = prob > 255 ? 127 : static_cast<uint32_t>(prob) - 128;
+          rsp_ |= (q & 0xff) << (8 * lane);
+        }
+        cycles += 7;
+        break;
+      default:
+        rsp_ = 0;
+        cycles += 1;
+        break;
+    }
+    return rsp_;
+  }
+
+ private:
+  // Q0.31 exp of the scaled diff of x, 0 below diff_min or the LUT
+  uint32_t exp_of(int8_t x) const {
+    const int32_t diff = x - max_in_row_;
+    if (diff < diff_min_) {
+      return 0;
+    }
+    const int64_t prod = (static_cast<int64_t>(diff) * beta_multiplier_) << beta_left_shift_;
+    const int32_t scaled = static_cast<int32_t>(-((-prod + (1ll << 30) - 1) >> 31));
+    if (scaled < kSoftmaxLutX[0]) {
+      return 0;
+    }
+    int seg = 0;
+    for (int i = 1; i < kSoftmaxLutSize; ++i) {
+      if (scaled >= kSoftmaxLutX[i]) {
+        seg = i;
+      }
+    }
+    const int64_t step = static_cast<int64_t>(kSoftmaxLutSlope[seg]) *
+                             (static_cast<int64_t>(scaled) - kSoftmaxLutX[seg]) +
+                         (1 << 23);
+    return kSoftmaxLutY[seg] + static_cast<uint32_t>(step >> 24);
+  }
+
+  int32_t beta_multiplier_ = 0, max_in_row_ = 0, diff_min_ = 0;
+  int beta_left_shift_ = 0;
+  uint32_t sum_ = 0, reciprocal_ = 0;
+  uint32_t rsp_ = 0;
+};
+
+//
+// cfuop_act: loadable table, int8 lookup or the int16 logistic/tanh
+// interpolation of reference_integer_ops
+class Act {
+ public:
+  uint32_t op(int funct7, uint32_t rs1, uint32_t rs2) {
+    switch (funct7) {
+      case 0:
+        table_[rs1 & (kTableWords - 1)] = rs2;
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 1:
+        rsp_ = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+          const uint32_t index = ((rs1 >> (8 * lane)) ^ 0x80) & 0xff;
+          const uint32_t q = (table_[index >> 2] >> (8 * (index & 3))) & 0xff;
+          rsp_ |= q << (8 * lane);
+        }
+        cycles += 1;
+        break;
+      case 2:
+        input_multiplier_ = static_cast<int32_t>(rs1);
+        input_left_shift_ = rs2 & 31;
+        tanh_ = (rs2 >> 8) & 1;
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 3:
+        rsp_ = 0;
+        for (int lane = 0; lane < 2; ++lane) {
+          const int16_t x = static_cast<int16_t>(rs1 >> (16 * lane));
+          rsp_ |= (eval(x) & 0xffff) << (16 * lane);
+        }
+        cycles += 6;
+        break;
+      default:
+        rsp_ = 0;
+        cycles += 1;
+        break;
+    }
+    return rsp_;
+  }
+
+ private:
+  static constexpr int kTableWords = 128;
+
+  uint32_t half(uint32_t index) const {
+    return (table_[(index >> 1) & (kTableWords - 1)] >> (16 * (index & 1))) & 0xffff;
+  }
+
+  uint32_t eval(int16_t x) const {
+    const int32_t round = input_left_shift_ > 0 ? 1 << (input_left_shift_ - 1) : 0;
+    const int32_t input = (x * input_multiplier_ + round) >> input_left_shift_;
+    const uint32_t abs_input = input < 0 ? -static_cast<uint32_t>(input) : input;
+    if (tanh_) {
+      const uint32_t uh = abs_input >> 8;
+      const uint32_t result = uh >= 255 ? 0xffffu << 8
+                                        : (half(uh) << 8) + (abs_input & 0xff) * (half(uh + 1) - half(uh));
+      const int32_t signed_result =
+          input >= 0 ? static_cast<int32_t>(result) - (1 << 23) + (1 << 7)
+                     : -static_cast<int32_t>(result) + (1 << 23) + (1 << 7) - 1;
+      return static_cast<uint32_t>(signed_result >> 8);
+    }
+    const uint32_t uh = abs_input >> 9;
+    uint32_t result = uh >= 255 ? 0x7fffu << 10
+                                : (half(uh) << 9) + (abs_input & 0x1ff) * (half(uh + 1) - half(uh));
+    result = input >= 0 ? result + (1 << 9) : (1 << 25) - result + (1 << 9) - 1;
+    return result >> 10;
+  }
+
+  uint32_t table_[kTableWords] = {};
+  int32_t input_multiplier_ = 0;
+  int input_left_shift_ = 0, tanh_ = 0;
+  uint32_t rsp_ = 0;
+};
+
+class Pool {
+ public:
+  uint32_t op(int funct7, uint32_t rs1, uint32_t rs2) {
+    switch (funct7) {
+      case 0:
+        act_min_ = static_cast<int32_t>(rs1);
+        act_max_ = static_cast<int32_t>(rs2);
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 1:
+        reciprocal_ = rs1;
+        half_count_ = rs2 >> 8;
+        shift_ = rs2 & 63;
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 2:
+        for (int lane = 0; lane < 4; ++lane) {
+          sum_[lane] = 0;
+          max_[lane] = -128;
+        }
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 3:
+        for (int lane = 0; lane < 4; ++lane) {
+          sum_[lane] += byte_of(rs1, lane) + byte_of(rs2, lane);
+        }
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 4:
+        for (int lane = 0; lane < 4; ++lane) {
+          const int32_t a = byte_of(rs1, lane), b = byte_of(rs2, lane);
+          const int32_t m = a > b ? a : b;
+          max_[lane] = m > max_[lane] ? m : max_[lane];
+        }
+        rsp_ = 0;
+        cycles += 1;
+        break;
+      case 5:
+        rsp_ = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+          const uint32_t rounded =
+              (sum_[lane] < 0 ? -static_cast<uint32_t>(sum_[lane]) : sum_[lane]) + half_count_;
+          const uint32_t quotient = static_cast<uint32_t>(
+              (static_cast<uint64_t>(rounded) * reciprocal_) >> shift_);
+          const int32_t average = sum_[lane] < 0 ? -static_cast<int32_t>(quotient)
+                                                 : static_cast<int32_t>(quotient);
+          rsp_ |= (clamp(average) & 0xff) << (8 * lane);
+        }
+        cycles += 5;
+        break;
+      case 6:
+        rsp_ = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+          rsp_ |= (clamp(max_[lane]) & 0xff) << (8 * lane);
+        }
+        cycles += 1;
+        break;
+      default:
+        rsp_ = 0;
+        cycles += 1;
+        break;
+    }
+    return rsp_;
+  }
+
+ private:
+  uint32_t clamp(int32_t x) const {
+    return static_cast<uint32_t>(x < act_min_ ? act_min_ : x > act_max_ ? act_max_ : x);
+  }
+
+  int32_t act_min_ = -128, act_max_ = 127;
+  uint32_t reciprocal_ = 0, half_count_ = 0;
+  int shift_ = 0;
+  int32_t sum_[4] = {}, max_[4] = {-128, -128, -128, -128};
+  uint32_t rsp_ = 0;
+};
+
+SystolicArray sa;
+Add add;
+Simd simd;
+Softmax softmax;
+Act act;
+Pool pool;
+
+FILE* trace_file = nullptr;
+char trace_ops[256];
+int trace_last_op = -2;
+
+bool trace_wanted(const char* tag) {
+  if (trace_ops[0] == '\0') {
+    return true;
+  }
+  if (!tag) {
+    return false;
+  }
+  const size_t len = strlen(tag);
+  for (const char* p = trace_ops; (p = strstr(p, tag)) != nullptr; p += len) {
+    const bool starts = p == trace_ops || p[-1] == ',';
+    const bool ends = p[len] == '\0' || p[len] == ',';
+    if (starts && ends) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void trace(int funct3, int funct7, uint32_t rs1, uint32_t rs2, uint32_t rsp) {
+  const char* tag = cfu_profile_current_tag();
+  if (!trace_wanted(tag)) {
+    return;
+  }
+  const int op = cfu_profile_current_op();
+  if (op != trace_last_op) {
+    fprintf(trace_file, "# op %d %s\n", op, tag ? tag : "-");
+    trace_last_op = op;
+  }
+  fprintf(trace_file, "%d %02x %08lx %08lx %08lx\n", funct3, funct7,
+          static_cast<unsigned long>(rs1), static_cast<unsigned long>(rs2),
+          static_cast<unsigned long>(rsp));
+}
+
+}  // anonymous namespace
+
+uint32_t software_cfu(int funct3, int funct7, uint32_t rs1, uint32_t rs2)
+{
+  ++ops;
+  uint32_t rsp;
+  switch (funct3) {
+    case CFUOP_SA:   rsp = sa.op(funct7, rs1, rs2); break;
+    case CFUOP_ADD:  rsp = add.op(funct7, rs1, rs2); break;
+    case CFUOP_SIMD: rsp = simd.op(funct7, rs1, rs2); break;
+    case CFUOP_SOFTMAX: rsp = softmax.op(funct7, rs1, rs2); break;
+    case CFUOP_ACT:  rsp = act.op(funct7, rs1, rs2); break;
+    case CFUOP_POOL: rsp = pool.op(funct7, rs1, rs2); break;
+    default:         rsp = 0; break;
+  }
+  if (trace_file) {
+    trace(funct3, funct7, rs1, rs2, rsp);
+  }
+  return rsp;
+}
+
+uint64_t software_cfu_cycles(void) { return cycles - stats_cycles_base; }
+
+uint64_t software_cfu_ops(void) { return ops; }
+
+void software_cfu_reset_stats(void) {
+  stats_cycles_base = cycles;
+  ops = 0;
+}
+
+int software_cfu_trace_open(const char* path, const char* ops) {
+  software_cfu_trace_close();
+  trace_file = fopen(path, "w");
+  snprintf(trace_ops, sizeof(trace_ops), "%s", ops ? ops : "");
+  trace_last_op = -2;
+  return trace_file != nullptr;
+}
+
+void software_cfu_trace_close(void) {
+  if (trace_file) {
+    fclose(trace_file);
+    trace_file = nullptr;
+  }
+}
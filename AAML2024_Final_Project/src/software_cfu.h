@@ -0,0 +1,44 @@
+/*
+ * Copyright 2021 The CFU-Playground Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SOFTWARE_CFU_H
+#define _SOFTWARE_CFU_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t software_cfu(int funct3, int funct7, uint32_t rs1, uint32_t rs2);
+
+// AAML: statistics of the software CFU model (software_cfu.cc). Cycles are
+// CFU cycles: response latency of every op, stalls on the GEMM unit included.
+uint64_t software_cfu_cycles(void);
+uint64_t software_cfu_ops(void);
+void software_cfu_reset_stats(void);
+
+// AAML: trace every op to a file, for replay on the RTL (TESTBENCH/tb_cfu.cpp).
+// ops is a comma-separated list of the op tags to trace ("CONV_2D,ADD"), or
+// NULL for all of them. Returns 0 if the file cannot be opened.
+int software_cfu_trace_open(const char* path, const char* ops);
+void software_cfu_trace_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _SOFTWARE_CFU_H
@@ -22,7 +22,22 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/types.h"
 
 #include "cfu.h"
+#include "residual_fusion.h"
 #include <cstdio>
+#include <cstring>
+
+// cfuop_add function7 (see cfuop_add.v)
+#define FUNC7_ADD_SET_OFFSET_SHIFT 0
+#define FUNC7_ADD_SET_MULTIPLIER   1
+#define FUNC7_ADD_ADD4             2
+#define FUNC7_ADD_WRITE_BCAST      3
+#define FUNC7_ADD_SET_BCAST        4
+#define FUNC7_ADD_ADD4_BCAST       5
+#define FUNC7_ADD_SET_INPUT2       6
+#define FUNC7_ADD_SET_OUTPUT       7
+
+// Broadcast operand memory of cfuop_add
+#define ADD_BCAST_MAX_BYTES        256
 
 namespace tflite {
 namespace reference_integer_ops {
@@ -49,26 +64,58 @@ inline void ElementWise(
   }
 }
 
+// Program the quantization parameters of an ADD into cfuop_add
+inline void AddCfuSetParams(const ArithmeticParams& params) {
+  uint32_t input_offset = ((params.input1_offset & 0xFFFF) << 16) |
+                           (params.input2_offset & 0xFFFF);
+  [[maybe_unused]]uint32_t cfu_result = cfu_op1(FUNC7_ADD_SET_OFFSET_SHIFT, input_offset, params.output_shift);
+  __asm volatile("NOP");
+  cfu_result = cfu_op1(FUNC7_ADD_SET_MULTIPLIER, params.input1_multiplier, params.output_multiplier);
+  cfu_result = cfu_op1(FUNC7_ADD_SET_INPUT2, params.input2_multiplier,
+                       ((params.left_shift & 0x1F) << 16) |
+                       ((params.input2_shift & 0xFF) << 8) | (params.input1_shift & 0xFF));
+  cfu_result = cfu_op1(FUNC7_ADD_SET_OUTPUT, params.output_offset,
+                       ((params.quantized_activation_max & 0xFFFF) << 16) |
+                       (params.quantized_activation_min & 0xFFFF));
+}
+
+// Up to 4 bytes as one word, lane 0 in the LSB, zero filled
+inline uint32_t AddCfuLoadTail(const int8_t* data, int count) {
+  uint32_t word = 0;
+  for (int lane = 0; lane < count; ++lane) {
+    word |= static_cast<uint32_t>(static_cast<uint8_t>(data[lane])) << (8 * lane);
+  }
+  return word;
+}
+
+inline void AddCfuStoreTail(int8_t* data, uint32_t word, int count) {
+  for (int lane = 0; lane < count; ++lane) {
+    data[lane] = static_cast<int8_t>(word >> (8 * lane));
+  }
+}
+
 inline void ElementWise_m(
     int size, const ArithmeticParams& params, const int8_t* input1_data,
     const int8_t* input2_data, int8_t* output_data,
     void (*check_arithmetic_params)(const ArithmeticParams&),
     uint32_t (*binary_func)(uint32_t, uint32_t, const ArithmeticParams&)) {
   CheckArithmeticParams(params);
+  AddCfuSetParams(params);
 
-  uint32_t input_offset = ((params.input1_offset & 0xFFFF) << 16) |
-                           (params.input2_offset & 0xFFFF);
-  [[maybe_unused]]uint32_t cfu_result = cfu_op1(0, input_offset, params.output_shift);
-  __asm volatile("NOP");
-  cfu_result = cfu_op1(1, params.input1_multiplier, params.output_multiplier);
-
-  for (int i = 0; i < size; i=i+4) {
+  int i = 0;
+  for (; i + 4 <= size; i=i+4) {
     uint32_t data = binary_func(*((uint32_t *)(input1_data + i)), *((uint32_t *)(input2_data + i)), params);
     output_data[i]     = (int8_t)( data & 0xFF);
     output_data[i + 1] = (int8_t)((data >>  8) & 0xFF);
     output_data[i + 2] = (int8_t)((data >> 16) & 0xFF);
     output_data[i + 3] = (int8_t)((data >> 24) & 0xFF);
   }
+  // tail, without touching the bytes past the tensors
+  if (i < size) {
+    uint32_t data = binary_func(AddCfuLoadTail(input1_data + i, size - i),
+                                AddCfuLoadTail(input2_data + i, size - i), params);
+    AddCfuStoreTail(output_data + i, data, size - i);
+  }
 }
 
 inline void BroadcastBinaryFunction4DSlow(
@@ -132,7 +179,7 @@ inline int8_t AddFunc(int8_t x, int8_t y, const ArithmeticParams& params) {
 }
 
 inline uint32_t AddFunc_m(uint32_t x, uint32_t y, const ArithmeticParams& params) {
-  uint32_t cfu_result = cfu_op1(2, x, y);
+  uint32_t cfu_result = cfu_op1(FUNC7_ADD_ADD4, x, y);
   __asm volatile("NOP");
   return cfu_result;
 }
@@ -155,9 +202,74 @@ inline void Add(const ArithmeticParams& params,
   const int flat_size =
       MatchingElementsSize(input1_shape, input2_shape, output_shape);
 
+  // Already done by the conv that produced one of the inputs
+  if (residual_fusion_add(params, input1_data, input2_data, output_data,
+                          flat_size)) {
+    return;
+  }
   AddElementwise(flat_size, params, input1_data, input2_data, output_data);
 }
 
+// Broadcast add on cfuop_add, when one input is a scalar or a per-channel
+// vector [1, 1, 1, C] and the other has the output shape. The broadcast input
+// is written to the CFU once, repeated up to a whole number of words, and the
+// other input streams through it four lanes per op. Returns false for other
+// broadcasts, or if the repeated vector does not fit the CFU.
+inline bool BroadcastAddCfu(const ArithmeticParams& params,
+                            const RuntimeShape& input1_shape,
+                            const int8_t* input1_data,
+                            const RuntimeShape& input2_shape,
+                            const int8_t* input2_data,
+                            const RuntimeShape& output_shape,
+                            int8_t* output_data) {
+  const RuntimeShape shape1 = RuntimeShape::ExtendedShape(4, input1_shape);
+  const RuntimeShape shape2 = RuntimeShape::ExtendedShape(4, input2_shape);
+  const RuntimeShape shape_out = RuntimeShape::ExtendedShape(4, output_shape);
+  bool full1 = true, full2 = true, vector1 = true, vector2 = true;
+  for (int i = 0; i < 4; ++i) {
+    full1 &= shape1.Dims(i) == shape_out.Dims(i);
+    full2 &= shape2.Dims(i) == shape_out.Dims(i);
+    const bool channel = i == 3 && shape_out.Dims(3) > 1;
+    vector1 &= shape1.Dims(i) == 1 || (channel && shape1.Dims(i) == shape_out.Dims(i));
+    vector2 &= shape2.Dims(i) == 1 || (channel && shape2.Dims(i) == shape_out.Dims(i));
+  }
+  const bool bcast_input1 = !full1;
+  if (bcast_input1 ? !(vector1 && full2) : !vector2) {
+    return false;
+  }
+  const int8_t* bcast_data = bcast_input1 ? input1_data : input2_data;
+  const int8_t* full_data = bcast_input1 ? input2_data : input1_data;
+  const int period = (bcast_input1 ? shape1 : shape2).Dims(3);
+  // Repeat the vector to a multiple of 4 channels, e.g. 3 -> 12
+  const int repeat = (period % 4 == 0) ? 1 : (period % 2 == 0) ? 2 : 4;
+  const int words = period * repeat / 4;
+  if (period * repeat > ADD_BCAST_MAX_BYTES) {
+    return false;
+  }
+
+  AddCfuSetParams(params);
+  for (int word = 0; word < words; ++word) {
+    uint32_t wdata = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+      wdata |= static_cast<uint32_t>(static_cast<uint8_t>(bcast_data[(4 * word + lane) % period])) << (8 * lane);
+    }
+    cfu_op1(FUNC7_ADD_WRITE_BCAST, wdata, word);
+  }
+  cfu_op1(FUNC7_ADD_SET_BCAST, words, bcast_input1 ? 1 : 0);
+
+  const int size = shape_out.FlatSize();
+  int i = 0;
+  for (; i + 4 <= size; i += 4) {
+    uint32_t data = cfu_op1(FUNC7_ADD_ADD4_BCAST, *((uint32_t *)(full_data + i)), 0);
+    memcpy(output_data + i, &data, 4);
+  }
+  if (i < size) {
+    uint32_t data = cfu_op1(FUNC7_ADD_ADD4_BCAST, AddCfuLoadTail(full_data + i, size - i), 0);
+    AddCfuStoreTail(output_data + i, data, size - i);
+  }
+  return true;
+}
+
 inline void BroadcastAdd4DSlow(const ArithmeticParams& params,
                                const RuntimeShape& input1_shape,
                                const int8_t* input1_data,
@@ -165,6 +277,11 @@ inline void BroadcastAdd4DSlow(const ArithmeticParams& params,
                                const int8_t* input2_data,
                                const RuntimeShape& output_shape,
                                int8_t* output_data) {
+  CheckArithmeticParams(params);
+  if (BroadcastAddCfu(params, input1_shape, input1_data, input2_shape,
+                      input2_data, output_shape, output_data)) {
+    return;
+  }
   BroadcastBinaryFunction4DSlow(params, input1_shape, input1_data, input2_shape,
                                 input2_data, output_shape, output_data,
                                 CheckArithmeticParams, AddFunc);
@@ -19,131 +19,38 @@ limitations under the License.
 #include <stdio.h>
 #include <perf.h>
 #include <cmath>
+#include <cstring>
 
 #include "tensorflow/lite/kernels/internal/common.h"
 #include "tensorflow/lite/kernels/internal/portable_tensor_utils.h"
 #include "cfu.h"
+#include "cfu_config.h"
+#include "cfu_profile.h"
+#include "cfu_scratch.h"
+#include "gemm_cfu.h"
+#include "gemm_weight_pack.h"
+#include "residual_fusion.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/add.h"
 
 // #define SHOW_PARAMS
 #define USE_GEMM
-#define CFU_GEMM_BUFF_SIZE 256
-
-#define FUNC7_GEMM_WRITE_CONFIG 0x40
-#define FUNC7_GEMM_READ_CONFIG  0x00
-#define FUNC7_GEMM_WRITE_BUFF_A 0x50
-#define FUNC7_GEMM_READ_BUFF_A  0x10
-#define FUNC7_GEMM_WRITE_BUFF_B 0x60
-#define FUNC7_GEMM_READ_BUFF_B  0x20
-#define FUNC7_GEMM_WRITE_BUFF_C 0x70
-#define FUNC7_GEMM_READ_BUFF_C  0x30
-#define FUNC7_GEMM_COMPUTE      0x01
+#define USE_IMPLICIT_GEMM
+#define USE_GEMM_EPILOGUE
+#define USE_RESIDUAL_FUSION
 
 namespace tflite {
 namespace reference_integer_ops {
 
-// Matrix multiplication with tiling
-inline void Int8GemmWithTilingCfu(
-    const int& k, const int& m, const int& n, const int32_t& input_offset,
-    const int8_t* mat_a, const int8_t* mat_b, int32_t* mat_c, int tile_size) {
-  // Initialize
-  int cnt = 0;
-  for (int i = 0; i < m; ++i) {
-    for (int j = 0; j < n; ++j) {
-      mat_c[cnt++] = 0;
-    }
-  }
-  // Tiling
-  int8_t wdata[4];
-  cfu_op0(FUNC7_GEMM_WRITE_CONFIG, input_offset, 3); // write config - offset
-  for (int k_start = 0; k_start < k; k_start += tile_size) {
-    int k_tile = std::min(tile_size, k - k_start);
-    cfu_op0(FUNC7_GEMM_WRITE_CONFIG, k_tile, 0); // write config - k
-    for (int n_start = 0; n_start < n; n_start += tile_size) {
-      int n_tile = std::min(tile_size, n - n_start);
-      cfu_op0(FUNC7_GEMM_WRITE_CONFIG, n_tile, 2); // write config - n
-      const int8_t* mat_b_head = mat_b+(k_start*n+n_start);
-      // write weight
-      cnt = 0;
-      int col_tile = std::ceil(n_tile / 4.0);
-      for (int cnt_tile = 0; cnt_tile < col_tile; ++cnt_tile) {
-        for (int row = 0; row < k_tile; ++row) {
-          for (int byte_offset = 0; byte_offset < 4; ++byte_offset) {
-            int col = 4 * cnt_tile + byte_offset;
-            wdata[3 - byte_offset] = (col < n_tile) ? mat_b_head[row * n + col] : 0;
-            // mat_cfumem[cnt++] = (col < width) ? mat[row * width + col] : 0;
-          }
-          // printf("%8lx: [%4d, %4d, %4d, %4d]\n", *((int32_t*)wdata), (int)wdata[3], (int)wdata[2], (int)wdata[1], (int)wdata[0]);
-          cfu_op0(FUNC7_GEMM_WRITE_BUFF_B, *((int32_t*)wdata), cnt++);
-        }
-      }
-      for (int m_start = 0; m_start < m; m_start += tile_size) {
-        int m_tile = std::min(tile_size, m - m_start);
-        cfu_op0(FUNC7_GEMM_WRITE_CONFIG, m_tile, 1); // write config - m
-        // Tile GEMM
-        // A[m_start:m_end][k_start:k_end] * B[k_start:k_end][n_start:n_end]
-        const int8_t* mat_a_head = mat_a+(m_start*k+k_start);
-        int32_t* mat_c_head = mat_c+(m_start*n+n_start);
-        // CFU GEMM
-        // write input
-        cnt = 0;
-        int row_tile = std::ceil(m_tile / 4.0);
-        for (int cnt_tile = 0; cnt_tile < row_tile; ++cnt_tile) {
-          for (int col = 0; col < k_tile; ++col) {
-            for (int byte_offset = 0; byte_offset < 4; ++byte_offset) {
-              int row = 4 * cnt_tile + byte_offset;
-              wdata[3 - byte_offset] = (row < m_tile) ? mat_a_head[row * k + col] : 0;
-              // mat_cfumem[cnt++] = (row < height) ? mat[row * width +col] : 0;
-            }
-            // printf("%8lx: [%4d, %4d, %4d, %4d]\n", *((int32_t*)wdata), (int)wdata[3], (int)wdata[2], (int)wdata[1], (int)wdata[0]);
-            cfu_op0(FUNC7_GEMM_WRITE_BUFF_A, *((int32_t*)wdata), cnt++);
-          }
-        }
-        // compute
-        cfu_op0(FUNC7_GEMM_COMPUTE, 0, 0);
-        // read result
-        cnt = 0;
-        int32_t rdata;
-        for (int cnt_tile = 0; cnt_tile < col_tile; ++cnt_tile) {
-          for (int row = 0; row < m_tile; ++row) {
-            for (int byte_offset = 0; byte_offset < 4; ++byte_offset) {
-              int col = 4 * cnt_tile + byte_offset;
-              rdata = cfu_op0(FUNC7_GEMM_READ_BUFF_C, byte_offset, cnt);
-              // printf("%ld ", rdata);
-              if (col < n_tile) {
-                mat_c_head[row * n + col] += rdata;
-              }
-            }
-            ++cnt;
-          }
-        }
-      }
-    }
-  }
-}
-
-// Im2col
-inline void Im2col(
-    const int& batches, const int& filters_per_group,
-    const int& input_height, const int& input_width, const int& input_depth, const int32_t& input_offset,
-    const int& output_height, const int& output_width, const int& output_depth,
-    const int& filter_num, const int& filter_height, const int& filter_width, const int& filter_depth,
+// Im2col - Input
+inline void Im2colInput(
+    const int& batches,
+    const int& input_height, const int& input_width, const int32_t& input_offset,
+    const int& output_height, const int& output_width,
+    const int& filter_height, const int& filter_width, const int& filter_depth,
     const int& dilation_height, const int& dilation_width, const int& pad_height, const int& pad_width,
     const int& stride_height, const int& stride_width,
-    const int8_t* input_data, const RuntimeShape& input_shape, int8_t* input_data_2D,
-    const int8_t* filter_data, const RuntimeShape& filter_shape, int8_t* filter_data_2D) {
-  // Kernel
+    const int8_t* input_data, const RuntimeShape& input_shape, int8_t* input_data_2D) {
   int cnt = 0;
-  for (int filter_channel = 0; filter_channel < filter_depth; ++filter_channel) {
-    for (int filter_row = 0; filter_row < filter_height; ++filter_row) {
-      for (int filter_col = 0; filter_col < filter_width; ++filter_col) {
-        for (int output_channel = 0; output_channel < filter_num; ++output_channel) {
-          filter_data_2D[cnt++] = filter_data[Offset(filter_shape, output_channel, filter_row, filter_col, filter_channel)];
-        }
-      }   
-    }  
-  }
-  // Input
-  cnt = 0;
   for (int batch = 0; batch < batches; ++batch) {
     for (int out_y = 0; out_y < output_height; ++out_y) {
       const int in_y_origin = (out_y * stride_height) - pad_height;
@@ -206,16 +113,39 @@ inline void Im2col_reverse_and_post(
   }
 }
 
-// Fixed-point per-channel-quantization convolution reference kernel.
-inline void ConvPerChannel(
+// Scratch of ConvPerChannel for an m x n x k GEMM, from the shared pool
+// (cfu_scratch.h): the packed filter if it was not packed at model load,
+// the folded bias if it was not folded then (CFU_FOLD_INPUT_OFFSET),
+// then C and the im2col A for the paths that materialize them.
+inline size_t ConvScratchBytes(int m, int n, int k, bool filter_packed,
+                               bool bias_folded) {
+  size_t bytes = 0;
+#ifdef USE_GEMM
+  if (!filter_packed) {
+    bytes += cfu_scratch_round_up(gemm_packed_filter_words(n, k) * sizeof(uint32_t));
+  }
+  if (CFU_FOLD_INPUT_OFFSET && !bias_folded) {
+    bytes += cfu_scratch_round_up(n * sizeof(int32_t));
+  }
+#if !defined(USE_IMPLICIT_GEMM) || !defined(USE_GEMM_EPILOGUE)
+  bytes += cfu_scratch_round_up(static_cast<size_t>(m) * n * sizeof(int32_t));
+#endif
+#ifndef USE_IMPLICIT_GEMM
+  bytes += cfu_scratch_round_up(static_cast<size_t>(m) * k);
+#endif
+#endif
+  return bytes;
+}
+
+// Scalar reference of ConvPerChannel, without the CFU or any scratch. Also
+// taken when the scratch pool planned at load is too small for an op.
+inline void ConvPerChannelReference(
     const ConvParams& params, const int32_t* output_multiplier,
     const int32_t* output_shift, const RuntimeShape& input_shape,
     const int8_t* input_data, const RuntimeShape& filter_shape,
     const int8_t* filter_data, const RuntimeShape& bias_shape,
     const int32_t* bias_data, const RuntimeShape& output_shape,
     int8_t* output_data) {
-  perf_enable_counter(6);
-  // Get parameters.
   const int32_t input_offset = params.input_offset;  // r = s(q - Z)
   const int stride_width = params.stride_width;
   const int stride_height = params.stride_height;
@@ -224,84 +154,21 @@ inline void ConvPerChannel(
   const int pad_width = params.padding_values.width;
   const int pad_height = params.padding_values.height;
   const int32_t output_offset = params.output_offset;
-
-  // Set min and max value of the output.
   const int32_t output_activation_min = params.quantized_activation_min;
   const int32_t output_activation_max = params.quantized_activation_max;
 
-  // Consistency check.
-  TFLITE_DCHECK_LE(output_activation_min, output_activation_max);
-  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
-  TFLITE_DCHECK_EQ(filter_shape.DimensionsCount(), 4);
-  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
   const int batches = MatchingDim(input_shape, 0, output_shape, 0);
   const int input_depth = input_shape.Dims(3);
   const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
-  if (bias_data) {
-    TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
-  }
-
-  // Check dimensions of the tensors.
   const int input_height = input_shape.Dims(1);
   const int input_width = input_shape.Dims(2);
   const int filter_height = filter_shape.Dims(1);
   const int filter_width = filter_shape.Dims(2);
   const int filter_input_depth = filter_shape.Dims(3);
   const int groups = input_depth / filter_input_depth;
-  TFLITE_DCHECK_EQ(input_depth % filter_input_depth, 0);
   const int filters_per_group = output_depth / groups;
   const int output_height = output_shape.Dims(1);
   const int output_width = output_shape.Dims(2);
-
-  // Show params
-#ifdef SHOW_PARAMS
-  printf("Batches = %d\n", batches);
-  
-  printf("Input Height = %d, ", input_height);
-  printf("Input Width = %d, ", input_width);
-  printf("Input Depth = %d\n", input_depth);
-
-  printf("Filter Num = %d, ", output_depth);
-  printf("Filter groups = %d, ", groups);
-  printf("Filter Height = %d, ", filter_height);
-  printf("Filter Width = %d, ", filter_width);
-  printf("Filter Depth = %d\n", filter_input_depth);
-  
-  printf("Stride Height = %d, ", stride_height);
-  printf("Stride Width = %d, ", stride_width);
-  printf("Dilation Height = %d, ", dilation_height_factor);
-  printf("Dilation Width = %d, ", dilation_width_factor);
-  printf("Padding Height = %d, ", pad_height);
-  printf("Padding Width = %d\n", pad_width);
-  
-  printf("Output Height = %d, ", output_height);
-  printf("Output Width = %d, ", output_width);
-  printf("Output Depth = %d\n", output_depth);
-#endif
-
-#ifdef USE_GEMM
-  int8_t input_data_2D[206400];
-  int8_t filter_data_2D[90000];
-  int32_t result_data_2D[300000];
-  Im2col(batches, filters_per_group,
-    input_height, input_width, input_depth, input_offset,
-    output_height, output_width, output_depth,
-    output_depth, filter_height, filter_width, filter_input_depth,
-    dilation_height_factor, dilation_width_factor, pad_height, pad_width,
-    stride_height, stride_width,
-    input_data, input_shape, input_data_2D,
-    filter_data, filter_shape, filter_data_2D);
-  int k = filter_height * filter_width * filter_input_depth;
-  int m = batches * output_height * output_width;
-  int n = output_depth;
-  Int8GemmWithTilingCfu(k, m, n, input_offset, input_data_2D, filter_data_2D, result_data_2D, 64);
-  Im2col_reverse_and_post(batches,
-    output_height, output_width, output_depth,
-    output_data, output_shape, result_data_2D,
-    output_multiplier, output_shift,
-    output_offset, output_activation_min, output_activation_max,
-    bias_shape, bias_data);
-#else
   for (int batch = 0; batch < batches; ++batch) {
     for (int out_y = 0; out_y < output_height; ++out_y) {
       const int in_y_origin = (out_y * stride_height) - pad_height;
@@ -347,12 +214,10 @@ inline void ConvPerChannel(
                 // we have seen so far.
                 // TODO(b/174275578): Add a check to make sure the
                 // accumulator depth is smaller than 2^16.
-                // printf("[acc += (%4ld) * (%4ld)]\n", input_val + input_offset, filter_val);
                 acc += filter_val * (input_val + input_offset);
               }
             }
           }
-          // printf("%4ld", acc);
           if (bias_data) {
             acc += bias_data[out_channel];
           }
@@ -361,18 +226,206 @@ inline void ConvPerChannel(
           acc += output_offset;
           acc = std::max(acc, output_activation_min);
           acc = std::min(acc, output_activation_max);
-          // output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] =
-          //     static_cast<int8_t>(acc);
-          // if (static_cast<int8_t>(acc) != output_data[Offset(output_shape, batch, out_y, out_x, out_channel)]) {
-          //   printf("error at output[%d, %d, %d, %d] = %d, expect = %ld\n", batch, out_y, out_x, out_channel, (int)output_data[Offset(output_shape, batch, out_y, out_x, out_channel)], acc);
-          // } else {
-          //   printf("correct at output[%d, %d, %d, %d] = %d\n", batch, out_y, out_x, out_channel, (int)output_data[Offset(output_shape, batch, out_y, out_x, out_channel)]);
-          // }
-          // printf("(%4ld) \n", acc);
+          output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] =
+              static_cast<int8_t>(acc);
         }
       }
     }
   }
+}
+
+// Fixed-point per-channel-quantization convolution reference kernel.
+inline void ConvPerChannel(
+    const ConvParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const int8_t* filter_data, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data) {
+  perf_enable_counter(6);
+  // Get parameters.
+  const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+  const int stride_width = params.stride_width;
+  const int stride_height = params.stride_height;
+  const int dilation_width_factor = params.dilation_width_factor;
+  const int dilation_height_factor = params.dilation_height_factor;
+  const int pad_width = params.padding_values.width;
+  const int pad_height = params.padding_values.height;
+  const int32_t output_offset = params.output_offset;
+
+  // Set min and max value of the output.
+  const int32_t output_activation_min = params.quantized_activation_min;
+  const int32_t output_activation_max = params.quantized_activation_max;
+
+  // Consistency check.
+  TFLITE_DCHECK_LE(output_activation_min, output_activation_max);
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(filter_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int input_depth = input_shape.Dims(3);
+  const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+  if (bias_data) {
+    TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
+  }
+
+  // Check dimensions of the tensors.
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int filter_height = filter_shape.Dims(1);
+  const int filter_width = filter_shape.Dims(2);
+  const int filter_input_depth = filter_shape.Dims(3);
+  const int groups = input_depth / filter_input_depth;
+  TFLITE_DCHECK_EQ(input_depth % filter_input_depth, 0);
+  const int filters_per_group = output_depth / groups;
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+
+  // Show params
+#ifdef SHOW_PARAMS
+  printf("Batches = %d\n", batches);
+  
+  printf("Input Height = %d, ", input_height);
+  printf("Input Width = %d, ", input_width);
+  printf("Input Depth = %d\n", input_depth);
+
+  printf("Filter Num = %d, ", output_depth);
+  printf("Filter groups = %d, ", groups);
+  printf("Filter Height = %d, ", filter_height);
+  printf("Filter Width = %d, ", filter_width);
+  printf("Filter Depth = %d\n", filter_input_depth);
+  
+  printf("Stride Height = %d, ", stride_height);
+  printf("Stride Width = %d, ", stride_width);
+  printf("Dilation Height = %d, ", dilation_height_factor);
+  printf("Dilation Width = %d, ", dilation_width_factor);
+  printf("Padding Height = %d, ", pad_height);
+  printf("Padding Width = %d\n", pad_width);
+  
+  printf("Output Height = %d, ", output_height);
+  printf("Output Width = %d, ", output_width);
+  printf("Output Depth = %d\n", output_depth);
+#endif
+
+#ifdef USE_GEMM
+  int k = filter_height * filter_width * filter_input_depth;
+  int m = batches * output_height * output_width;
+  int n = output_depth;
+  // Filters are packed at model load; pack here only if that was not possible
+  const uint32_t* filter_data_packed = gemm_weight_pack_find(filter_data);
+  // The PEs take the raw input with CFU_FOLD_INPUT_OFFSET, and the input
+  // offset is in the bias, folded at model load or here
+  const int32_t* mac_bias = CFU_FOLD_INPUT_OFFSET ?
+      gemm_weight_pack_find_bias(filter_data, bias_data, input_offset) : bias_data;
+  const size_t scratch_bytes = ConvScratchBytes(m, n, k, filter_data_packed != nullptr,
+                                                mac_bias != nullptr);
+  uint8_t* scratch = nullptr;
+  if (scratch_bytes) {
+    scratch = static_cast<uint8_t*>(cfu_scratch_get(scratch_bytes));
+    if (!scratch) {
+      ConvPerChannelReference(params, output_multiplier, output_shift,
+                              input_shape, input_data, filter_shape,
+                              filter_data, bias_shape, bias_data,
+                              output_shape, output_data);
+      perf_disable_counter(6);
+      return;
+    }
+  }
+  if (!filter_data_packed) {
+    CFU_PROFILE_BEGIN(pack_start);
+    uint32_t* filter_data_runtime = reinterpret_cast<uint32_t*>(scratch);
+    scratch += cfu_scratch_round_up(gemm_packed_filter_words(n, k) * sizeof(uint32_t));
+    gemm_pack_filter(filter_data, output_depth, filter_height, filter_width,
+      filter_input_depth, filter_data_runtime);
+    filter_data_packed = filter_data_runtime;
+    CFU_PROFILE_END(CFU_PROFILE_WEIGHT_PACK, pack_start);
+  }
+  if (CFU_FOLD_INPUT_OFFSET && !mac_bias) {
+    CFU_PROFILE_BEGIN(fold_start);
+    int32_t* folded_bias = reinterpret_cast<int32_t*>(scratch);
+    scratch += cfu_scratch_round_up(n * sizeof(int32_t));
+    gemm_fold_bias(bias_data, filter_data, n, k, k, 1, input_offset, folded_bias);
+    mac_bias = folded_bias;
+    CFU_PROFILE_END(CFU_PROFILE_WEIGHT_PACK, fold_start);
+  }
+  // A 1x1 stride-1 conv without padding: the NHWC input already is the
+  // row-major A[m][k], so it is fed to the GEMM as it is. At other strides
+  // the implicit GEMM gathers strided rows (Im2colWriteBuffAPointwise).
+  const bool direct_a = filter_height == 1 && filter_width == 1 &&
+                        stride_height == 1 && stride_width == 1 &&
+                        pad_height == 0 && pad_width == 0 &&
+                        filter_input_depth == input_depth;
+#ifdef USE_IMPLICIT_GEMM
+  const Im2colGeometry geo = {
+    input_data, input_height, input_width, input_depth,
+    output_height, output_width,
+    filter_height, filter_width,
+    stride_height, stride_width,
+    dilation_height_factor, dilation_width_factor,
+    pad_height, pad_width,
+    input_offset};
+#ifdef USE_GEMM_EPILOGUE
+  GemmEpilogue epilogue = {
+    mac_bias, output_multiplier, output_shift,
+    output_offset, output_activation_min, output_activation_max,
+    output_data, false, nullptr, false};
+#ifdef USE_RESIDUAL_FUSION
+  // Do the ADD that reads this output, into the ADD output
+  ResidualFusion* fusion = residual_fusion_find(filter_data);
+  if (fusion && residual_fusion_begin_conv(fusion, output_data, input_data,
+                                           input_shape.FlatSize(), output_shape.FlatSize())) {
+    AddCfuSetParams(fusion->params);
+    epilogue.output = fusion->add_output;
+    epilogue.residual = fusion->shortcut;
+    epilogue.residual_is_input1 = !fusion->conv_is_input1;
+  }
+#endif
+  Int8GemmWithTilingCfu(k, m, n, input_offset, direct_a ? input_data : nullptr, filter_data_packed, nullptr,
+                        GemmPlanTiles(m, n, k), direct_a ? nullptr : &geo, &epilogue);
+#else
+  int32_t* result_data_2D = reinterpret_cast<int32_t*>(scratch);
+  Int8GemmWithTilingCfu(k, m, n, input_offset, direct_a ? input_data : nullptr, filter_data_packed, result_data_2D,
+                        GemmPlanTiles(m, n, k), direct_a ? nullptr : &geo);
+  CFU_PROFILE_BEGIN(post_start);
+  Im2col_reverse_and_post(batches,
+    output_height, output_width, output_depth,
+    output_data, output_shape, result_data_2D,
+    output_multiplier, output_shift,
+    output_offset, output_activation_min, output_activation_max,
+    bias_shape, mac_bias);
+  CFU_PROFILE_END(CFU_PROFILE_POST, post_start);
+#endif
+#else
+  int32_t* result_data_2D = reinterpret_cast<int32_t*>(scratch);
+  const int8_t* input_data_2D = input_data;
+  if (!direct_a) {
+    int8_t* im2col_data = reinterpret_cast<int8_t*>(
+        scratch + cfu_scratch_round_up(static_cast<size_t>(m) * n * sizeof(int32_t)));
+    CFU_PROFILE_BEGIN(im2col_start);
+    Im2colInput(batches,
+      input_height, input_width, input_offset,
+      output_height, output_width,
+      filter_height, filter_width, filter_input_depth,
+      dilation_height_factor, dilation_width_factor, pad_height, pad_width,
+      stride_height, stride_width,
+      input_data, input_shape, im2col_data);
+    CFU_PROFILE_END(CFU_PROFILE_IM2COL, im2col_start);
+    input_data_2D = im2col_data;
+  }
+  Int8GemmWithTilingCfu(k, m, n, input_offset, input_data_2D, filter_data_packed, result_data_2D, GemmPlanTiles(m, n, k));
+  CFU_PROFILE_BEGIN(post_start);
+  Im2col_reverse_and_post(batches,
+    output_height, output_width, output_depth,
+    output_data, output_shape, result_data_2D,
+    output_multiplier, output_shift,
+    output_offset, output_activation_min, output_activation_max,
+    bias_shape, mac_bias);
+  CFU_PROFILE_END(CFU_PROFILE_POST, post_start);
+#endif
+#else
+  ConvPerChannelReference(params, output_multiplier, output_shift, input_shape,
+                          input_data, filter_shape, filter_data, bias_shape,
+                          bias_data, output_shape, output_data);
 #endif
   perf_disable_counter(6);
 }
@@ -21,11 +21,71 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/portable_tensor_utils.h"
 
 #include "cfu.h"
+#include "cfu_config.h"
+#include "cfu_profile.h"
+#include "cfu_scratch.h"
+#include "gemm_cfu.h"
+#include "gemm_weight_pack.h"
+#include "pool_fusion.h"
 #include "stdio.h"
 
+#define USE_GEMM_FC
+#define USE_POOL_FUSION
+
+// cfuop_simd function7 (see cfuop_simd.v)
+#define FUNC7_SIMD_SET_INPUT_OFFSET 8
+
 namespace tflite {
 namespace reference_integer_ops {
 
+// Fully connected layer on the GEMM unit, output = input * filter^T with
+// m = batches, n = output_depth and k = accum_depth. The filter is the B
+// operand, four output channels per BUFF_B word, pre-packed at model load or
+// gathered from the OI filter if it did not fit the pool. The input rows
+// (one vector at batch 1) are written to BUFF_A once per k tile and reused
+// across the n tiles, so the weight stream is the only traffic that scales
+// with the layer.
+inline void FullyConnectedGemm(
+    int batches, int output_depth, int accum_depth, int32_t input_offset,
+    const int8_t* input_data, const int8_t* filter_data,
+    const GemmEpilogue& epilogue) {
+  const uint32_t* filter_data_packed = gemm_weight_pack_find(filter_data);
+  Int8GemmWithTilingCfu(accum_depth, batches, output_depth, input_offset,
+                        input_data, filter_data_packed, nullptr,
+                        GemmPlanTiles(batches, output_depth, accum_depth),
+                        nullptr, &epilogue, filter_data);
+}
+
+// Bias for the MACs of the CFU. With CFU_FOLD_INPUT_OFFSET they take the raw
+// input and the input offset is in the bias, folded at model load or, if it
+// was not, here into scratch. False if the scratch is short. The per-tensor
+// path adds weights_offset to the filter bytes; int8 filters are symmetric,
+// so it is 0 and the filter is summed as it is.
+inline bool FullyConnectedMacBias(const int8_t* filter_data,
+                                  const int32_t* bias_data, int output_depth,
+                                  int accum_depth, int32_t input_offset,
+                                  const int32_t** mac_bias) {
+  *mac_bias = bias_data;
+  if (!CFU_FOLD_INPUT_OFFSET) {
+    return true;
+  }
+  *mac_bias = gemm_weight_pack_find_bias(filter_data, bias_data, input_offset);
+  if (*mac_bias) {
+    return true;
+  }
+  int32_t* folded_bias = static_cast<int32_t*>(
+      cfu_scratch_get(cfu_scratch_round_up(output_depth * sizeof(int32_t))));
+  if (!folded_bias) {
+    return false;
+  }
+  CFU_PROFILE_BEGIN(fold_start);
+  gemm_fold_bias(bias_data, filter_data, output_depth, accum_depth, accum_depth,
+                 1, input_offset, folded_bias);
+  CFU_PROFILE_END(CFU_PROFILE_WEIGHT_PACK, fold_start);
+  *mac_bias = folded_bias;
+  return true;
+}
+
 // For per-channel functions, since it is defined in quantization spec that
 // weights are symmetric
 // (https://www.tensorflow.org/lite/performance/quantization_spec#symmetric_vs_asymmetric),
@@ -53,6 +113,22 @@ inline void FullyConnectedPerChannel(
   const int output_depth = output_shape.Dims(1);
   TFLITE_DCHECK_LE(output_depth, filter_shape.Dims(filter_dim_count - 2));
   const int accum_depth = filter_shape.Dims(filter_dim_count - 1);
+#ifdef USE_GEMM_FC
+  // int and int32_t are both 32 bits, but may be distinct types
+  static_assert(sizeof(int) == sizeof(int32_t), "output_shift");
+  // Short of scratch for the folded bias, the loop below does it on the CPU
+  const int32_t* mac_bias;
+  if (FullyConnectedMacBias(filter_data, bias_data, output_depth, accum_depth,
+                            input_offset, &mac_bias)) {
+    const GemmEpilogue epilogue = {
+      mac_bias, output_multiplier, reinterpret_cast<const int32_t*>(output_shift),
+      output_offset, output_activation_min, output_activation_max,
+      output_data, false, nullptr, false};
+    FullyConnectedGemm(batches, output_depth, accum_depth, input_offset,
+                       input_data, filter_data, epilogue);
+    return;
+  }
+#endif
   for (int b = 0; b < batches; ++b) {
     for (int out_c = 0; out_c < output_depth; ++out_c) {
       int32_t acc = 0;
@@ -114,49 +190,141 @@ inline void FullyConnectedPerChannel(
   }
 }
 
-inline void FullyConnected(
-    const FullyConnectedParams& params, const RuntimeShape& input_shape,
-    const int8_t* input_data, const RuntimeShape& filter_shape,
-    const int8_t* filter_data, const RuntimeShape& bias_shape,
-    const int32_t* bias_data, const RuntimeShape& output_shape,
-    int8_t* output_data) {
-  // const int32_t input_offset = params.input_offset;
+// Per-tensor int8 fully connected on the CPU, for when the CFU cannot take
+// it (no scratch for the folded bias).
+inline void FullyConnectedInt8Reference(
+    const FullyConnectedParams& params, int batches, int output_depth,
+    int accum_depth, const int8_t* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, int8_t* output_data) {
+  for (int b = 0; b < batches; ++b) {
+    for (int out_c = 0; out_c < output_depth; ++out_c) {
+      int32_t acc = 0;
+      for (int d = 0; d < accum_depth; ++d) {
+        int32_t input_val = input_data[b * accum_depth + d];
+        int32_t filter_val = filter_data[out_c * accum_depth + d];
+        acc += (filter_val + params.weights_offset) *
+               (input_val + params.input_offset);
+      }
+      if (bias_data) {
+        acc += bias_data[out_c];
+      }
+      acc = MultiplyByQuantizedMultiplier(acc, params.output_multiplier,
+                                          params.output_shift);
+      acc += params.output_offset;
+      acc = std::max(acc, params.quantized_activation_min);
+      acc = std::min(acc, params.quantized_activation_max);
+      output_data[out_c + output_depth * b] = static_cast<int8_t>(acc);
+    }
+  }
+}
+
+// Per-tensor int8 fully connected on the CFU, once the shapes are resolved.
+// Also run by a fused average pool on its pooled vector (see pool_fusion.h).
+inline void FullyConnectedInt8(
+    const FullyConnectedParams& params, int batches, int output_depth,
+    int accum_depth, const int8_t* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, int8_t* output_data) {
+  const int32_t input_offset = params.input_offset;
   const int32_t filter_offset = params.weights_offset;
   const int32_t output_offset = params.output_offset;
   const int32_t output_multiplier = params.output_multiplier;
   const int output_shift = params.output_shift;
   const int32_t output_activation_min = params.quantized_activation_min;
   const int32_t output_activation_max = params.quantized_activation_max;
-  TFLITE_DCHECK_GE(filter_shape.DimensionsCount(), 2);
-  TFLITE_DCHECK_GE(output_shape.DimensionsCount(), 1);
-
-  TFLITE_DCHECK_LE(output_activation_min, output_activation_max);
-  const int filter_dim_count = filter_shape.DimensionsCount();
-  const int output_dim_count = output_shape.DimensionsCount();
-  const int batches = FlatSizeSkipDim(output_shape, output_dim_count - 1);
-  const int output_depth = output_shape.Dims(output_dim_count - 1);
-  TFLITE_DCHECK_LE(output_depth, filter_shape.Dims(filter_dim_count - 2));
-  const int accum_depth = filter_shape.Dims(filter_dim_count - 1);
+  const int32_t* mac_bias;
+  if (!FullyConnectedMacBias(filter_data, bias_data, output_depth, accum_depth,
+                             input_offset, &mac_bias)) {
+    FullyConnectedInt8Reference(params, batches, output_depth, accum_depth,
+                                input_data, filter_data, bias_data, output_data);
+    return;
+  }
+#ifdef USE_GEMM_FC
+  // The GEMM unit takes symmetric filters only. At batch 1 both paths stream
+  // the same K * N / 4 filter words, but cfuop_simd takes the input in the
+  // same op and needs no BUFF_A or qparam writes, so it stays on it when it
+  // can (K a multiple of 4).
+  const bool simd_gemv = batches == 1 && accum_depth % 4 == 0;
+  if (filter_offset == 0 && !simd_gemv) {
+    const int32_t output_shift_32 = output_shift;
+    const GemmEpilogue epilogue = {
+      mac_bias, &output_multiplier, &output_shift_32,
+      output_offset, output_activation_min, output_activation_max,
+      output_data, true, nullptr, false};
+    FullyConnectedGemm(batches, output_depth, accum_depth, input_offset,
+                       input_data, filter_data, epilogue);
+    return;
+  }
+#endif
+  cfu_op2(FUNC7_SIMD_SET_INPUT_OFFSET, input_offset, 0);
   for (int b = 0; b < batches; ++b) {
     int acc_offset = output_depth * b;
     for (int out_c = 0; out_c < output_depth; ++out_c) {
       int32_t acc = cfu_op2(0, 0, 0); // resets acc
-      for (int d = 0; d < accum_depth; d += 4) {
-        int in_offset  = b * accum_depth + d;
-        int fil_offset = out_c * accum_depth + d;
-        uint32_t input_val = *((uint32_t *)(input_data + in_offset));
-        uint32_t filter_val = *((uint32_t *)(filter_data + fil_offset));
-        acc = cfu_op2(1, input_val, (filter_val + filter_offset));
+      if (accum_depth % 4 == 0) {
+        for (int d = 0; d < accum_depth; d += 4) {
+          int in_offset  = b * accum_depth + d;
+          int fil_offset = out_c * accum_depth + d;
+          uint32_t input_val = *((uint32_t *)(input_data + in_offset));
+          uint32_t filter_val = *((uint32_t *)(filter_data + fil_offset));
+          acc = cfu_op2(1, input_val, (filter_val + filter_offset));
+        }
+      } else {
+        // Rows are not word aligned; gather bytewise, zero filter lanes past
+        // the end contribute nothing.
+        for (int d = 0; d < accum_depth; d += 4) {
+          const int count = std::min(4, accum_depth - d);
+          uint32_t input_val = 0;
+          uint32_t filter_val = 0;
+          for (int i = 0; i < count; ++i) {
+            input_val |= static_cast<uint32_t>(static_cast<uint8_t>(
+                             input_data[b * accum_depth + d + i])) << (8 * i);
+            filter_val |= static_cast<uint32_t>(static_cast<uint8_t>(
+                              filter_data[out_c * accum_depth + d + i] +
+                              filter_offset)) << (8 * i);
+          }
+          acc = cfu_op2(1, input_val, filter_val);
+        }
       }
 
-      acc = cfu_op2(2, bias_data[out_c], output_offset);
+      acc = cfu_op2(2, mac_bias[out_c], output_offset);
       acc = cfu_op2(3, output_multiplier, output_shift);
+      // cfuop_simd clamps to the int8 range only
+      acc = std::max(acc, output_activation_min);
+      acc = std::min(acc, output_activation_max);
       output_data[acc_offset] = static_cast<int8_t>(acc);
       acc_offset++;
     }
   }
 }
 
+inline void FullyConnected(
+    const FullyConnectedParams& params, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const int8_t* filter_data, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data) {
+  TFLITE_DCHECK_GE(filter_shape.DimensionsCount(), 2);
+  TFLITE_DCHECK_GE(output_shape.DimensionsCount(), 1);
+
+  TFLITE_DCHECK_LE(params.quantized_activation_min,
+                   params.quantized_activation_max);
+  const int filter_dim_count = filter_shape.DimensionsCount();
+  const int output_dim_count = output_shape.DimensionsCount();
+  const int batches = FlatSizeSkipDim(output_shape, output_dim_count - 1);
+  const int output_depth = output_shape.Dims(output_dim_count - 1);
+  TFLITE_DCHECK_LE(output_depth, filter_shape.Dims(filter_dim_count - 2));
+  const int accum_depth = filter_shape.Dims(filter_dim_count - 1);
+#ifdef USE_POOL_FUSION
+  // Already done by the average pool that produced the input
+  if (pool_fusion_fc(params, input_data, filter_data, bias_data, output_data,
+                     batches, output_depth, accum_depth)) {
+    return;
+  }
+#endif
+  FullyConnectedInt8(params, batches, output_depth, accum_depth, input_data,
+                     filter_data, bias_data, output_data);
+}
+
 // inline void FullyConnected(
 //     const FullyConnectedParams& params, const RuntimeShape& input_shape,
 //     const int8_t* input_data, const RuntimeShape& filter_shape,
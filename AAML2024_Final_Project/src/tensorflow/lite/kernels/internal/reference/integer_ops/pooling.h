@@ -0,0 +1,460 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_REFERENCE_INTEGER_OPS_POOLING_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_REFERENCE_INTEGER_OPS_POOLING_H_
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/fully_connected.h"
+
+#include "cfu.h"
+#include "pool_fusion.h"
+
+#define USE_CFU_POOL
+
+// cfuop_pool function7 (see cfuop_pool.v)
+#define FUNC7_POOL_SET_CLAMP   0
+#define FUNC7_POOL_SET_DIVISOR 1
+#define FUNC7_POOL_CLEAR       2
+#define FUNC7_POOL_SUM8        3
+#define FUNC7_POOL_MAX8        4
+#define FUNC7_POOL_AVG4        5
+#define FUNC7_POOL_MAX4        6
+
+// Lanes past the end of the channels: no effect on a sum or a max
+#define POOL_SUM_FILL 0x00000000u
+#define POOL_MAX_FILL 0x80808080u
+
+namespace tflite {
+namespace reference_integer_ops {
+
+// Up to 4 channels as one word, first channel in the LSB, fill elsewhere
+inline uint32_t PoolLoadLanes(const int8_t* data, int lanes, uint32_t fill) {
+  uint32_t word = fill;
+  if (lanes == 4) {
+    memcpy(&word, data, 4);
+    return word;
+  }
+  for (int lane = 0; lane < lanes; ++lane) {
+    word &= ~(0xffu << (8 * lane));
+    word |= static_cast<uint32_t>(static_cast<uint8_t>(data[lane])) << (8 * lane);
+  }
+  return word;
+}
+
+inline void PoolStoreLanes(int8_t* data, int lanes, uint32_t word) {
+  memcpy(data, &word, lanes);
+}
+
+// Averages of count values: (|sum| + count / 2) * reciprocal >> shift, with
+// reciprocal = ceil(2**shift / count) and shift = 31 + ceil(log2(count)).
+// The error of the reciprocal is below count / 2**shift, too small to move
+// any sum of count int8 values across an integer.
+inline void PoolSetDivisor(int count) {
+  int log2_count = 0;
+  while ((1 << log2_count) < count) {
+    ++log2_count;
+  }
+  const int shift = 31 + log2_count;
+  const uint32_t reciprocal = static_cast<uint32_t>(
+      ((static_cast<uint64_t>(1) << shift) + count - 1) / count);
+  cfu_op5(FUNC7_POOL_SET_DIVISOR, reciprocal, (count / 2) << 8 | shift);
+}
+
+// Streams the window of 4 channels into the cfuop_pool lanes, two words
+// per op; funct7 is FUNC7_POOL_SUM8 or FUNC7_POOL_MAX8.
+template <int funct7>
+inline void PoolReduceWindow(const int8_t* window, int row_stride,
+                             int col_stride, int rows, int cols, int lanes,
+                             uint32_t fill) {
+  cfu_op5(FUNC7_POOL_CLEAR, 0, 0);
+  bool pending = false;
+  uint32_t pending_word = 0;
+  for (int y = 0; y < rows; ++y) {
+    const int8_t* row = window + y * row_stride;
+    for (int x = 0; x < cols; ++x) {
+      const uint32_t word = PoolLoadLanes(row + x * col_stride, lanes, fill);
+      if (pending) {
+        cfu_op5(funct7, pending_word, word);
+      } else {
+        pending_word = word;
+      }
+      pending = !pending;
+    }
+  }
+  if (pending) {
+    cfu_op5(funct7, pending_word, fill);
+  }
+}
+
+// Average and max pooling on cfuop_pool, channel-parallel as the depthwise
+// conv: 4 adjacent channels are one word of the NHWC input and each lane
+// reduces its own channel over the window. An average is then one
+// reciprocal multiply per lane in the CFU instead of a division per output,
+// and the activation clamp is done there too.
+template <int funct7>
+inline bool PoolCfu(const PoolParams& params, const RuntimeShape& input_shape,
+                    const int8_t* input_data, const RuntimeShape& output_shape,
+                    int8_t* output_data) {
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(input_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int stride_height = params.stride_height;
+  const int stride_width = params.stride_width;
+  const bool average = funct7 == FUNC7_POOL_SUM8;
+  const uint32_t fill = average ? POOL_SUM_FILL : POOL_MAX_FILL;
+
+  cfu_op5(FUNC7_POOL_SET_CLAMP, params.quantized_activation_min,
+          params.quantized_activation_max);
+  int divisor_count = 0;
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        const int in_x_origin =
+            (out_x * stride_width) - params.padding_values.width;
+        const int in_y_origin =
+            (out_y * stride_height) - params.padding_values.height;
+        // Compute the boundaries of the filter region clamped so as to
+        // ensure that the filter window fits in the input array.
+        const int filter_x_start = std::max(0, -in_x_origin);
+        const int filter_x_end =
+            std::min(params.filter_width, input_width - in_x_origin);
+        const int filter_y_start = std::max(0, -in_y_origin);
+        const int filter_y_end =
+            std::min(params.filter_height, input_height - in_y_origin);
+        const int rows = std::max(0, filter_y_end - filter_y_start);
+        const int cols = std::max(0, filter_x_end - filter_x_start);
+        if (average) {
+          const int filter_count = rows * cols;
+          if (filter_count == 0) {
+            return false;
+          }
+          if (filter_count != divisor_count) {
+            PoolSetDivisor(filter_count);
+            divisor_count = filter_count;
+          }
+        }
+        // An empty window (max pool only) reads nothing
+        const int8_t* window =
+            rows == 0 || cols == 0
+                ? input_data
+                : input_data + Offset(input_shape, batch,
+                                      in_y_origin + filter_y_start,
+                                      in_x_origin + filter_x_start, 0);
+        int8_t* output =
+            output_data + Offset(output_shape, batch, out_y, out_x, 0);
+        for (int channel = 0; channel < depth; channel += 4) {
+          const int lanes = std::min(4, depth - channel);
+          PoolReduceWindow<funct7>(window + channel, input_width * depth,
+                                   depth, rows, cols, lanes, fill);
+          const uint32_t result = average ? cfu_op5(FUNC7_POOL_AVG4, 0, 0)
+                                          : cfu_op5(FUNC7_POOL_MAX4, 0, 0);
+          PoolStoreLanes(output + channel, lanes, result);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+inline bool AveragePoolReference(const PoolParams& params,
+                                 const RuntimeShape& input_shape,
+                                 const int8_t* input_data,
+                                 const RuntimeShape& output_shape,
+                                 int8_t* output_data) {
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(input_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int stride_height = params.stride_height;
+  const int stride_width = params.stride_width;
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        for (int channel = 0; channel < depth; ++channel) {
+          const int in_x_origin =
+              (out_x * stride_width) - params.padding_values.width;
+          const int in_y_origin =
+              (out_y * stride_height) - params.padding_values.height;
+          // Compute the boundaries of the filter region clamped so as to
+          // ensure that the filter window fits in the input array.
+          const int filter_x_start = std::max(0, -in_x_origin);
+          const int filter_x_end =
+              std::min(params.filter_width, input_width - in_x_origin);
+          const int filter_y_start = std::max(0, -in_y_origin);
+          const int filter_y_end =
+              std::min(params.filter_height, input_height - in_y_origin);
+          int32_t acc = 0;
+          int filter_count = 0;
+          for (int filter_y = filter_y_start; filter_y < filter_y_end;
+               ++filter_y) {
+            for (int filter_x = filter_x_start; filter_x < filter_x_end;
+                 ++filter_x) {
+              const int in_x = in_x_origin + filter_x;
+              const int in_y = in_y_origin + filter_y;
+              acc +=
+                  input_data[Offset(input_shape, batch, in_y, in_x, channel)];
+              filter_count++;
+            }
+          }
+          if (filter_count == 0) return false;
+          // Round to the closest integer value.
+          acc = acc > 0 ? (acc + filter_count / 2) / filter_count
+                        : (acc - filter_count / 2) / filter_count;
+          acc = std::max(acc, params.quantized_activation_min);
+          acc = std::min(acc, params.quantized_activation_max);
+          output_data[Offset(output_shape, batch, out_y, out_x, channel)] =
+              static_cast<int8_t>(acc);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+inline bool AveragePool(const PoolParams& params,
+                        const RuntimeShape& input_shape,
+                        const int8_t* input_data,
+                        const RuntimeShape& output_shape, int8_t* output_data) {
+  TFLITE_DCHECK_LE(params.quantized_activation_min,
+                   params.quantized_activation_max);
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+#ifdef USE_CFU_POOL
+#ifdef USE_POOL_FUSION
+  // Pool into a buffer of our own and run the FC that reads the output
+  PoolFusion* fusion = pool_fusion_begin_pool(
+      input_data, input_shape.FlatSize(), output_data, output_shape.FlatSize());
+  if (fusion) {
+    alignas(4) static int8_t pooled[POOL_FUSION_MAX_SIZE];
+    if (!PoolCfu<FUNC7_POOL_SUM8>(params, input_shape, input_data,
+                                  output_shape, pooled)) {
+      fusion->done = false;
+      return false;
+    }
+    FullyConnectedInt8(fusion->params, fusion->batches, fusion->output_depth,
+                       fusion->accum_depth, pooled, fusion->filter_data,
+                       fusion->bias_data, fusion->fc_output);
+    return true;
+  }
+#endif
+  return PoolCfu<FUNC7_POOL_SUM8>(params, input_shape, input_data,
+                                  output_shape, output_data);
+#else
+  return AveragePoolReference(params, input_shape, input_data, output_shape,
+                              output_data);
+#endif
+}
+
+inline void MaxPoolReference(const PoolParams& params,
+                             const RuntimeShape& input_shape,
+                             const int8_t* input_data,
+                             const RuntimeShape& output_shape,
+                             int8_t* output_data) {
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(input_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int stride_height = params.stride_height;
+  const int stride_width = params.stride_width;
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        for (int channel = 0; channel < depth; ++channel) {
+          const int in_x_origin =
+              (out_x * stride_width) - params.padding_values.width;
+          const int in_y_origin =
+              (out_y * stride_height) - params.padding_values.height;
+          // Compute the boundaries of the filter region clamped so as to
+          // ensure that the filter window fits in the input array.
+          const int filter_x_start = std::max(0, -in_x_origin);
+          const int filter_x_end =
+              std::min(params.filter_width, input_width - in_x_origin);
+          const int filter_y_start = std::max(0, -in_y_origin);
+          const int filter_y_end =
+              std::min(params.filter_height, input_height - in_y_origin);
+          int8_t max = std::numeric_limits<int8_t>::lowest();
+          for (int filter_y = filter_y_start; filter_y < filter_y_end;
+               ++filter_y) {
+            for (int filter_x = filter_x_start; filter_x < filter_x_end;
+                 ++filter_x) {
+              const int in_x = in_x_origin + filter_x;
+              const int in_y = in_y_origin + filter_y;
+              max = std::max(
+                  max,
+                  input_data[Offset(input_shape, batch, in_y, in_x, channel)]);
+            }
+          }
+          max = std::max<int8_t>(max, params.quantized_activation_min);
+          max = std::min<int8_t>(max, params.quantized_activation_max);
+          output_data[Offset(output_shape, batch, out_y, out_x, channel)] =
+              static_cast<int8_t>(max);
+        }
+      }
+    }
+  }
+}
+
+inline void MaxPool(const PoolParams& params, const RuntimeShape& input_shape,
+                    const int8_t* input_data, const RuntimeShape& output_shape,
+                    int8_t* output_data) {
+  TFLITE_DCHECK_LE(params.quantized_activation_min,
+                   params.quantized_activation_max);
+  TFLITE_DCHECK_GE(params.quantized_activation_min,
+                   std::numeric_limits<int8_t>::min());
+  TFLITE_DCHECK_LE(params.quantized_activation_max,
+                   std::numeric_limits<int8_t>::max());
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+#ifdef USE_CFU_POOL
+  PoolCfu<FUNC7_POOL_MAX8>(params, input_shape, input_data, output_shape,
+                           output_data);
+#else
+  MaxPoolReference(params, input_shape, input_data, output_shape, output_data);
+#endif
+}
+
+inline bool AveragePool(const PoolParams& params,
+                        const RuntimeShape& input_shape,
+                        const int16_t* input_data,
+                        const RuntimeShape& output_shape,
+                        int16_t* output_data) {
+  TFLITE_DCHECK_LE(params.quantized_activation_min,
+                   params.quantized_activation_max);
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(input_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int stride_height = params.stride_height;
+  const int stride_width = params.stride_width;
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        for (int channel = 0; channel < depth; ++channel) {
+          const int in_x_origin =
+              (out_x * stride_width) - params.padding_values.width;
+          const int in_y_origin =
+              (out_y * stride_height) - params.padding_values.height;
+          // Compute the boundaries of the filter region clamped so as to
+          // ensure that the filter window fits in the input array.
+          const int filter_x_start = std::max(0, -in_x_origin);
+          const int filter_x_end =
+              std::min(params.filter_width, input_width - in_x_origin);
+          const int filter_y_start = std::max(0, -in_y_origin);
+          const int filter_y_end =
+              std::min(params.filter_height, input_height - in_y_origin);
+          int32_t acc = 0;
+          int filter_count = 0;
+          for (int filter_y = filter_y_start; filter_y < filter_y_end;
+               ++filter_y) {
+            for (int filter_x = filter_x_start; filter_x < filter_x_end;
+                 ++filter_x) {
+              const int in_x = in_x_origin + filter_x;
+              const int in_y = in_y_origin + filter_y;
+              acc +=
+                  input_data[Offset(input_shape, batch, in_y, in_x, channel)];
+              filter_count++;
+            }
+          }
+          if (filter_count == 0) return false;
+          // Round to the closest integer value.
+          acc = acc > 0 ? (acc + filter_count / 2) / filter_count
+                        : (acc - filter_count / 2) / filter_count;
+          acc = std::max(acc, params.quantized_activation_min);
+          acc = std::min(acc, params.quantized_activation_max);
+          output_data[Offset(output_shape, batch, out_y, out_x, channel)] =
+              static_cast<int16_t>(acc);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+inline void MaxPool(const PoolParams& params, const RuntimeShape& input_shape,
+                    const int16_t* input_data, const RuntimeShape& output_shape,
+                    int16_t* output_data) {
+  TFLITE_DCHECK_LE(params.quantized_activation_min,
+                   params.quantized_activation_max);
+  TFLITE_DCHECK_GE(params.quantized_activation_min,
+                   std::numeric_limits<int16_t>::min());
+  TFLITE_DCHECK_LE(params.quantized_activation_max,
+                   std::numeric_limits<int16_t>::max());
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(input_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int stride_height = params.stride_height;
+  const int stride_width = params.stride_width;
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        for (int channel = 0; channel < depth; ++channel) {
+          const int in_x_origin =
+              (out_x * stride_width) - params.padding_values.width;
+          const int in_y_origin =
+              (out_y * stride_height) - params.padding_values.height;
+          // Compute the boundaries of the filter region clamped so as to
+          // ensure that the filter window fits in the input array.
+          const int filter_x_start = std::max(0, -in_x_origin);
+          const int filter_x_end =
+              std::min(params.filter_width, input_width - in_x_origin);
+          const int filter_y_start = std::max(0, -in_y_origin);
+          const int filter_y_end =
+              std::min(params.filter_height, input_height - in_y_origin);
+          int16_t max = std::numeric_limits<int16_t>::lowest();
+          for (int filter_y = filter_y_start; filter_y < filter_y_end;
+               ++filter_y) {
+            for (int filter_x = filter_x_start; filter_x < filter_x_end;
+                 ++filter_x) {
+              const int in_x = in_x_origin + filter_x;
+              const int in_y = in_y_origin + filter_y;
+              max = std::max(
+                  max,
+                  input_data[Offset(input_shape, batch, in_y, in_x, channel)]);
+            }
+          }
+          max = std::max<int16_t>(max, params.quantized_activation_min);
+          max = std::min<int16_t>(max, params.quantized_activation_max);
+          output_data[Offset(output_shape, batch, out_y, out_x, channel)] =
+              static_cast<int16_t>(max);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace reference_integer_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_REFERENCE_INTEGER_OPS_POOLING_H_
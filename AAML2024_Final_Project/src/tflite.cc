@@ -18,9 +18,15 @@
 
 #include <cstdint>
 
+#include "cfu_memory.h"
+#include "cfu_profile.h"
+#include "cfu_scratch.h"
+#include "gemm_weight_pack.h"
 #include "perf.h"
 #include "playground_util/random.h"
 #include "proj_tflite.h"
+#include "pool_fusion.h"
+#include "residual_fusion.h"
 #include "tensorflow/lite/micro/all_ops_resolver.h"
 #include "tensorflow/lite/micro/micro_error_reporter.h"
 #include "tensorflow/lite/micro/micro_interpreter.h"
@@ -38,23 +44,34 @@
 #define INTERPRETER_TYPE MicroInterpreter
 #endif
 
-// For C++ exceptions
+// For C++ exceptions (the host C++ runtime has its own)
+#ifndef CFU_HOST_BUILD
 void* __dso_handle = &__dso_handle;
+#endif
 
 //
 // TfLM global objects
 namespace {
 
-// A profiler that prints a "." for each profile event begun
+// A profiler that prints a "." for each profile event begun, and feeds the
+// per-op cycle profile (cfu_profile.h)
 class ProgressProfiler : public tflite::MicroProfiler {
  public:
   virtual uint32_t BeginEvent(const char* tag) {
 #ifndef HIDE_PROGRESS_DOTS
     printf(".");
 #endif
+    cfu_profile_begin_op(tag);
+    cfu_memory_begin_op();
     return tflite::MicroProfiler::BeginEvent(tag);
   }
 
+  virtual void EndEvent(uint32_t event_handle) {
+    tflite::MicroProfiler::EndEvent(event_handle);
+    cfu_memory_end_op();
+    cfu_profile_end_op();
+  }
+
  private:
   TF_LITE_REMOVE_VIRTUAL_DELETE;
 };
@@ -66,6 +83,12 @@ tflite::MicroProfiler* profiler = nullptr;
 const tflite::Model* model = nullptr;
 tflite::INTERPRETER_TYPE* interpreter = nullptr;
 
+// AAML: images per invoke of the IMGC model (model_converter.py --batch),
+// activations in the arena scale with it
+#ifndef MLPERF_TINY_BATCH
+#define MLPERF_TINY_BATCH 1
+#endif
+
 // C++ 11 does not have a constexpr std::max.
 // For this reason, a small implementation is written.
 template <typename T>
@@ -99,7 +122,7 @@ constexpr int kTensorArenaSize = const_max<int>(
     3 * 1024,
 #endif
 #ifdef INCLUDE_MODEL_MLCOMMONS_TINY_V01_IMGC
-    128 * 1024,
+    128 * 1024 * MLPERF_TINY_BATCH,
 #endif
 #ifdef INCLUDE_MODEL_MLCOMMONS_TINY_V01_KWS
     23 * 1024,
@@ -158,13 +181,29 @@ void tflite_load_model(const unsigned char* model_data,
   // copying or parsing, it's a very lightweight operation.
   model = tflite::GetModel(model_data);
 
+  // Pack conv filters into BUFF_B word order once per model.
+  gemm_weight_pack_model(model);
+  // Find the conv + residual add pairs to fuse.
+  residual_fusion_plan_model(model);
+  // Find the average pool + fully connected pairs to fuse.
+  pool_fusion_plan_model(model);
+  // Live arena bytes per op, for the memory report.
+  cfu_memory_plan_model(model);
+  // Kernel scratch comes off the end of the arena.
+  const size_t interpreter_arena_size =
+      cfu_scratch_plan_model(model, tensor_arena, kTensorArenaSize);
+  if (interpreter_arena_size == 0) {
+    TF_LITE_REPORT_ERROR(error_reporter, "Kernel scratch does not fit the arena");
+    return;
+  }
+
   // Build an interpreter to run the model with.
   // NOLINTNEXTLINE(runtime-global-variables)
   alignas(tflite::INTERPRETER_TYPE) static unsigned char
       buf[sizeof(tflite::INTERPRETER_TYPE)];
   interpreter = new (buf)
       tflite::INTERPRETER_TYPE(model, *op_resolver, tensor_arena,
-                               kTensorArenaSize, nullptr, profiler);
+                               interpreter_arena_size, nullptr, profiler);
 
   // Allocate memory from the tensor_arena for the model's tensors.
   TfLiteStatus allocate_status = interpreter->AllocateTensors();
@@ -215,6 +254,45 @@ void tflite_set_input_unsigned(const unsigned char* data) {
   printf("Set %d bytes at %p\n", input->bytes, input->data.int8);
 }
 
+// AAML: uint8 bytes to the int8 input at byte `offset`, as they arrive. x ^ 0x80
+// is x - 128; it is done a word at a time when both sides are word aligned.
+size_t tflite_write_input_unsigned(size_t offset, const uint8_t* data, size_t len) {
+  auto input = interpreter->input(0);
+  if (offset >= input->bytes) {
+    return 0;
+  }
+  if (len > input->bytes - offset) {
+    len = input->bytes - offset;
+  }
+  uint8_t* dst = reinterpret_cast<uint8_t*>(input->data.int8) + offset;
+  size_t i = 0;
+  for (; i < len && (reinterpret_cast<uintptr_t>(dst + i) & 3); ++i) {
+    dst[i] = data[i] ^ 0x80;
+  }
+  if (!(reinterpret_cast<uintptr_t>(data + i) & 3)) {
+    for (; i + 4 <= len; i += 4) {
+      *reinterpret_cast<uint32_t*>(dst + i) =
+          *reinterpret_cast<const uint32_t*>(data + i) ^ 0x80808080u;
+    }
+  }
+  for (; i < len; ++i) {
+    dst[i] = data[i] ^ 0x80;
+  }
+  return len;
+}
+
+size_t tflite_write_input(size_t offset, const uint8_t* data, size_t len) {
+  auto input = interpreter->input(0);
+  if (offset >= input->bytes) {
+    return 0;
+  }
+  if (len > input->bytes - offset) {
+    len = input->bytes - offset;
+  }
+  memcpy(reinterpret_cast<uint8_t*>(input->data.int8) + offset, data, len);
+  return len;
+}
+
 void tflite_set_input_float(const float* data) {
   auto input = interpreter->input(0);
   memcpy(input->data.f, data, input->bytes);
@@ -253,6 +331,7 @@ void tflite_classify() {
   perf_reset_all_counters();
 
   // perf_set_mcycle is a no-op for some boards, start and end used instead.
+  cfu_profile_begin_invoke();
   uint64_t start = perf_get_mcycle64();
   if (kTfLiteOk != interpreter->Invoke()) {
     puts("Invoke failed.");
@@ -272,12 +351,16 @@ void tflite_invoke_pre() {
   perf_reset_all_counters();
 }
 void tflite_invoke() {
-  // perf_set_mcycle is a no-op for some boards, start and end used instead.
+  cfu_profile_begin_invoke();
   if (kTfLiteOk != interpreter->Invoke()) {
     puts("Invoke failed.");
   }
 }
 
+size_t tflite_arena_used_bytes() {
+  return interpreter ? interpreter->arena_used_bytes() : 0;
+}
+
 int8_t* get_input() { return interpreter->input(0)->data.int8; }
 
 TfLiteTensor* tflite_get_input_tensor(const int input_id){
@@ -52,6 +52,13 @@ void tflite_invoke_pre();
 TfLiteTensor* tflite_get_tensor(const int);
 TfLiteTensor* tflite_get_input_tensor(const int);
 TfLiteTensor* tflite_get_output_tensor(const int);
+// Convert uint8 input bytes into the input tensor at a byte offset; returns
+// the bytes written
+size_t tflite_write_input_unsigned(size_t offset, const uint8_t* data, size_t len);
+// Copy already quantized input bytes in the same way
+size_t tflite_write_input(size_t offset, const uint8_t* data, size_t len);
+// Arena bytes taken by the interpreter of the loaded model
+size_t tflite_arena_used_bytes();
 
 
 // The arena
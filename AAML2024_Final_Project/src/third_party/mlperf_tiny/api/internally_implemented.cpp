@@ -29,8 +29,9 @@ replaced by a fixed-size array.
 char volatile g_cmd_buf[EE_CMD_SIZE + 1];
 size_t volatile g_cmd_pos = 0u;
 
-// Generic buffer to db input.
-uint8_t gp_buff[MAX_DB_INPUT_SIZE];
+// Generic buffer to db input. Every byte is also handed to th_buffer_write()
+// once received, so the input tensor is filled during the load.
+uint8_t gp_buff[MAX_DB_INPUT_SIZE] __attribute__((aligned(4)));
 size_t g_buff_size = 0u;
 size_t g_buff_pos = 0u;
 
@@ -124,12 +125,15 @@ arg_claimed_t ee_profile_parse(char *command) {
     th_printf("db SUBCMD    : Manipulate a generic byte buffer\r\n");
     th_printf("  load N     : Allocate N bytes and set load counter\r\n");
     th_printf("  db HH[HH]* : Load 8-bit hex byte(s) until N bytes\r\n");
+    th_printf("  bin        : Load the rest of the N bytes as binary frames\r\n");
     th_printf("  print [N=16] [offset=0]\r\n");
     th_printf("             : Print N bytes at offset as hex\r\n");
     th_printf(
         "infer N [W=0]: Load input, execute N inferences after W warmup "
         "loops\r\n");
     th_printf("results      : Return the result fp32 vector\r\n");
+    th_printf("cycles [csv|json|reset]\r\n");
+    th_printf("             : Print or clear the per-op cycle profile\r\n");
   } else if (ee_buffer_parse(command) == EE_ARG_CLAIMED) {
   } else if (strncmp(command, "infer", EE_CMD_SIZE) == 0) {
     size_t n = 1;
@@ -160,6 +164,9 @@ arg_claimed_t ee_profile_parse(char *command) {
     ee_infer(n, w);
   } else if (strncmp(command, "results", EE_CMD_SIZE) == 0) {
     th_results();
+  } else if (strncmp(command, "cycles", EE_CMD_SIZE) == 0) {
+    p_next = strtok(NULL, EE_CMD_DELIMITER);
+    th_cycles(p_next);
   } else {
     return EE_ARG_UNCLAIMED;
   }
@@ -224,6 +231,8 @@ arg_claimed_t ee_buffer_parse(char *p_command) {
         }
       }
     }
+  } else if (strncmp(p_next, "bin", EE_CMD_SIZE) == 0) {
+    ee_buffer_load_binary();
   } else if (strncmp(p_next, "print", EE_CMD_SIZE) == 0) {
     size_t i = 0;
     const size_t max = 8;
@@ -256,27 +265,116 @@ arg_claimed_t ee_buffer_parse(char *p_command) {
       return EE_ARG_CLAIMED;
     }
     test[2] = 0;
+    const size_t start = g_buff_pos;
     for (size_t i = 0; i < numbytes;) {
       test[0] = p_next[i++];
       test[1] = p_next[i++];
       res = ee_hexdec(test);
       if (res < 0) {
         th_printf("e-[Invalid hex digit '%s']\r\n", test);
+        th_buffer_write(start, &gp_buff[start], g_buff_pos - start);
         return EE_ARG_CLAIMED;
       } else {
         gp_buff[g_buff_pos] = (uint8_t)res;
         g_buff_pos++;
         if (g_buff_pos == g_buff_size) {
+          th_buffer_write(start, &gp_buff[start], g_buff_pos - start);
           th_printf("m-load-done\r\n");
           /* Disregard the remainder of the digits when done. */
           return EE_ARG_CLAIMED;
         }
       }
     }
+    th_buffer_write(start, &gp_buff[start], g_buff_pos - start);
   }
   return EE_ARG_CLAIMED;
 }
 
+/**
+ * Fletcher-16 of a byte string, continued from `sum` (0 to start).
+ */
+static uint16_t ee_fletcher16(uint16_t sum, const uint8_t *data, size_t len) {
+  uint16_t sum1 = sum & 0xff;
+  uint16_t sum2 = sum >> 8;
+  for (size_t i = 0; i < len; ++i) {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (uint16_t)((sum2 << 8) | sum1);
+}
+
+static uint8_t ee_getbyte(void) { return (uint8_t)th_getchar(); }
+
+/**
+ * `db bin`: receive the rest of the buffer announced by `db load N` as raw
+ * frames, straight into gp_buff, instead of two hex digits per byte.
+ *
+ * Once the DUT prints m-bin-ready, the host sends frames of
+ *
+ *   0xA5, length (2 bytes, LE, 1..EE_BIN_FRAME_MAX),
+ *   Fletcher-16 of the 0xA5 and length bytes (2 bytes, LE), payload,
+ *   Fletcher-16 of the length and payload bytes (2 bytes, LE)
+ *
+ * and waits for the reply to each: m-bin-ack-POS with the bytes received so
+ * far, or m-bin-nak, after which the frame is sent again. The length is only
+ * acted on once its own check passes. A frame longer than the buffer left is
+ * then read to its end and dropped, so the next byte is the next frame. If
+ * the length check fails, the frame end is unknown: the DUT hunts for the
+ * next 0xA5 whose length checks out, and the host, which flushes its input
+ * before the resend, ignores the NAKs of any false marker in the rest of the
+ * bad frame. A frame of length 0 aborts the load, if its checksum is good
+ * too. Frames are not echoed.
+ */
+void ee_buffer_load_binary(void) {
+  if (g_buff_size == 0 || g_buff_size > MAX_DB_INPUT_SIZE) {
+    th_printf("e-[Command 'db bin' requires a valid 'db load N']\r\n");
+    return;
+  }
+  th_printf("m-bin-ready\r\n");
+  while (g_buff_pos < g_buff_size) {
+    /* The marker is in the header check, so a run of zeros never passes */
+    uint8_t sync_header[3] = {EE_BIN_FRAME_SYNC};
+    uint8_t *header = &sync_header[1];
+    while (ee_getbyte() != EE_BIN_FRAME_SYNC) {
+    }
+    header[0] = ee_getbyte();
+    header[1] = ee_getbyte();
+    uint16_t header_check = ee_getbyte();
+    header_check |= ee_getbyte() << 8;
+    if (ee_fletcher16(0, sync_header, 3) != header_check) {
+      th_printf("m-bin-nak\r\n");
+      continue;
+    }
+    size_t len = header[0] | (header[1] << 8);
+    if (len > EE_BIN_FRAME_MAX || len > g_buff_size - g_buff_pos) {
+      /* Drop the payload and checksum, not hunt for a marker inside them */
+      for (size_t i = 0; i < len + 2; ++i) {
+        ee_getbyte();
+      }
+      th_printf("m-bin-nak\r\n");
+      continue;
+    }
+    uint8_t *payload = &gp_buff[g_buff_pos];
+    for (size_t i = 0; i < len; ++i) {
+      payload[i] = ee_getbyte();
+    }
+    uint16_t check = ee_getbyte();
+    check |= ee_getbyte() << 8;
+    if (ee_fletcher16(ee_fletcher16(0, header, 2), payload, len) != check) {
+      th_printf("m-bin-nak\r\n");
+      continue;
+    }
+    if (len == 0) {
+      th_printf("e-[Binary load aborted at %d bytes]\r\n", g_buff_pos);
+      return;
+    }
+    th_buffer_write(g_buff_pos, payload, len);
+    g_buff_pos += len;
+    th_printf("m-bin-ack-%d\r\n", g_buff_pos);
+  }
+  th_printf("m-load-done\r\n");
+}
+
 /**
  * @brief convert a hexidecimal string to a signed long
  * will not produce or process negative numbers except
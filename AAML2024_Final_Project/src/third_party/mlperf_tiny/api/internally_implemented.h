@@ -41,6 +41,10 @@ typedef enum { EE_STATUS_OK = 0, EE_STATUS_ERROR } ee_status_t;
 #define EE_CMD_DELIMITER " "
 #define EE_CMD_TERMINATOR '%'
 
+/* Binary `db bin` frames (see ee_buffer_load_binary) */
+#define EE_BIN_FRAME_SYNC 0xA5
+#define EE_BIN_FRAME_MAX 1024u
+
 #define EE_CMD_NAME "name"
 #define EE_CMD_TIMESTAMP "timestamp"
 
@@ -57,6 +61,7 @@ long ee_hexdec(char *);
 void ee_infer(size_t n, size_t n_warmup);
 size_t ee_get_buffer(uint8_t* buffer, size_t max_len);
 arg_claimed_t ee_buffer_parse(char *command);
+void ee_buffer_load_binary(void);
 arg_claimed_t ee_profile_parse(char *command);
 
 #endif /* MLPERF_TINY_V0_1_API_INTERNALLY_IMPLEMENTED_H_ */
@@ -29,9 +29,23 @@ methods from th_libc.h and all testharness methods from th_lib.h are here.
 /// gather energy measurments we recommend using the EEMBC test suite.
 #define EE_MSG_TIMESTAMP "m-lap-us-%lu\r\n"
 #define TH_VENDOR_NAME_STRING "NYCU-CAS-LAB"
-#define TH_MODEL_VERSION EE_MODEL_VERSION_IC01
 
+// AAML: the workload comes from the INCLUDE_MODEL_MLCOMMONS_TINY_V01_* define
+#include "mlperf_workload.h"
+#define TH_MODEL_VERSION MLPERF_WORKLOAD_VERSION
+
+// AAML: samples per invoke, must match the batch of the model (see the
+// --batch option of model_converter.py). "db load" takes up to this many
+// samples and "results" prints one line per sample.
+#ifndef MLPERF_TINY_BATCH
+#define MLPERF_TINY_BATCH 1
+#endif
+
+#if MLPERF_WORKLOAD_SAMPLE_BYTES * MLPERF_TINY_BATCH > 96 * 96 * 3
+#define MAX_DB_INPUT_SIZE (MLPERF_WORKLOAD_SAMPLE_BYTES * MLPERF_TINY_BATCH)
+#else
 #define MAX_DB_INPUT_SIZE (96 * 96 * 3)
+#endif
 #ifndef TH_MODEL_VERSION
 // See "internally_implemented.h" for a list
 #error "PLease set TH_MODEL_VERSION to one of the EE_MODEL_VERSION_* defines"
@@ -72,6 +86,8 @@ void th_final_initialize(void);
 void th_pre();
 void th_post();
 void th_command_ready(char volatile *msg);
+void th_buffer_write(size_t offset, const uint8_t *data, size_t len);
+void th_cycles(const char *subcmd);
 
 /// \brief libc hooks
 int th_strncmp(const char *str1, const char *str2, size_t n);
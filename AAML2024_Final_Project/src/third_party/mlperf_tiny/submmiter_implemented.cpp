@@ -28,59 +28,110 @@ in th_results is copied from the original in EEMBC.
 
 #include <stdio.h>
 
-#include "tiny/v0.1/training/image_classification/trained_models/pretrainedResnet_quant.h"
-
+#include "cfu_profile.h"
 #include "menu.h"
+#include "mlperf_workload.h"
 #include "tflite.h"
 #include "perf.h"
 
-const int kIcInputSize = 32*32*3;
+// Samples in the input tensor that were loaded by the last "db" command
+static int g_loaded_samples = 1;
+
+#if MLPERF_WORKLOAD_INPUT == MLPERF_INPUT_FLOAT32
+// The float input of the last load, kept for the AD reconstruction error
+static float g_input_float[MAX_DB_INPUT_SIZE / sizeof(float)];
+#endif
+
+// Input tensor bytes per sample, the model's batch is dimension 0
+static size_t tensor_sample_bytes(const TfLiteTensor* input) {
+  return input->bytes / input->dims->data[0];
+}
 
+// Called by ee_buffer_parse() with the db bytes as they arrive: 8-bit
+// samples go straight into the [MLPERF_TINY_BATCH, ...] input tensor. Float
+// samples are quantized in th_load_tensor, once the whole db is in.
+void th_buffer_write(size_t offset, const uint8_t *data, size_t len) {
+#if MLPERF_WORKLOAD_INPUT == MLPERF_INPUT_UINT8
+  tflite_write_input_unsigned(offset, data, len);
+#elif MLPERF_WORKLOAD_INPUT == MLPERF_INPUT_INT8
+  tflite_write_input(offset, data, len);
+#else
+  (void)offset;
+  (void)data;
+  (void)len;
+#endif
+}
 
 // Implement this method to prepare for inference and preprocess inputs.
+// The input tensor already holds the 1 .. MLPERF_TINY_BATCH samples of the
+// db buffer (see th_buffer_write), except for float input.
 void th_load_tensor() {
-  uint8_t input_quantized[kIcInputSize];
-  int8_t input_asint[kIcInputSize];
-
-  size_t bytes = ee_get_buffer(reinterpret_cast<uint8_t *>(input_quantized),
-                               kIcInputSize * sizeof(uint8_t));
-  if (bytes / sizeof(uint8_t) != kIcInputSize) {
-    th_printf("Input db has %d elemented, expected %d\n", bytes / sizeof(uint8_t),
-              kIcInputSize);
+  TfLiteTensor* input = tflite_get_input_tensor(0);
+  const size_t tensor_bytes = tensor_sample_bytes(input);
+  const int batch = input->dims->data[0];
+#if MLPERF_WORKLOAD_INPUT == MLPERF_INPUT_FLOAT32
+  const size_t sample_bytes = tensor_bytes * sizeof(float);
+#else
+  const size_t sample_bytes = tensor_bytes;
+#endif
+
+  size_t bytes = ee_get_buffer(nullptr, sample_bytes * batch);
+  if (bytes == 0 || bytes % sample_bytes != 0) {
+    th_printf("Input db has %d elemented, expected a multiple of %d (up to %d)\n",
+              bytes, sample_bytes, batch * sample_bytes);
     return;
   }
-  uint16_t i = 0;
-  for(i=0; i<kIcInputSize;i++)
-  {
-	  if(input_quantized[i]<=127)
-	    input_asint[i] = ((int8_t)input_quantized[i]) - 128;
-	  else
-	    input_asint[i] = (int8_t)(input_quantized[i] - 128);
+  g_loaded_samples = bytes / sample_bytes;
+
+#if MLPERF_WORKLOAD_INPUT == MLPERF_INPUT_FLOAT32
+  ee_get_buffer(reinterpret_cast<uint8_t*>(g_input_float), bytes);
+  const float scale = input->params.scale;
+  const int zero_point = input->params.zero_point;
+  for (size_t i = 0; i < bytes / sizeof(float); i++) {
+    input->data.int8[i] = QuantizeFloatToInt8(g_input_float[i], scale, zero_point);
   }
- 
-  tflite_set_input(input_asint);
+#endif
+
   tflite_invoke_pre();
 }
 
 // Add to this method to return real inference results.
+// One m-results line per loaded sample, in load order.
 void th_results() {
-  const int nresults = 10;
   /**
    * The results need to be printed back in exactly this format; if easier
    * to just modify this loop than copy to results[] above, do that.
    */
-  th_printf("m-results-[");
-  int kCategoryCount = 10;
-
+  TfLiteTensor* output = tflite_get_output_tensor(0);
+  const int output_count = tensor_sample_bytes(output);
   int8_t* output_data = tflite_get_output();
 
-  for (int i = 0; i < kCategoryCount; i++) {
-    th_printf("%d", output_data[i]);
-    if (i < (nresults - 1)) {
-      th_printf(",");
+  for (int sample = 0; sample < g_loaded_samples; sample++) {
+    const int8_t* result = output_data + sample * output_count;
+#if MLPERF_WORKLOAD_INPUT == MLPERF_INPUT_FLOAT32
+    // Anomaly score: mean squared error of the reconstruction. printf may
+    // not have %f, so it is printed as fixed point with 3 decimals.
+    const float* expected = g_input_float + sample * output_count;
+    float diffsum = 0;
+    for (int i = 0; i < output_count; i++) {
+      const float diff = DequantizeInt8ToFloat(result[i], output->params.scale,
+                                               output->params.zero_point) -
+                         expected[i];
+      diffsum += diff * diff;
+    }
+    const int score = static_cast<int>(diffsum / output_count * 1000 + 0.5f);
+    th_printf("m-results-[%d.%03d]\r\n", score / 1000, score % 1000);
+#else
+    th_printf("m-results-[");
+    for (int i = 0; i < output_count; i++) {
+      th_printf("%d", result[i]);
+      if (i < (output_count - 1)) {
+        th_printf(",");
+      }
     }
+    th_printf("]\r\n");
+#endif
   }
-  th_printf("]\r\n");
 }
 
 // Implement this method with the logic to perform one inference cycle.
@@ -88,7 +139,7 @@ void th_infer() { tflite_invoke(); }
 
 /// \brief optional API.
 void th_final_initialize(void) {
-  tflite_load_model(pretrainedResnet_quant, pretrainedResnet_quant_len);
+  tflite_load_model(MLPERF_WORKLOAD_MODEL, MLPERF_WORKLOAD_MODEL_LEN);
 }
 void th_pre() {}
 void th_post() {}
@@ -98,6 +149,19 @@ void th_command_ready(char volatile *p_command) {
   ee_serial_command_parser_callback((char *)p_command);
 }
 
+// Print the per-op cycle profile of the inferences since the last reset
+// (subcmd "csv" or "json"), or clear it (subcmd "reset").
+void th_cycles(const char *subcmd) {
+  if (subcmd && strcmp(subcmd, "reset") == 0) {
+    cfu_profile_reset();
+    th_printf("m-cycles-reset\r\n");
+    return;
+  }
+  th_printf("m-cycles-begin\r\n");
+  cfu_profile_dump(subcmd && strcmp(subcmd, "json") == 0);
+  th_printf("m-cycles-end\r\n");
+}
+
 // th_libc implementations.
 int th_strncmp(const char *str1, const char *str2, size_t n) {
   return strncmp(str1, str2, n);
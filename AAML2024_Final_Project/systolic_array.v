@@ -4,7 +4,10 @@ module systolic_array #(
     parameter ArraySize = 4,
     parameter DataWidth = 8,
     parameter AccWidth = 32,
-    parameter UseSigned = 0
+    parameter UseSigned = 0,
+    // 1: input_col is multiplied as it is and offset is not used (the input
+    // offset is folded into the bias), so the PEs are DataWidth wide
+    parameter FoldOffset = 0
 ) (
     input  clk,
     input  rst_n,
@@ -62,6 +65,7 @@ wire done;
 // ==========
 localparam S_IDLE = 'd0;
 localparam S_RUN = 'd1;
+localparam PeWidth = FoldOffset ? DataWidth : DataWidth + 1;
 integer idx;
 
 // ==========
@@ -202,7 +206,7 @@ generate
     genvar i, j;
     for (i = 0; i < ArraySize; i = i + 1) begin : idx_x
         for (j = 0; j < ArraySize; j = j + 1) begin : idx_y
-            wire [DataWidth:0] in_x, in_y, out_x, out_y;
+            wire [PeWidth-1:0] in_x, in_y, out_x, out_y;
             wire [AccWidth-1:0] value;
 
             if (i == 0) begin
@@ -211,7 +215,9 @@ generate
                 assign in_y = idx_x[i-1].idx_y[j].out_y;
             end
 
-            if (j == 0) begin
+            if (j == 0 && FoldOffset) begin
+                assign in_x = sa_xin[i];
+            end else if (j == 0) begin
                 assign in_x = {sa_xin[i][DataWidth-1], sa_xin[i]} + offset;
             end else begin
                 assign in_x = idx_x[i].idx_y[j-1].out_x;
@@ -220,7 +226,7 @@ generate
             assign sa_out_row[i][(ArraySize-j)*AccWidth-1 -: AccWidth] = value;
 
             proc_element #(
-                .DataWidth(DataWidth+1),
+                .DataWidth(PeWidth),
                 .AccWidth (AccWidth),
                 .UseSigned(UseSigned)
             ) u_pe (